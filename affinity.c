@@ -0,0 +1,86 @@
+#include "affinity.h"
+
+#include <linux/mempolicy.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+
+int affinity_parse(char const* spec, cpu_set_t* set) {
+  CPU_ZERO(set);
+  if(!spec) return 0;
+
+  char const* cursor = spec;
+  while(*cursor) {
+    if(!isdigit((unsigned char)*cursor)) return -1;
+    char* end;
+    long first = strtol(cursor, &end, 10);
+    long last = first;
+    if(*end == '-') {
+      if(!isdigit((unsigned char)end[1])) return -1;
+      last = strtol(end + 1, &end, 10);
+    }
+    if(last < first || last >= CPU_SETSIZE) return -1;
+    for(long cpu = first; cpu <= last; ++cpu) {
+      CPU_SET(cpu, set);
+    }
+    if(*end == ',') ++end;
+    else if(*end) return -1;
+    cursor = end;
+  }
+  return 0;
+}
+
+int affinity_nth_cpu(cpu_set_t const* set, unsigned int index) {
+  index %= CPU_COUNT(set);
+  for(int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+    if(CPU_ISSET(cpu, set) && index-- == 0) return cpu;
+  }
+  return 0;
+}
+
+void affinity_apply(pthread_attr_t* attr, cpu_set_t const* set) {
+  if(CPU_COUNT(set) == 0) return;
+  if(pthread_attr_setaffinity_np(attr, sizeof(cpu_set_t), set) != 0) {
+    fprintf(stderr, "Warning: unable to set thread affinity\n");
+  }
+}
+
+int affinity_cpu_node(int cpu) {
+  char path[64];
+  for(int node = 0; node < affinity_node_count(); ++node) {
+    sprintf(path, "/sys/devices/system/node/node%d/cpu%d", node, cpu);
+    if(access(path, F_OK) == 0) return node;
+  }
+  return 0;
+}
+
+int affinity_node_count() {
+  static int count = 0;
+  if(count == 0) {
+    char path[64];
+    int nodes = 0;
+    for(;;) {
+      sprintf(path, "/sys/devices/system/node/node%d", nodes);
+      if(access(path, F_OK) != 0) break;
+      ++nodes;
+    }
+    count = nodes ? nodes : 1;
+  }
+  return count;
+}
+
+void* affinity_alloc_on_node(size_t size, int node) {
+  void* addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if(addr == MAP_FAILED) return NULL;
+  unsigned long mask = 1UL << node;
+  // Best effort - without the binding memory simply follows first touch
+  syscall(SYS_mbind, addr, size, MPOL_PREFERRED, &mask, sizeof(mask) * 8, 0);
+  return addr;
+}
+
+void affinity_free(void* addr, size_t size) {
+  munmap(addr, size);
+}
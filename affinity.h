@@ -0,0 +1,30 @@
+#ifndef _AFFINITY_H_
+#define _AFFINITY_H_
+
+// Needs _GNU_SOURCE for cpu_set_t, the Makefile defines it for every unit
+#include <pthread.h>
+#include <sched.h>
+#include <stddef.h>
+
+// Parse a CPU list such as "0-3,8,10-11" - returns 0 on success, -1 if malformed.
+// An empty or NULL spec gives an empty set, which means "do not pin".
+int affinity_parse(char const* spec, cpu_set_t* set);
+
+// The index-th CPU of set, wrapping around - undefined if set is empty
+int affinity_nth_cpu(cpu_set_t const* set, unsigned int index);
+
+// Restrict threads created with attr to set, does nothing if set is empty
+void affinity_apply(pthread_attr_t* attr, cpu_set_t const* set);
+
+// NUMA node a CPU belongs to, 0 if the topology is unknown
+int affinity_cpu_node(int cpu);
+
+// Number of NUMA nodes with memory, at least 1
+int affinity_node_count();
+
+// Allocate page-aligned memory preferring node, so first touch lands there.
+// Falls back to the default policy if the kernel refuses the binding.
+void* affinity_alloc_on_node(size_t size, int node);
+void affinity_free(void* addr, size_t size);
+
+#endif
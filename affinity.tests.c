@@ -0,0 +1,48 @@
+#include "affinity.h"
+
+#include <assert.h>
+#include <stdio.h>
+
+void test_affinity_parse() {
+  printf("Test parse CPU lists\n");
+  cpu_set_t set;
+  assert(affinity_parse("", &set) == 0);
+  assert(CPU_COUNT(&set) == 0);
+  assert(affinity_parse(NULL, &set) == 0);
+  assert(CPU_COUNT(&set) == 0);
+
+  assert(affinity_parse("0-3,8,10-11", &set) == 0);
+  assert(CPU_COUNT(&set) == 7);
+  assert(CPU_ISSET(0, &set) && CPU_ISSET(3, &set) && CPU_ISSET(8, &set) && CPU_ISSET(11, &set));
+  assert(!CPU_ISSET(4, &set) && !CPU_ISSET(9, &set));
+
+  assert(affinity_nth_cpu(&set, 0) == 0);
+  assert(affinity_nth_cpu(&set, 4) == 8);
+  assert(affinity_nth_cpu(&set, 7) == 0); // Wraps around
+}
+
+void test_affinity_parse_malformed() {
+  printf("Test reject malformed CPU lists\n");
+  cpu_set_t set;
+  assert(affinity_parse("a", &set) == -1);
+  assert(affinity_parse("3-1", &set) == -1);
+  assert(affinity_parse("1-", &set) == -1);
+  assert(affinity_parse("1;2", &set) == -1);
+}
+
+void test_affinity_alloc_on_node() {
+  printf("Test node-local allocation\n");
+  assert(affinity_node_count() >= 1);
+  int const node = affinity_cpu_node(0);
+  char* memory = affinity_alloc_on_node(1 << 16, node);
+  assert(memory);
+  memory[0] = memory[(1 << 16) - 1] = 1; // First touch
+  affinity_free(memory, 1 << 16);
+}
+
+int main() {
+  test_affinity_parse();
+  test_affinity_parse_malformed();
+  test_affinity_alloc_on_node();
+  return 0;
+}
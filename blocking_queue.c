@@ -1,17 +1,46 @@
 #include "blocking_queue.h"
 #include "utilities.h"
+#include "lock_profile.h"
 
 // Student : Salameh Alfasatleh ID: 20578169
 #include "list.h"             
 #include <pthread.h>          
 #include <assert.h>           
 #include <stdio.h>            
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+// Keep the eventfd readable exactly while a pop would not block. Only the
+// empty/non-empty edges cost a system call.
+static void update_readiness_locked(BlockingQueueT* queue) {
+  if (queue->event_fd < 0) {
+    return;
+  }
+  int const ready = queue->length > 0 || queue->terminated;
+  if (ready && !queue->readable) {
+    uint64_t const one = 1;
+    if (write(queue->event_fd, &one, sizeof(one)) != sizeof(one)) {
+      fprintf(stderr, "Error: Failed to signal queue eventfd\n");
+      exit(EXIT_FAILURE);
+    }
+  } else if (!ready && queue->readable) {
+    uint64_t count;
+    if (read(queue->event_fd, &count, sizeof(count)) != sizeof(count)) {
+      fprintf(stderr, "Error: Failed to clear queue eventfd\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+  queue->readable = ready;
+}
 
 void blocking_queue_terminate(BlockingQueueT* queue) {
-  pthread_mutex_lock(&queue->mutex);
+  PROFILED_LOCK(&queue->mutex);
   queue->terminated = 1;
+  update_readiness_locked(queue);
   pthread_cond_broadcast(&queue->cond); 
-  pthread_mutex_unlock(&queue->mutex);
+  PROFILED_UNLOCK(&queue->mutex);
 }
 
 void blocking_queue_create(BlockingQueueT* queue) {
@@ -20,51 +49,104 @@ void blocking_queue_create(BlockingQueueT* queue) {
   pthread_cond_init(&queue->cond, NULL);
   queue->terminated = 0;
   queue->length = 0;
+  queue->event_fd = -1;
+  queue->readable = 0;
 }
 
 void blocking_queue_destroy(BlockingQueueT* queue) {
   pthread_mutex_destroy(&queue->mutex);
   pthread_cond_destroy(&queue->cond);
   list_destroy(queue->list);
+  if (queue->event_fd >= 0) {
+    close(queue->event_fd);
+  }
 }
 
 void blocking_queue_push(BlockingQueueT* queue, unsigned int value) {
-  pthread_mutex_lock(&queue->mutex);
+  PROFILED_LOCK(&queue->mutex);
   list_append(queue->list, value);
   queue->length++;
+  update_readiness_locked(queue);
   pthread_cond_signal(&queue->cond); 
-  pthread_mutex_unlock(&queue->mutex);
+  PROFILED_UNLOCK(&queue->mutex);
 }
 
 int blocking_queue_pop(BlockingQueueT* queue, unsigned int* value) {
-  pthread_mutex_lock(&queue->mutex);
+  PROFILED_LOCK(&queue->mutex);
 
   while (queue->length == 0 && !queue->terminated) {
-    pthread_cond_wait(&queue->cond, &queue->mutex);
+    PROFILED_WAIT(&queue->cond, &queue->mutex);
   }
 
   if (queue->terminated) {
-    pthread_mutex_unlock(&queue->mutex);
+    PROFILED_UNLOCK(&queue->mutex);
     return -1;  
   }
 
   *value = list_pop_front(queue->list);
   queue->length--;
+  update_readiness_locked(queue);
 
-  pthread_mutex_unlock(&queue->mutex);
+  PROFILED_UNLOCK(&queue->mutex);
   return 0; 
 }
 
+int blocking_queue_try_pop(BlockingQueueT* queue, unsigned int* value) {
+  PROFILED_LOCK(&queue->mutex);
+  int result = 1;
+  if (queue->terminated) {
+    result = -1;
+  } else if (queue->length > 0) {
+    *value = list_pop_front(queue->list);
+    queue->length--;
+    update_readiness_locked(queue);
+    result = 0;
+  }
+  PROFILED_UNLOCK(&queue->mutex);
+  return result;
+}
+
+int blocking_queue_drain(BlockingQueueT* queue, unsigned int* values, int capacity) {
+  PROFILED_LOCK(&queue->mutex);
+  if (queue->terminated) {
+    PROFILED_UNLOCK(&queue->mutex);
+    return -1;
+  }
+  int taken = 0;
+  while (taken < capacity && queue->length > 0) {
+    values[taken++] = list_pop_front(queue->list);
+    queue->length--;
+  }
+  update_readiness_locked(queue);
+  PROFILED_UNLOCK(&queue->mutex);
+  return taken;
+}
+
+int blocking_queue_event_fd(BlockingQueueT* queue) {
+  PROFILED_LOCK(&queue->mutex);
+  if (queue->event_fd < 0) {
+    queue->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (queue->event_fd < 0) {
+      fprintf(stderr, "Error: Failed to create queue eventfd\n");
+      exit(EXIT_FAILURE);
+    }
+    update_readiness_locked(queue);
+  }
+  int const fd = queue->event_fd;
+  PROFILED_UNLOCK(&queue->mutex);
+  return fd;
+}
+
 int blocking_queue_empty(BlockingQueueT* queue) {
-  pthread_mutex_lock(&queue->mutex);
+  PROFILED_LOCK(&queue->mutex);
   int is_empty = (queue->length == 0);
-  pthread_mutex_unlock(&queue->mutex);
+  PROFILED_UNLOCK(&queue->mutex);
   return is_empty;
 }
 
 int blocking_queue_length(BlockingQueueT* queue) {
-  pthread_mutex_lock(&queue->mutex);
+  PROFILED_LOCK(&queue->mutex);
   int length = queue->length;
-  pthread_mutex_unlock(&queue->mutex);
+  PROFILED_UNLOCK(&queue->mutex);
   return length;;
 }
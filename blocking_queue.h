@@ -13,6 +13,8 @@ typedef struct BlockingQueue {
   pthread_cond_t cond;        
   int terminated;             
   int length;                 
+  int event_fd;               // -1 until blocking_queue_event_fd is called
+  int readable;               // Whether event_fd currently reads as ready
 } BlockingQueueT;
 
 void blocking_queue_create(BlockingQueueT* queue);
@@ -21,6 +23,20 @@ void blocking_queue_destroy(BlockingQueueT* queue);
 void blocking_queue_push(BlockingQueueT* queue, unsigned int value);
 int blocking_queue_pop(BlockingQueueT* queue, unsigned int* value);
 
+// Pop without waiting: 0 on success, 1 if the queue is empty, -1 once terminated
+int blocking_queue_try_pop(BlockingQueueT* queue, unsigned int* value);
+
+// Pop up to capacity values in one lock hold. Returns how many were taken,
+// or -1 once terminated. Fewer than capacity means the queue is now empty.
+int blocking_queue_drain(BlockingQueueT* queue, unsigned int* values, int capacity);
+
+// An eventfd that polls readable while a pop would not block, that is while
+// the queue holds values or has been terminated, so one thread can wait on
+// many queues, timers and sockets with epoll instead of one thread per queue.
+// Created on first call and closed by blocking_queue_destroy. Readiness is
+// level-triggered: consume with try_pop or drain, never by reading the fd.
+int blocking_queue_event_fd(BlockingQueueT* queue);
+
 int blocking_queue_empty(BlockingQueueT* queue);
 int blocking_queue_length(BlockingQueueT* queue);
 
@@ -6,6 +6,10 @@
 // Student : Salameh Alfasatleh ID: 20578169
 
 #include <stdio.h>  
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
 
 void test_blocking_queue_basic() {
   BlockingQueueT queue;
@@ -41,9 +45,160 @@ void test_blocking_queue_termination() {
   printf("test_blocking_queue_termination passed!\n");
 }
 
+void test_blocking_queue_try_pop_drain() {
+  BlockingQueueT queue;
+  blocking_queue_create(&queue);
+
+  unsigned int value;
+  assert(blocking_queue_try_pop(&queue, &value) == 1);
+  for (unsigned int i = 0; i < 10; i++) {
+    blocking_queue_push(&queue, i);
+  }
+  assert(blocking_queue_try_pop(&queue, &value) == 0);
+  assert(value == 0);
+
+  unsigned int values[4];
+  assert(blocking_queue_drain(&queue, values, 4) == 4);
+  assert(values[0] == 1 && values[3] == 4);
+  assert(blocking_queue_drain(&queue, values, 4) == 4);
+  assert(blocking_queue_drain(&queue, values, 4) == 1);
+  assert(values[0] == 9);
+  assert(blocking_queue_empty(&queue) == 1);
+
+  blocking_queue_terminate(&queue);
+  assert(blocking_queue_try_pop(&queue, &value) == -1);
+  assert(blocking_queue_drain(&queue, values, 4) == -1);
+
+  blocking_queue_destroy(&queue);
+  printf("test_blocking_queue_try_pop_drain passed!\n");
+}
+
+static int readable(int fd) {
+  int const epoll = epoll_create1(0);
+  struct epoll_event event = { .events = EPOLLIN };
+  epoll_ctl(epoll, EPOLL_CTL_ADD, fd, &event);
+  int const ready = epoll_wait(epoll, &event, 1, 0);
+  close(epoll);
+  return ready == 1;
+}
+
+void test_blocking_queue_event_fd() {
+  BlockingQueueT queue;
+  blocking_queue_create(&queue);
+  blocking_queue_push(&queue, 7);
+
+  // A queue holding values is readable as soon as its fd exists
+  int const fd = blocking_queue_event_fd(&queue);
+  assert(fd == blocking_queue_event_fd(&queue));
+  assert(readable(fd));
+  unsigned int value;
+  assert(blocking_queue_try_pop(&queue, &value) == 0);
+  assert(!readable(fd));
+  blocking_queue_push(&queue, 8);
+  blocking_queue_push(&queue, 9);
+  assert(readable(fd));
+  assert(blocking_queue_pop(&queue, &value) == 0);
+  assert(readable(fd));
+  assert(blocking_queue_pop(&queue, &value) == 0);
+  assert(!readable(fd));
+
+  blocking_queue_terminate(&queue);
+  assert(readable(fd));
+
+  blocking_queue_destroy(&queue);
+  printf("test_blocking_queue_event_fd passed!\n");
+}
+
+#define EPOLL_VALUES 1000
+
+static void* produce(void* arg) {
+  BlockingQueueT* queues = (BlockingQueueT*)arg;
+  for (unsigned int i = 0; i < EPOLL_VALUES; i++) {
+    blocking_queue_push(&queues[i % 2], i);
+    if (i % 100 == 0) {
+      usleep(100);
+    }
+  }
+  blocking_queue_terminate(&queues[0]);
+  blocking_queue_terminate(&queues[1]);
+  return NULL;
+}
+
+// One thread serves two queues and a periodic timer, standing in for the
+// event source tick, from a single epoll_wait
+void test_blocking_queue_epoll() {
+  BlockingQueueT queues[2];
+  blocking_queue_create(&queues[0]);
+  blocking_queue_create(&queues[1]);
+
+  int const epoll = epoll_create1(0);
+  assert(epoll >= 0);
+  for (unsigned int i = 0; i < 2; i++) {
+    struct epoll_event event = { .events = EPOLLIN, .data.u32 = i };
+    assert(epoll_ctl(epoll, EPOLL_CTL_ADD, blocking_queue_event_fd(&queues[i]), &event) == 0);
+  }
+  int const timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+  struct itimerspec const period = { { 0, 1000000 }, { 0, 1000000 } };
+  timerfd_settime(timer, 0, &period, NULL);
+  struct epoll_event timer_event = { .events = EPOLLIN, .data.u32 = 2 };
+  assert(epoll_ctl(epoll, EPOLL_CTL_ADD, timer, &timer_event) == 0);
+
+  pthread_t producer;
+  assert(pthread_create(&producer, NULL, produce, queues) == 0);
+
+  unsigned long long sum = 0;
+  unsigned int received = 0, open = 2;
+  while (open > 0) {
+    struct epoll_event events[3];
+    int const n = epoll_wait(epoll, events, 3, -1);
+    for (int e = 0; e < n; e++) {
+      unsigned int const source = events[e].data.u32;
+      if (source == 2) {
+        uint64_t ticks;
+        assert(read(timer, &ticks, sizeof(ticks)) == sizeof(ticks));
+        continue;
+      }
+      unsigned int values[64];
+      int taken;
+      while ((taken = blocking_queue_drain(&queues[source], values, 64)) > 0) {
+        for (int i = 0; i < taken; i++) {
+          assert(values[i] % 2 == source);
+          sum += values[i];
+        }
+        received += taken;
+      }
+      if (taken < 0) {
+        assert(epoll_ctl(epoll, EPOLL_CTL_DEL, blocking_queue_event_fd(&queues[source]), NULL) == 0);
+        open--;
+      }
+    }
+  }
+  pthread_join(producer, NULL);
+
+  // Termination may overtake values not yet drained, so count what is left
+  for (unsigned int q = 0; q < 2; q++) {
+    while (queues[q].length > 0) {
+      sum += list_pop_front(queues[q].list);
+      queues[q].length--;
+      received++;
+    }
+  }
+  assert(received == EPOLL_VALUES);
+  assert(sum == (unsigned long long)EPOLL_VALUES * (EPOLL_VALUES - 1) / 2);
+
+  close(timer);
+  close(epoll);
+  blocking_queue_destroy(&queues[0]);
+  blocking_queue_destroy(&queues[1]);
+  printf("test_blocking_queue_epoll passed!\n");
+}
+
 int main() {
   test_blocking_queue_basic();
   test_blocking_queue_termination();
+  test_blocking_queue_try_pop_drain();
+  test_blocking_queue_event_fd();
+  test_blocking_queue_epoll();
   printf("All tests passed!\n");
   return 0;
 }
@@ -2,15 +2,30 @@
 #include "environment.h"
 #include "event_source.h"
 #include "logger.h"
+#include "stats.h"
 
 #ifndef SIMULATOR_THREADS
 #define SIMULATOR_THREADS 2
 #endif
 
+// The worker pool grows and shrinks between these bounds
+#ifndef SIMULATOR_MIN_THREADS
+#define SIMULATOR_MIN_THREADS SIMULATOR_THREADS
+#endif
+
+#ifndef SIMULATOR_MAX_THREADS
+#define SIMULATOR_MAX_THREADS SIMULATOR_THREADS
+#endif
+
 #ifndef SIMULATOR_MAX_PROCESSES
 #define SIMULATOR_MAX_PROCESSES 2048
 #endif
 
+// Live processes admitted at once, 0 for no limit - creators wait beyond it
+#ifndef SIMULATOR_MAX_LIVE_PROCESSES
+#define SIMULATOR_MAX_LIVE_PROCESSES 0
+#endif
+
 #ifndef ENVIRONMENT_THREADS
 #define ENVIRONMENT_THREADS 2
 #endif
@@ -27,15 +42,94 @@
 #define EVENT_SOURCE_INTERVAL 10
 #endif
 
+// Back-to-back slices a worker may run of one process while nothing else is ready
+#ifndef SIMULATOR_COALESCE_SLICES
+#define SIMULATOR_COALESCE_SLICES 1
+#endif
+
+// 1 to size each process's quantum from its recent CPU usage
+#ifndef SIMULATOR_ADAPTIVE_QUANTUM
+#define SIMULATOR_ADAPTIVE_QUANTUM 0
+#endif
+
+// Ready processes a worker evaluates together per dispatch
+#ifndef SIMULATOR_DISPATCH_BATCH
+#define SIMULATOR_DISPATCH_BATCH 1
+#endif
+
+// Fibers per worker, each running one process at a time; 0 for plain workers
+#ifndef SIMULATOR_FIBERS_PER_WORKER
+#define SIMULATOR_FIBERS_PER_WORKER 0
+#endif
+
+// Simulated cores with their own ready queues, 0 to let workers stand in for
+// CPUs, and the CPU time charged when a process moves between them
+#ifndef SIMULATOR_CORES
+#define SIMULATOR_CORES 0
+#endif
+#ifndef SIMULATOR_MIGRATION_PENALTY
+#define SIMULATOR_MIGRATION_PENALTY 20
+#endif
+
+// 1 to pick processes by stride scheduling over share groups instead of FIFO
+#ifndef SIMULATOR_STRIDE_SCHEDULING
+#define SIMULATOR_STRIDE_SCHEDULING 0
+#endif
+
+// CPU lists such as "0-3,8" - empty leaves the threads unpinned
+#ifndef SIMULATOR_CPUS
+#define SIMULATOR_CPUS ""
+#endif
+
+#ifndef EVENT_SOURCE_CPUS
+#define EVENT_SOURCE_CPUS ""
+#endif
+
+#ifndef ENVIRONMENT_CPUS
+#define ENVIRONMENT_CPUS ""
+#endif
+
+// File live counters are published to for simtop - empty disables publishing
+#ifndef STATS_PATH
+#define STATS_PATH ""
+#endif
+
+// Chrome/Perfetto trace-event file written at shutdown - empty disables tracing
+#ifndef TRACE_PATH
+#define TRACE_PATH ""
+#endif
+
+#ifndef STATS_INTERVAL_MS
+#define STATS_INTERVAL_MS 500
+#endif
+
 int main() {
   logger_start();
   logger_write("Starting simulator");
-  simulator_start(SIMULATOR_THREADS, SIMULATOR_MAX_PROCESSES);
-  event_source_start(EVENT_SOURCE_INTERVAL);
-  environment_start(ENVIRONMENT_THREADS, ITERATIONS, BATCH_SIZE);
-  environment_stop();
-  event_source_stop();
-  simulator_stop();
+  if (STATS_PATH[0]) {
+    stats_start(STATS_PATH, STATS_INTERVAL_MS);
+  }
+  SimulatorConfigT const config = {
+    .cpus = SIMULATOR_CPUS,
+    .min_threads = SIMULATOR_MIN_THREADS,
+    .max_threads = SIMULATOR_MAX_THREADS,
+    .coalesce_slices = SIMULATOR_COALESCE_SLICES,
+    .adaptive_quantum = SIMULATOR_ADAPTIVE_QUANTUM,
+    .dispatch_batch = SIMULATOR_DISPATCH_BATCH,
+    .fibers_per_worker = SIMULATOR_FIBERS_PER_WORKER,
+    .simulated_cores = SIMULATOR_CORES,
+    .migration_penalty = SIMULATOR_MIGRATION_PENALTY,
+    .stride_scheduling = SIMULATOR_STRIDE_SCHEDULING,
+    .max_live_processes = SIMULATOR_MAX_LIVE_PROCESSES,
+    .trace_path = TRACE_PATH,
+  };
+  SimulatorT* simulator = simulator_start(SIMULATOR_THREADS, SIMULATOR_MAX_PROCESSES, &config);
+  EventSourceT* event_source = event_source_start(simulator, EVENT_SOURCE_INTERVAL, EVENT_SOURCE_CPUS);
+  EnvironmentT* environment = environment_start(simulator, ENVIRONMENT_THREADS, ITERATIONS, BATCH_SIZE, ENVIRONMENT_CPUS);
+  environment_stop(environment);
+  event_source_stop(event_source);
+  simulator_stop(simulator);
+  stats_stop();
   logger_write("Stopping simulator");
   logger_stop();
   return 0;
@@ -4,50 +4,85 @@
 #include "evaluator.h"
 #include "list.h"
 #include "logger.h"
+#include "affinity.h"
 #include <pthread.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <unistd.h>
+
+// How long a batch waits for PCBs when the simulator limits live processes
+#ifndef ENVIRONMENT_ADMISSION_TIMEOUT_MS
+#define ENVIRONMENT_ADMISSION_TIMEOUT_MS 1000
+#endif
+
+// Pause between polls while the simulator is above its high watermark
+#ifndef ENVIRONMENT_THROTTLE_US
+#define ENVIRONMENT_THROTTLE_US 100
+#endif
 
 // Thread management structures
-pthread_t* environment_threads = NULL;
-unsigned int environment_thread_count = 0;
+struct Environment {
+    SimulatorT* simulator;
+    pthread_t* threads;
+    unsigned int thread_count;
+    unsigned int iterations;
+    unsigned int batch_size;
+};
 
 // Routine for infinite-running processes
 void* infinite_routine(void* arg) {
-    unsigned int iterations = *((unsigned int*)arg);
-    unsigned int batch_size = *((unsigned int*)(arg + sizeof(unsigned int)));
-    free(arg);
+    EnvironmentT* environment = (EnvironmentT*)arg;
+    SimulatorT* simulator = environment->simulator;
+    unsigned int iterations = environment->iterations;
+    unsigned int batch_size = environment->batch_size;
 
     char log_message[128];
     sprintf(log_message, "Infinite routine started with %u iterations and batch size %u.", iterations, batch_size);
     logger_write(log_message);
 
+    // Every batch runs the same code, so the code array is built once
+    EvaluatorCodeT* codes = (EvaluatorCodeT*)malloc(sizeof(EvaluatorCodeT) * (batch_size ? batch_size : 1));
+    if (!codes) {
+        fprintf(stderr, "Error: Unable to allocate process codes for environment.\n");
+        exit(EXIT_FAILURE);
+    }
+    for (unsigned int j = 0; j < batch_size; j++) {
+        codes[j] = evaluator_infinite_loop; // Processes that run indefinitely
+    }
+
     for (unsigned int i = 0; i < iterations; i++) {
-        ProcessIdT pids[batch_size];
+        // Back off while the table is nearly full rather than queue for it
+        while (simulator_throttled(simulator)) {
+            usleep(ENVIRONMENT_THROTTLE_US);
+        }
 
-        // Create batch_size processes
-        for (unsigned int j = 0; j < batch_size; j++) {
-            EvaluatorCodeT code = evaluator_infinite_loop; // Processes that run indefinitely
-            pids[j] = simulator_create_process(code);
+        // Create batch_size processes in one go. The group only holds PIDs
+        // that were created, so a short batch is never killed or waited on as PID 0.
+        ProcessGroupT* group = simulator_group_create_timed(simulator, codes, batch_size, ENVIRONMENT_ADMISSION_TIMEOUT_MS);
+        if (!group) {
+            fprintf(stderr, "Error: Unable to allocate process group.\n");
+            exit(EXIT_FAILURE);
+        }
 
-            // Log process creation
-            sprintf(log_message, "Created process %u in iteration %u.", pids[j], i);
-            logger_write(log_message);
+        if (group->count < batch_size) {
+            sprintf(log_message, "Created %u of %u processes in iteration %u, the rest were not admitted.", group->count, batch_size, i);
+        } else {
+            sprintf(log_message, "Created %u processes in iteration %u.", group->count, i);
         }
+        logger_write(log_message);
 
-        // Kill the processes after they are created
-        for (unsigned int j = 0; j < batch_size; j++) {
-            simulator_kill(pids[j]);
+        // Kill the processes after they are created, then wait for all of them
+        simulator_group_kill(simulator, group);
+        simulator_group_wait(simulator, group);
 
-            // Wait for the process to terminate
-            simulator_wait(pids[j]);
+        sprintf(log_message, "Killed %u processes in iteration %u.", group->count, i);
+        logger_write(log_message);
 
-            // Log process termination
-            sprintf(log_message, "Process %u killed.", pids[j]);
-            logger_write(log_message);
-        }
+        simulator_group_destroy(group);
     }
 
+    free(codes);
+
     sprintf(log_message, "Infinite routine finished.");
     logger_write(log_message);
 
@@ -56,46 +91,60 @@ void* infinite_routine(void* arg) {
 
 
 // Start environment with thread_count threads
-void environment_start(unsigned int thread_count,
-                       unsigned int iterations,
-                       unsigned int batch_size) {
-    environment_thread_count = thread_count;
-    environment_threads = (pthread_t*)malloc(sizeof(pthread_t) * thread_count);
+EnvironmentT* environment_start(SimulatorT* simulator,
+                                unsigned int thread_count,
+                                unsigned int iterations,
+                                unsigned int batch_size,
+                                char const* cpus) {
+    cpu_set_t environment_cpus;
+    if (affinity_parse(cpus ? cpus : "", &environment_cpus) != 0) {
+        fprintf(stderr, "Error: Invalid environment CPU list \"%s\".\n", cpus);
+        exit(EXIT_FAILURE);
+    }
 
-    if (!environment_threads) {
+    EnvironmentT* environment = (EnvironmentT*)malloc(sizeof(EnvironmentT));
+    if (environment) {
+        environment->threads = (pthread_t*)malloc(sizeof(pthread_t) * (thread_count ? thread_count : 1));
+    }
+    if (!environment || !environment->threads) {
         fprintf(stderr, "Error: Unable to allocate threads for environment.\n");
         exit(EXIT_FAILURE);
     }
+    environment->simulator = simulator;
+    environment->thread_count = thread_count;
+    environment->iterations = iterations;
+    environment->batch_size = batch_size;
 
     for (unsigned int i = 0; i < thread_count; i++) {
-        unsigned int* thread_args = malloc(2 * sizeof(unsigned int));
-        thread_args[0] = iterations;
-        thread_args[1] = batch_size;
-
         // Log thread creation
         char log_message[128];
         sprintf(log_message, "Creating thread %u for infinite routine.", i);
         logger_write(log_message);
 
-        if (pthread_create(&environment_threads[i], NULL, infinite_routine, thread_args) != 0) {
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        affinity_apply(&attr, &environment_cpus);
+
+        if (pthread_create(&environment->threads[i], &attr, infinite_routine, environment) != 0) {
             fprintf(stderr, "Error: Unable to create environment thread %u\n", i);
             exit(EXIT_FAILURE);
         }
+        pthread_attr_destroy(&attr);
     }
+    return environment;
 }
 
 // Stop environment and clean up threads
-void environment_stop() {
-    for (unsigned int i = 0; i < environment_thread_count; i++) {
+void environment_stop(EnvironmentT* environment) {
+    for (unsigned int i = 0; i < environment->thread_count; i++) {
         // Log when waiting for a thread to finish
         char log_message[128];
         sprintf(log_message, "Joining thread %u.", i);
         logger_write(log_message);
 
-        pthread_join(environment_threads[i], NULL);
+        pthread_join(environment->threads[i], NULL);
     }
 
-    free(environment_threads);
-    environment_threads = NULL;
-    environment_thread_count = 0;
+    free(environment->threads);
+    free(environment);
 }
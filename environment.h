@@ -1,9 +1,17 @@
 #ifndef _ENVIRONMENT_H_
 #define _ENVIRONMENT_H_
 
-void environment_start(unsigned int thread_count,
-		       unsigned int iterations,
-		       unsigned int batch_size);
-void environment_stop();
+#include "simulator.h"
+
+// Threads creating and killing processes on one simulator
+typedef struct Environment EnvironmentT;
+
+// Threads are pinned to a CPU list such as "2-3" - NULL or "" leaves them unpinned
+EnvironmentT* environment_start(SimulatorT* simulator,
+				unsigned int thread_count,
+				unsigned int iterations,
+				unsigned int batch_size,
+				char const* cpus);
+void environment_stop(EnvironmentT* environment);
 
 #endif
@@ -2,22 +2,61 @@
 #include "simulator.h"
 
 #include <assert.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define EVALUATOR_X86 1
+#endif
+
 #define SMALL_DURATION (unsigned int)(TIME_SLICE_LENGTH / 10)
 #define MEDIUM_DURATION (unsigned int)(TIME_SLICE_LENGTH / 2)
 
-#ifndef SLEEP_PER_CPU_CYCLE
-#define SLEEP_PER_CPU_CYCLE 5
-#endif
+static __thread EvaluatorSleepHookT sleep_hook = NULL;
+static __thread void* sleep_context = NULL;
 
-EvaluatorResultT evaluator_evaluate(EvaluatorCodeT const code, unsigned int PC) {
+void evaluator_set_sleep_hook(EvaluatorSleepHookT hook, void* context) {
+  sleep_hook = hook;
+  sleep_context = context;
+}
+
+// Time proportional to CPU usage
+static void sleep_for(unsigned int cpu_time) {
+  if(sleep_hook) {
+    sleep_hook(sleep_context, SLEEP_PER_CPU_CYCLE * cpu_time);
+  } else {
+    usleep(SLEEP_PER_CPU_CYCLE * cpu_time);
+  }
+}
+
+static EvaluatorResultT evaluate_step(EvaluatorCodeT const code, unsigned int PC) {
   EvaluatorResultT const result = code.implementation(PC, code.parameter);
   assert(result.reason == reason_terminated ||
 	 result.reason == reason_timeslice_ended ||
-	 result.reason == reason_blocked);
+	 result.reason == reason_blocked ||
+	 result.reason == reason_send ||
+	 result.reason == reason_receive);
   assert(result.cpu_time);
-  usleep(SLEEP_PER_CPU_CYCLE * result.cpu_time); // time proportional to CPU usage
+  return result;
+}
+
+EvaluatorResultT evaluator_evaluate(EvaluatorCodeT const code, unsigned int PC) {
+  return evaluator_evaluate_quantum(code, PC, TIME_SLICE_LENGTH);
+}
+
+EvaluatorResultT evaluator_evaluate_quantum(EvaluatorCodeT const code, unsigned int PC, unsigned int quantum) {
+  EvaluatorResultT result = evaluate_step(code, PC);
+  unsigned int cpu_time = result.cpu_time;
+  while(result.reason == reason_timeslice_ended && cpu_time < quantum) {
+    result = evaluate_step(code, result.PC);
+    cpu_time += result.cpu_time;
+  }
+  result.cpu_time = cpu_time;
+  sleep_for(result.cpu_time);
   return result;
 }
 
@@ -61,6 +100,7 @@ EvaluatorResultT implementation_blocking(unsigned int PC, unsigned int PC_max) {
     result.cpu_time = SMALL_DURATION;
   } else if(result.PC % 2) { // even steps block
     result.reason = reason_blocked;
+    result.device = 0;
     result.cpu_time = MEDIUM_DURATION;
   } else { // odd steps cpu bound
     result.reason = reason_timeslice_ended;
@@ -73,3 +113,408 @@ EvaluatorCodeT evaluator_blocking_terminates_after(unsigned int steps) {
   EvaluatorCodeT code = { implementation_blocking, steps };
   return code;
 }
+
+#ifndef EVALUATOR_MAX_PROGRAMS
+#define EVALUATOR_MAX_PROGRAMS 4096
+#endif
+
+#define PROGRAM_IP(PC) ((PC) & 0xFFFF)
+#define PROGRAM_PROGRESS(PC) ((PC) >> 16)
+#define PROGRAM_PC(ip, progress) (((progress) << 16) | (ip))
+#define INSTRUCTION_OPCODE(instruction) ((instruction) >> 24)
+#define INSTRUCTION_OPERAND(instruction) ((instruction) & 0xFFFFFF)
+
+struct EvaluatorProgram {
+  unsigned int id;  // Index in the registry, carried as EvaluatorCodeT.parameter
+  unsigned int length;
+  EvaluatorInstructionT instructions[];
+};
+
+// Programs are found by id, registered once and never moved or freed
+static EvaluatorProgramT* _Atomic registry[EVALUATOR_MAX_PROGRAMS];
+static unsigned int registry_count = 0;
+static pthread_mutex_t registry_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+EvaluatorProgramT const* evaluator_program_create(EvaluatorInstructionT const* instructions,
+                                                  unsigned int length) {
+  if(length == 0 || length > 0xFFFF) return NULL;
+  for(unsigned int ip = 0; ip != length; ++ip) {
+    unsigned int const operand = INSTRUCTION_OPERAND(instructions[ip]);
+    switch(INSTRUCTION_OPCODE(instructions[ip])) {
+    case op_compute:
+      if(operand == 0 || operand > 0xFFFF) return NULL;
+      break;
+    case op_loop:
+      if(operand >= length) return NULL;
+      break;
+    case op_block:
+    case op_terminate:
+    case op_send:
+    case op_receive:
+      break;
+    default:
+      return NULL;
+    }
+  }
+
+  EvaluatorProgramT* program = malloc(sizeof(EvaluatorProgramT) + length * sizeof(EvaluatorInstructionT));
+  if(!program) return NULL;
+  program->length = length;
+  memcpy(program->instructions, instructions, length * sizeof(EvaluatorInstructionT));
+
+  pthread_mutex_lock(&registry_mutex);
+  if(registry_count == EVALUATOR_MAX_PROGRAMS) {
+    pthread_mutex_unlock(&registry_mutex);
+    free(program);
+    return NULL;
+  }
+  program->id = registry_count++;
+  atomic_store_explicit(&registry[program->id], program, memory_order_release);
+  pthread_mutex_unlock(&registry_mutex);
+  return program;
+}
+
+// Threaded interpreter: each handler jumps straight to the next one through
+// a computed goto rather than returning to a central switch. Loops take no
+// CPU time, so a step runs until it reaches an instruction that does.
+EvaluatorResultT implementation_program(unsigned int PC, unsigned int id) {
+  EvaluatorProgramT const* program = atomic_load_explicit(&registry[id], memory_order_acquire);
+  assert(program);
+  EvaluatorInstructionT const* const code = program->instructions;
+  unsigned int ip = PROGRAM_IP(PC);
+  unsigned int progress = PROGRAM_PROGRESS(PC);
+  unsigned int jumps = 0;
+  EvaluatorResultT result;
+
+#ifdef __GNUC__
+  static void* const handlers[] = { &&do_compute, &&do_block, &&do_loop, &&do_terminate,
+                                      &&do_send, &&do_receive };
+#define DISPATCH() \
+  do { if(ip >= program->length) goto do_terminate; \
+       goto *handlers[INSTRUCTION_OPCODE(code[ip])]; } while(0)
+#else
+#define DISPATCH() goto do_switch
+ do_switch:
+  if(ip >= program->length) goto do_terminate;
+  switch(INSTRUCTION_OPCODE(code[ip])) {
+  case op_compute: goto do_compute;
+  case op_block: goto do_block;
+  case op_loop: goto do_loop;
+  case op_send: goto do_send;
+  case op_receive: goto do_receive;
+  default: goto do_terminate;
+  }
+#endif
+
+  DISPATCH();
+
+ do_compute:
+  if(++progress == INSTRUCTION_OPERAND(code[ip])) {
+    ++ip;
+    progress = 0;
+  }
+  result.PC = PROGRAM_PC(ip, progress);
+  result.reason = reason_timeslice_ended;
+  result.cpu_time = TIME_SLICE_LENGTH;
+  return result;
+
+ do_block:
+  result.device = INSTRUCTION_OPERAND(code[ip]);
+  result.PC = PROGRAM_PC(ip + 1, 0);
+  result.reason = reason_blocked;
+  result.cpu_time = SMALL_DURATION;
+  return result;
+
+  // The exchange itself is the simulator's; the PC moves past it either way
+ do_send:
+  result.message = INSTRUCTION_OPERAND(code[ip]);
+  result.PC = PROGRAM_PC(ip + 1, 0);
+  result.reason = reason_send;
+  result.cpu_time = SMALL_DURATION;
+  return result;
+
+ do_receive:
+  result.PC = PROGRAM_PC(ip + 1, 0);
+  result.reason = reason_receive;
+  result.cpu_time = SMALL_DURATION;
+  return result;
+
+ do_loop:
+  ip = INSTRUCTION_OPERAND(code[ip]);
+  // A loop with no work in its body would spin forever, treat it as the end
+  if(++jumps > program->length) goto do_terminate;
+  DISPATCH();
+
+ do_terminate:
+  result.PC = PROGRAM_PC(ip, 0);
+  result.reason = reason_terminated;
+  result.cpu_time = SMALL_DURATION;
+  return result;
+#undef DISPATCH
+}
+
+EvaluatorCodeT evaluator_program(EvaluatorProgramT const* program) {
+  assert(program);
+  EvaluatorCodeT const code = { implementation_program, program->id };
+  return code;
+}
+
+EvaluatorProgramT const* evaluator_code_program(EvaluatorCodeT const code) {
+  if(code.implementation != implementation_program || code.parameter >= EVALUATOR_MAX_PROGRAMS) return NULL;
+  return atomic_load_explicit(&registry[code.parameter], memory_order_acquire);
+}
+
+EvaluatorInstructionT const* evaluator_program_instructions(EvaluatorProgramT const* program, unsigned int* length) {
+  assert(program);
+  *length = program->length;
+  return program->instructions;
+}
+
+// Follows the program as the interpreter would until it terminates or has
+// jumped more often than the program is long, so a program that loops
+// forever is counted for only a few passes
+static unsigned long long program_remaining_cpu_time(unsigned int PC, unsigned int id) {
+  EvaluatorProgramT const* program = atomic_load_explicit(&registry[id], memory_order_acquire);
+  assert(program);
+  unsigned int ip = PROGRAM_IP(PC);
+  unsigned int progress = PROGRAM_PROGRESS(PC);
+  unsigned int jumps = 0;
+  unsigned long long cpu_time = SMALL_DURATION;
+  while(ip < program->length) {
+    EvaluatorInstructionT const instruction = program->instructions[ip];
+    unsigned int const opcode = INSTRUCTION_OPCODE(instruction);
+    if(opcode == op_terminate) break;
+    if(opcode == op_loop) {
+      if(++jumps > program->length) break;
+      ip = INSTRUCTION_OPERAND(instruction);
+      continue;
+    }
+    if(opcode == op_compute) {
+      cpu_time += (unsigned long long)(INSTRUCTION_OPERAND(instruction) - progress) * TIME_SLICE_LENGTH;
+    } else {
+      cpu_time += SMALL_DURATION;
+    }
+    progress = 0;
+    ++ip;
+  }
+  return cpu_time;
+}
+
+unsigned long long evaluator_remaining_cpu_time(EvaluatorCodeT const code, unsigned int PC) {
+  if(code.implementation == implementation_cpu_bound) {
+    // Every step up to the last is a full slice
+    return (unsigned long long)(code.parameter - PC - 1) * TIME_SLICE_LENGTH + SMALL_DURATION;
+  }
+  if(code.implementation == implementation_blocking) {
+    // Steps PC + 1 to PC_max - 1 alternate between blocking and computing
+    unsigned int const steps = code.parameter - PC - 1;
+    unsigned int const blocking = (steps + ((PC + 1) % 2)) / 2;
+    return (unsigned long long)blocking * MEDIUM_DURATION +
+      (unsigned long long)(steps - blocking) * TIME_SLICE_LENGTH + SMALL_DURATION;
+  }
+  if(code.implementation == implementation_program) {
+    return program_remaining_cpu_time(PC, code.parameter);
+  }
+  return 0;
+}
+
+EvaluatorKindT evaluator_code_kind(EvaluatorCodeT const code) {
+  if(code.implementation == implementation_cpu_bound) return evaluator_kind_cpu_bound;
+  if(code.implementation == implementation_infinite_loop) return evaluator_kind_infinite_loop;
+  if(code.implementation == implementation_blocking) return evaluator_kind_blocking;
+  if(code.implementation == implementation_program) return evaluator_kind_program;
+  return evaluator_kind_unknown;
+}
+
+EvaluatorCodeT evaluator_code_of_kind(EvaluatorKindT kind, unsigned int parameter) {
+  static EvaluatorResultT (*const implementations[])(unsigned int, unsigned int) = {
+    implementation_cpu_bound, implementation_infinite_loop, implementation_blocking
+  };
+  assert(kind < evaluator_kind_program);
+  EvaluatorCodeT const code = { implementations[kind], parameter };
+  return code;
+}
+
+// Batched evaluation. Processes running a built-in implementation are
+// gathered into column arrays and stepped by a kernel; anything else is
+// evaluated one at a time. All kernels compute the same thing as
+// implementation_cpu_bound, implementation_infinite_loop and
+// implementation_blocking.
+
+typedef enum BatchKind {
+  batch_cpu_bound,
+  batch_infinite_loop,
+  batch_blocking,
+  batch_kinds
+} BatchKindT;
+
+typedef void (*BatchKernelT)(BatchKindT kind, unsigned int const* PC, unsigned int const* parameter,
+                             unsigned int n, unsigned int* out_PC, unsigned int* out_cpu_time,
+                             unsigned int* out_reason);
+
+static void kernel_scalar(BatchKindT kind, unsigned int const* PC, unsigned int const* parameter,
+                          unsigned int n, unsigned int* out_PC, unsigned int* out_cpu_time,
+                          unsigned int* out_reason) {
+  for(unsigned int i = 0; i != n; ++i) {
+    EvaluatorResultT result;
+    switch(kind) {
+    case batch_cpu_bound: result = implementation_cpu_bound(PC[i], parameter[i]); break;
+    case batch_infinite_loop: result = implementation_infinite_loop(PC[i], parameter[i]); break;
+    default: result = implementation_blocking(PC[i], parameter[i]); break;
+    }
+    out_PC[i] = result.PC;
+    out_cpu_time[i] = result.cpu_time;
+    out_reason[i] = result.reason;
+  }
+}
+
+#ifdef EVALUATOR_X86
+
+// Lanes select a when mask is set, b otherwise
+#define SELECT128(mask, a, b) _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b))
+
+__attribute__((target("sse2")))
+static void kernel_sse2(BatchKindT kind, unsigned int const* PC, unsigned int const* parameter,
+                        unsigned int n, unsigned int* out_PC, unsigned int* out_cpu_time,
+                        unsigned int* out_reason) {
+  __m128i const one = _mm_set1_epi32(1);
+  __m128i const slice = _mm_set1_epi32(TIME_SLICE_LENGTH);
+  __m128i const small = _mm_set1_epi32(SMALL_DURATION);
+  __m128i const medium = _mm_set1_epi32(MEDIUM_DURATION);
+  __m128i const terminated = _mm_set1_epi32(reason_terminated);
+  __m128i const timeslice = _mm_set1_epi32(reason_timeslice_ended);
+  __m128i const blocked = _mm_set1_epi32(reason_blocked);
+  unsigned int i = 0;
+  for(; i + 4 <= n; i += 4) {
+    __m128i const pc = _mm_loadu_si128((__m128i const*)(PC + i));
+    __m128i next, cpu, reason;
+    if(kind == batch_infinite_loop) {
+      next = _mm_xor_si128(pc, one);
+      cpu = slice;
+      reason = timeslice;
+    } else {
+      next = _mm_add_epi32(pc, one);
+      __m128i const done = _mm_cmpeq_epi32(next, _mm_loadu_si128((__m128i const*)(parameter + i)));
+      if(kind == batch_cpu_bound) {
+        cpu = SELECT128(done, small, slice);
+        reason = SELECT128(done, terminated, timeslice);
+      } else {
+        __m128i const odd = _mm_cmpeq_epi32(_mm_and_si128(next, one), one);
+        cpu = SELECT128(done, small, SELECT128(odd, medium, slice));
+        reason = SELECT128(done, terminated, SELECT128(odd, blocked, timeslice));
+      }
+    }
+    _mm_storeu_si128((__m128i*)(out_PC + i), next);
+    _mm_storeu_si128((__m128i*)(out_cpu_time + i), cpu);
+    _mm_storeu_si128((__m128i*)(out_reason + i), reason);
+  }
+  kernel_scalar(kind, PC + i, parameter + i, n - i, out_PC + i, out_cpu_time + i, out_reason + i);
+}
+
+#define SELECT256(mask, a, b) _mm256_blendv_epi8(b, a, mask)
+
+__attribute__((target("avx2")))
+static void kernel_avx2(BatchKindT kind, unsigned int const* PC, unsigned int const* parameter,
+                        unsigned int n, unsigned int* out_PC, unsigned int* out_cpu_time,
+                        unsigned int* out_reason) {
+  __m256i const one = _mm256_set1_epi32(1);
+  __m256i const slice = _mm256_set1_epi32(TIME_SLICE_LENGTH);
+  __m256i const small = _mm256_set1_epi32(SMALL_DURATION);
+  __m256i const medium = _mm256_set1_epi32(MEDIUM_DURATION);
+  __m256i const terminated = _mm256_set1_epi32(reason_terminated);
+  __m256i const timeslice = _mm256_set1_epi32(reason_timeslice_ended);
+  __m256i const blocked = _mm256_set1_epi32(reason_blocked);
+  unsigned int i = 0;
+  for(; i + 8 <= n; i += 8) {
+    __m256i const pc = _mm256_loadu_si256((__m256i const*)(PC + i));
+    __m256i next, cpu, reason;
+    if(kind == batch_infinite_loop) {
+      next = _mm256_xor_si256(pc, one);
+      cpu = slice;
+      reason = timeslice;
+    } else {
+      next = _mm256_add_epi32(pc, one);
+      __m256i const done = _mm256_cmpeq_epi32(next, _mm256_loadu_si256((__m256i const*)(parameter + i)));
+      if(kind == batch_cpu_bound) {
+        cpu = SELECT256(done, small, slice);
+        reason = SELECT256(done, terminated, timeslice);
+      } else {
+        __m256i const odd = _mm256_cmpeq_epi32(_mm256_and_si256(next, one), one);
+        cpu = SELECT256(done, small, SELECT256(odd, medium, slice));
+        reason = SELECT256(done, terminated, SELECT256(odd, blocked, timeslice));
+      }
+    }
+    _mm256_storeu_si256((__m256i*)(out_PC + i), next);
+    _mm256_storeu_si256((__m256i*)(out_cpu_time + i), cpu);
+    _mm256_storeu_si256((__m256i*)(out_reason + i), reason);
+  }
+  kernel_sse2(kind, PC + i, parameter + i, n - i, out_PC + i, out_cpu_time + i, out_reason + i);
+}
+
+#endif
+
+// Chosen once from CPUID
+static BatchKernelT select_kernel() {
+#ifdef EVALUATOR_X86
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("avx2")) return kernel_avx2;
+  if(__builtin_cpu_supports("sse2")) return kernel_sse2;
+#endif
+  return kernel_scalar;
+}
+
+static BatchKindT batch_kind(EvaluatorCodeT const code) {
+  if(code.implementation == implementation_cpu_bound) return batch_cpu_bound;
+  if(code.implementation == implementation_infinite_loop) return batch_infinite_loop;
+  if(code.implementation == implementation_blocking) return batch_blocking;
+  return batch_kinds;
+}
+
+// Largest group the kernels see at once, bounding the stack used for columns
+#define BATCH_COLUMN 256
+
+void evaluator_evaluate_batch(EvaluatorCodeT const* codes, unsigned int const* PCs,
+                              unsigned int n, EvaluatorResultT* results) {
+  static BatchKernelT _Atomic kernel = NULL;
+  BatchKernelT run = atomic_load_explicit(&kernel, memory_order_relaxed);
+  if(!run) {
+    run = select_kernel();
+    atomic_store_explicit(&kernel, run, memory_order_relaxed);
+  }
+
+  unsigned int index[BATCH_COLUMN], PC[BATCH_COLUMN], parameter[BATCH_COLUMN];
+  unsigned int out_PC[BATCH_COLUMN], out_cpu_time[BATCH_COLUMN], out_reason[BATCH_COLUMN];
+  unsigned long long cpu_time = 0;
+
+  for(BatchKindT kind = batch_cpu_bound; kind <= batch_kinds; ++kind) {
+    unsigned int gathered = 0;
+    for(unsigned int i = 0; i <= n; ++i) {
+      // Flush a full column, and whatever is left at the end
+      if(gathered == BATCH_COLUMN || (i == n && gathered)) {
+        run(kind, PC, parameter, gathered, out_PC, out_cpu_time, out_reason);
+        for(unsigned int j = 0; j != gathered; ++j) {
+          EvaluatorResultT* result = &results[index[j]];
+          result->PC = out_PC[j];
+          result->cpu_time = out_cpu_time[j];
+          result->reason = (ReasonT)out_reason[j];
+          result->device = 0;
+          cpu_time += out_cpu_time[j];
+        }
+        gathered = 0;
+      }
+      if(i == n || batch_kind(codes[i]) != kind) continue;
+
+      if(kind == batch_kinds) {
+        results[i] = evaluate_step(codes[i], PCs[i]);
+        cpu_time += results[i].cpu_time;
+        continue;
+      }
+      index[gathered] = i;
+      PC[gathered] = PCs[i];
+      parameter[gathered] = codes[i].parameter;
+      ++gathered;
+    }
+  }
+
+  sleep_for(cpu_time);
+}
@@ -3,16 +3,27 @@
 
 #define TIME_SLICE_LENGTH 100
 
+// Microseconds the evaluator sleeps per unit of CPU time
+#ifndef SLEEP_PER_CPU_CYCLE
+#define SLEEP_PER_CPU_CYCLE 5
+#endif
+
 typedef enum Reason {
   reason_terminated,
   reason_timeslice_ended,
   reason_blocked,
+  reason_send,      // Sending message to the process's peer
+  reason_receive,   // Waiting for a message in its own mailbox
 } ReasonT;
 
 typedef struct EvaluatorResult {
   unsigned int PC;
   unsigned int cpu_time;
   ReasonT reason;
+  union {
+    unsigned int device;   // Device blocked on, only meaningful with reason_blocked
+    unsigned int message;  // Message sent, only meaningful with reason_send
+  };
 } EvaluatorResultT;
 
 typedef struct EvaluatorCode {
@@ -21,9 +32,25 @@ typedef struct EvaluatorCode {
 } EvaluatorCodeT;
 
 
-// The evaluator - pretends to run some code on a CPU
+// The evaluator - pretends to run some code on a CPU for one time slice
 EvaluatorResultT evaluator_evaluate(EvaluatorCodeT const code, unsigned int PC);
 
+// Run consecutive steps until quantum units of CPU time are used or the code
+// blocks, exchanges a message or terminates. At least one step always runs; cpu_time is the total.
+EvaluatorResultT evaluator_evaluate_quantum(EvaluatorCodeT const code, unsigned int PC, unsigned int quantum);
+
+// The evaluator simulates CPU time by sleeping the calling thread. A thread
+// that multiplexes fibers installs a hook instead, so only the current fiber
+// is suspended. Per thread; NULL restores sleeping.
+typedef void (*EvaluatorSleepHookT)(void* context, unsigned int microseconds);
+void evaluator_set_sleep_hook(EvaluatorSleepHookT hook, void* context);
+
+// CPU time code at PC still needs before it can terminate, counting only
+// work it is certain to do: time blocked or waiting on messages is left out,
+// and a program that loops forever counts a few passes of its loop. 0 for
+// evaluator_infinite_loop and code implemented outside the evaluator.
+unsigned long long evaluator_remaining_cpu_time(EvaluatorCodeT const code, unsigned int PC);
+
 // A CPU bound process that terminates after specified steps
 EvaluatorCodeT evaluator_terminates_after(unsigned int steps);
 
@@ -33,4 +60,61 @@ extern EvaluatorCodeT const evaluator_infinite_loop;
 // A process that terminates after specified steps and may block
 EvaluatorCodeT evaluator_blocking_terminates_after(unsigned int steps);
 
+// Advance n processes by one time slice each, as n calls to evaluator_evaluate
+// would, but grouped by implementation so the built-in programs are stepped
+// several at a time with SIMD. Sleeps once for the combined CPU time.
+void evaluator_evaluate_batch(EvaluatorCodeT const* codes, unsigned int const* PCs,
+                              unsigned int n, EvaluatorResultT* results);
+
+// Bytecode process programs. Each instruction holds an opcode in its top 8
+// bits and an operand in the low 24 bits.
+typedef enum EvaluatorOpcode {
+  op_compute,    // Run operand time slices of CPU work (1 to 65535)
+  op_block,      // Block on device operand
+  op_loop,       // Jump to instruction operand
+  op_terminate,  // Finish the process, also implied past the last instruction
+  op_send,       // Send operand as a message to the process's peer
+  op_receive,    // Take the next message from the process's own mailbox
+} EvaluatorOpcodeT;
+
+// op_send operand that sends the last message the process received instead,
+// 0 if it has received none, so a program can pass on what reaches it
+#define EVALUATOR_MESSAGE_RECEIVED 0xFFFFFF
+
+typedef unsigned int EvaluatorInstructionT;
+
+#define EVALUATOR_INSTRUCTION(opcode, operand) \
+  ((EvaluatorInstructionT)(((opcode) << 24) | ((operand) & 0xFFFFFF)))
+
+// Programs are immutable once created and live until the evaluator exits, so
+// any number of processes can share one without copying it
+typedef struct EvaluatorProgram EvaluatorProgramT;
+
+// Copy and validate a program - returns NULL if it is malformed or the
+// program registry is full
+EvaluatorProgramT const* evaluator_program_create(EvaluatorInstructionT const* instructions,
+                                                  unsigned int length);
+
+// Code that runs a program; PC packs the instruction index in its low 16
+// bits and progress through the current instruction in the high 16
+EvaluatorCodeT evaluator_program(EvaluatorProgramT const* program);
+
+// The program code runs, or NULL if it does not run one
+EvaluatorProgramT const* evaluator_code_program(EvaluatorCodeT const code);
+EvaluatorInstructionT const* evaluator_program_instructions(EvaluatorProgramT const* program, unsigned int* length);
+
+// Stable identifiers for the evaluator's implementations. Function addresses
+// change from run to run, so saved code names its kind and parameter instead.
+typedef enum EvaluatorKind {
+  evaluator_kind_cpu_bound,      // evaluator_terminates_after
+  evaluator_kind_infinite_loop,  // evaluator_infinite_loop
+  evaluator_kind_blocking,       // evaluator_blocking_terminates_after
+  evaluator_kind_program,        // evaluator_program, parameter only valid in this run
+  evaluator_kind_unknown,        // Implemented outside the evaluator
+} EvaluatorKindT;
+
+EvaluatorKindT evaluator_code_kind(EvaluatorCodeT const code);
+// Code of a kind other than program and unknown with the given parameter
+EvaluatorCodeT evaluator_code_of_kind(EvaluatorKindT kind, unsigned int parameter);
+
 #endif
@@ -50,6 +50,212 @@ void test_evaluator_blocking() {
   assert(result.cpu_time <= TIME_SLICE_LENGTH);
 }
 
+void test_evaluator_quantum() {
+  printf("testing multi-slice quantum\n");
+  EvaluatorResultT result =
+    evaluator_evaluate_quantum(evaluator_terminates_after(20), 0, 4 * TIME_SLICE_LENGTH);
+  assert(result.reason == reason_timeslice_ended);
+  assert(result.PC == 4);
+  assert(result.cpu_time == 4 * TIME_SLICE_LENGTH);
+
+  // The quantum ends early when the process terminates...
+  result = evaluator_evaluate_quantum(evaluator_terminates_after(3), 0, 8 * TIME_SLICE_LENGTH);
+  assert(result.reason == reason_terminated);
+  assert(result.PC == 3);
+
+  // ...or blocks
+  result = evaluator_evaluate_quantum(evaluator_blocking_terminates_after(20), 0, 8 * TIME_SLICE_LENGTH);
+  assert(result.reason == reason_blocked);
+  assert(result.PC == 1);
+  assert(result.cpu_time < TIME_SLICE_LENGTH);
+}
+
+void test_evaluator_program() {
+  printf("testing bytecode program\n");
+  EvaluatorInstructionT const instructions[] = {
+    EVALUATOR_INSTRUCTION(op_compute, 3),
+    EVALUATOR_INSTRUCTION(op_block, 7),
+    EVALUATOR_INSTRUCTION(op_compute, 1),
+    EVALUATOR_INSTRUCTION(op_terminate, 0),
+  };
+  EvaluatorProgramT const* program = evaluator_program_create(instructions, 4);
+  assert(program);
+  EvaluatorCodeT const code = evaluator_program(program);
+
+  unsigned int PC = 0;
+  for(int step = 0; step != 3; ++step) {
+    EvaluatorResultT const result = evaluator_evaluate(code, PC);
+    assert(result.reason == reason_timeslice_ended);
+    assert(result.cpu_time == TIME_SLICE_LENGTH);
+    PC = result.PC;
+  }
+  EvaluatorResultT result = evaluator_evaluate(code, PC);
+  assert(result.reason == reason_blocked);
+  assert(result.device == 7);
+  result = evaluator_evaluate(code, result.PC);
+  assert(result.reason == reason_timeslice_ended);
+  result = evaluator_evaluate(code, result.PC);
+  assert(result.reason == reason_terminated);
+}
+
+void test_evaluator_program_loop() {
+  printf("testing bytecode loop\n");
+  EvaluatorInstructionT const instructions[] = {
+    EVALUATOR_INSTRUCTION(op_compute, 2),
+    EVALUATOR_INSTRUCTION(op_loop, 0),
+  };
+  EvaluatorCodeT const code = evaluator_program(evaluator_program_create(instructions, 2));
+  unsigned int PC = 0;
+  for(int i = 0; i != 100; ++i) { // Never terminates
+    EvaluatorResultT const result = evaluator_evaluate(code, PC);
+    assert(result.reason == reason_timeslice_ended);
+    PC = result.PC;
+  }
+
+  // A loop with nothing in it ends the program instead of hanging
+  EvaluatorInstructionT const empty_loop[] = { EVALUATOR_INSTRUCTION(op_loop, 0) };
+  EvaluatorResultT const result = evaluator_evaluate(evaluator_program(evaluator_program_create(empty_loop, 1)), 0);
+  assert(result.reason == reason_terminated);
+}
+
+// Sends and receives end the step and move past the instruction; what they
+// exchange is up to the caller
+void test_evaluator_program_messages() {
+  printf("testing bytecode send and receive\n");
+  EvaluatorInstructionT const instructions[] = {
+    EVALUATOR_INSTRUCTION(op_receive, 0),
+    EVALUATOR_INSTRUCTION(op_compute, 1),
+    EVALUATOR_INSTRUCTION(op_send, 0xABCDEF),
+    EVALUATOR_INSTRUCTION(op_loop, 0),
+  };
+  EvaluatorCodeT const code = evaluator_program(evaluator_program_create(instructions, 4));
+  EvaluatorResultT result = evaluator_evaluate_quantum(code, 0, 4 * TIME_SLICE_LENGTH);
+  assert(result.reason == reason_receive);
+  assert(result.cpu_time < TIME_SLICE_LENGTH);
+  result = evaluator_evaluate_quantum(code, result.PC, 4 * TIME_SLICE_LENGTH);
+  assert(result.reason == reason_send);
+  assert(result.message == 0xABCDEF);
+  assert(result.cpu_time > TIME_SLICE_LENGTH);
+  // Past the send, the loop leads straight back to the receive
+  result = evaluator_evaluate(code, result.PC);
+  assert(result.reason == reason_receive);
+}
+
+void test_evaluator_program_malformed() {
+  printf("testing malformed bytecode is rejected\n");
+  EvaluatorInstructionT const bad_target[] = { EVALUATOR_INSTRUCTION(op_loop, 5) };
+  assert(!evaluator_program_create(bad_target, 1));
+  EvaluatorInstructionT const bad_opcode[] = { EVALUATOR_INSTRUCTION(9, 0) };
+  assert(!evaluator_program_create(bad_opcode, 1));
+  EvaluatorInstructionT const empty_compute[] = { EVALUATOR_INSTRUCTION(op_compute, 0) };
+  assert(!evaluator_program_create(empty_compute, 1));
+}
+
+void test_evaluator_batch() {
+  printf("testing batched evaluation matches single evaluation\n");
+  EvaluatorInstructionT const instructions[] = { EVALUATOR_INSTRUCTION(op_compute, 2) };
+  EvaluatorCodeT const program = evaluator_program(evaluator_program_create(instructions, 1));
+
+  enum { n = 103 }; // Not a multiple of any vector width
+  EvaluatorCodeT codes[n];
+  unsigned int PCs[n];
+  for(unsigned int i = 0; i != n; ++i) {
+    switch(i % 4) {
+    case 0: codes[i] = evaluator_terminates_after(1 + i % 7); PCs[i] = i % 7 ? i % (i % 7) : 0; break;
+    case 1: codes[i] = evaluator_infinite_loop; PCs[i] = i % 2; break;
+    case 2: codes[i] = evaluator_blocking_terminates_after(2 + i % 5); PCs[i] = i % (2 + i % 5); break;
+    default: codes[i] = program; PCs[i] = 0; break;
+    }
+  }
+
+  EvaluatorResultT results[n];
+  evaluator_evaluate_batch(codes, PCs, n, results);
+  for(unsigned int i = 0; i != n; ++i) {
+    EvaluatorResultT const expected = codes[i].implementation(PCs[i], codes[i].parameter);
+    assert(results[i].PC == expected.PC);
+    assert(results[i].cpu_time == expected.cpu_time);
+    assert(results[i].reason == expected.reason);
+  }
+}
+
+static EvaluatorResultT implementation_custom(unsigned int PC, unsigned int unused) {
+  EvaluatorResultT const result = { PC, TIME_SLICE_LENGTH, reason_terminated, { 0 } };
+  return result;
+}
+
+void test_evaluator_code_kind() {
+  printf("testing code kinds round trip\n");
+  EvaluatorCodeT const builtins[] = {
+    evaluator_terminates_after(7), evaluator_infinite_loop, evaluator_blocking_terminates_after(9)
+  };
+  for(unsigned int i = 0; i != 3; ++i) {
+    EvaluatorKindT const kind = evaluator_code_kind(builtins[i]);
+    assert(kind == (EvaluatorKindT)i);
+    EvaluatorCodeT const code = evaluator_code_of_kind(kind, builtins[i].parameter);
+    assert(code.implementation == builtins[i].implementation);
+    assert(code.parameter == builtins[i].parameter);
+    assert(!evaluator_code_program(code));
+  }
+
+  EvaluatorInstructionT const instructions[] = {
+    EVALUATOR_INSTRUCTION(op_compute, 3),
+    EVALUATOR_INSTRUCTION(op_block, 1),
+  };
+  EvaluatorProgramT const* program = evaluator_program_create(instructions, 2);
+  EvaluatorCodeT const code = evaluator_program(program);
+  assert(evaluator_code_kind(code) == evaluator_kind_program);
+  assert(evaluator_code_program(code) == program);
+  unsigned int length;
+  EvaluatorInstructionT const* copy = evaluator_program_instructions(program, &length);
+  assert(length == 2 && copy[0] == instructions[0] && copy[1] == instructions[1]);
+
+  EvaluatorCodeT const custom = { implementation_custom, 0 };
+  assert(evaluator_code_kind(custom) == evaluator_kind_unknown);
+}
+
+// Terminating code without loops needs exactly the CPU time running it to the end takes
+static void check_remaining_cpu_time(EvaluatorCodeT const code) {
+  unsigned int PC = 0;
+  for(;;) {
+    unsigned long long const remaining = evaluator_remaining_cpu_time(code, PC);
+    unsigned long long used = 0;
+    EvaluatorResultT result;
+    unsigned int step_PC = PC;
+    do {
+      result = code.implementation(step_PC, code.parameter);
+      used += result.cpu_time;
+      step_PC = result.PC;
+    } while(result.reason != reason_terminated);
+    assert(remaining == used);
+    result = code.implementation(PC, code.parameter);
+    if(result.reason == reason_terminated) break;
+    PC = result.PC;
+  }
+}
+
+void test_evaluator_remaining_cpu_time() {
+  printf("testing remaining CPU time\n");
+  check_remaining_cpu_time(evaluator_terminates_after(20));
+  check_remaining_cpu_time(evaluator_blocking_terminates_after(9));
+  check_remaining_cpu_time(evaluator_blocking_terminates_after(10));
+  EvaluatorInstructionT const instructions[] = {
+    EVALUATOR_INSTRUCTION(op_compute, 3),
+    EVALUATOR_INSTRUCTION(op_block, 7),
+    EVALUATOR_INSTRUCTION(op_send, 1),
+    EVALUATOR_INSTRUCTION(op_compute, 2),
+  };
+  check_remaining_cpu_time(evaluator_program(evaluator_program_create(instructions, 4)));
+  assert(evaluator_remaining_cpu_time(evaluator_infinite_loop, 0) == 0);
+
+  // Endless loops count some passes, never less than the first
+  EvaluatorInstructionT const looping[] = {
+    EVALUATOR_INSTRUCTION(op_compute, 2),
+    EVALUATOR_INSTRUCTION(op_loop, 0),
+  };
+  EvaluatorCodeT const code = evaluator_program(evaluator_program_create(looping, 2));
+  assert(evaluator_remaining_cpu_time(code, 0) >= 2 * TIME_SLICE_LENGTH);
+}
+
 void test_evaluator_specification_examples() {
   evaluator_evaluate(evaluator_terminates_after(5), 0);
   evaluator_evaluate(evaluator_infinite_loop, 0);
@@ -60,6 +266,14 @@ int main() {
   test_evaluator_infinite_loop();
   test_evaluator_terminates_after();
   test_evaluator_blocking();
+  test_evaluator_quantum();
+  test_evaluator_program();
+  test_evaluator_program_loop();
+  test_evaluator_program_messages();
+  test_evaluator_program_malformed();
+  test_evaluator_batch();
+  test_evaluator_code_kind();
+  test_evaluator_remaining_cpu_time();
   test_evaluator_specification_examples();
   return 0;
 }
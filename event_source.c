@@ -1,50 +1,61 @@
 #include "event_source.h"
 #include "utilities.h"
 #include "simulator.h"
+#include "affinity.h"
 #include <pthread.h>
 #include <unistd.h>
 #include <stdbool.h>  // Include for bool, true, false
+#include <stdatomic.h>
 #include <stdio.h>    // Include for fprintf, stderr
 
-static pthread_t event_thread;
-static bool event_source_active = false;
+struct EventSource {
+    SimulatorT* simulator;
+    pthread_t thread;
+    useconds_t interval;
+    atomic_bool active;
+};
 
 // Function to generate events at regular intervals
 void* event_source_routine(void* arg) {
-    useconds_t interval = *((useconds_t*)arg);
-    free(arg);
+    EventSourceT* source = (EventSourceT*)arg;
 
-    while (event_source_active) {
-        usleep(interval);  // Wait for the specified interval
-        simulator_event();  // Trigger the event in the simulator
+    while (source->active) {
+        usleep(source->interval);  // Wait for the specified interval
+        simulator_event(source->simulator);  // Trigger the event in the simulator
     }
 
     return NULL;
 }
 
-// Start the event source to call simulator_event every interval microseconds
-void event_source_start(useconds_t interval) {
-    if (event_source_active) {
-        return;  // If the event source is already active, do nothing
+// Start an event source calling simulator_event every interval microseconds
+EventSourceT* event_source_start(SimulatorT* simulator, useconds_t interval, char const* cpus) {
+    cpu_set_t event_source_cpus;
+    if (affinity_parse(cpus ? cpus : "", &event_source_cpus) != 0) {
+        fprintf(stderr, "Error: Invalid event source CPU list \"%s\".\n", cpus);
+        exit(EXIT_FAILURE);
     }
 
-    event_source_active = true;
+    EventSourceT* source = (EventSourceT*)checked_malloc(sizeof(EventSourceT));
+    source->simulator = simulator;
+    source->interval = interval;
+    source->active = true;
 
-    int* interval_ptr = malloc(sizeof(int));
-    *interval_ptr = interval;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    affinity_apply(&attr, &event_source_cpus);
 
     // Create the event thread
-    if (pthread_create(&event_thread, NULL, event_source_routine, interval_ptr) != 0) {
+    if (pthread_create(&source->thread, &attr, event_source_routine, source) != 0) {
         fprintf(stderr, "Error: Failed to create event source thread\n");
         exit(EXIT_FAILURE);
     }
+    pthread_attr_destroy(&attr);
+    return source;
 }
 
 // Stop the event source and clean up resources
-void event_source_stop() {
-    event_source_active = false;
-
-    if (event_thread != 0) {
-        pthread_join(event_thread, NULL);  // Wait for the event thread to finish
-    }
+void event_source_stop(EventSourceT* source) {
+    source->active = false;
+    pthread_join(source->thread, NULL);  // Wait for the event thread to finish
+    checked_free(source);
 }
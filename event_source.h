@@ -1,9 +1,16 @@
 #ifndef _EVENT_SOURCE_H_
 #define _EVENT_SOURCE_H_
 
+#include "simulator.h"
+
 #include <unistd.h>
 
-void event_source_start(useconds_t interval);
-void event_source_stop();
+// A thread raising events on one simulator
+typedef struct EventSource EventSourceT;
+
+// Call simulator_event every interval microseconds from a thread pinned to a
+// CPU list such as "0-1" - NULL or "" leaves it unpinned
+EventSourceT* event_source_start(SimulatorT* simulator, useconds_t interval, char const* cpus);
+void event_source_stop(EventSourceT* source);
 
 #endif
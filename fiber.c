@@ -0,0 +1,270 @@
+#include "fiber.h"
+#include "heap.h"
+#include "utilities.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <limits.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <ucontext.h>
+#include <sys/mman.h>
+
+#define NO_FIBER UINT_MAX
+#define INITIAL_CAPACITY 16
+
+typedef struct Fiber {
+  ucontext_t context;
+  void* stack;          // NULL once finished
+  FiberEntryT entry;
+  void* argument;
+  FiberStateT state;
+} FiberT;
+
+// Fiber indices in arrival order, sized to the scheduler's capacity
+typedef struct FiberRing {
+  unsigned int* ids;
+  unsigned int head;
+  unsigned int length;
+} FiberRingT;
+
+struct FiberScheduler {
+  ucontext_t context;       // The thread's own, switched back to between fibers
+  FiberT** fibers;          // Allocated one by one, a saved context must not move
+  unsigned int count;
+  unsigned int capacity;    // Power of two
+  unsigned int finished;
+  unsigned int current;     // Index of the running fiber, NO_FIBER between fibers
+  FiberRingT runnable;
+  FiberRingT parked;
+  HeapT timers;             // Sleeping fibers keyed by wake time
+  size_t stack_size;
+};
+
+static __thread FiberSchedulerT* running_scheduler = NULL;
+
+static void ring_push(FiberSchedulerT* scheduler, FiberRingT* ring, unsigned int id) {
+  ring->ids[(ring->head + ring->length) & (scheduler->capacity - 1)] = id;
+  ring->length++;
+}
+
+static unsigned int ring_pop(FiberSchedulerT* scheduler, FiberRingT* ring) {
+  unsigned int const id = ring->ids[ring->head];
+  ring->head = (ring->head + 1) & (scheduler->capacity - 1);
+  ring->length--;
+  return id;
+}
+
+// Copy a ring into one of the new capacity, oldest first
+static void ring_grow(FiberRingT* ring, unsigned int old_capacity, unsigned int capacity) {
+  unsigned int* ids = checked_malloc(sizeof(unsigned int) * capacity);
+  for(unsigned int i = 0; i != ring->length; ++i) {
+    ids[i] = ring->ids[(ring->head + i) & (old_capacity - 1)];
+  }
+  free(ring->ids);
+  ring->ids = ids;
+  ring->head = 0;
+}
+
+static void grow(FiberSchedulerT* scheduler) {
+  unsigned int const capacity = scheduler->capacity ? scheduler->capacity * 2 : INITIAL_CAPACITY;
+  FiberT** fibers = realloc(scheduler->fibers, sizeof(FiberT*) * capacity);
+  if(!fibers) abort();
+  scheduler->fibers = fibers;
+  ring_grow(&scheduler->runnable, scheduler->capacity, capacity);
+  ring_grow(&scheduler->parked, scheduler->capacity, capacity);
+  scheduler->capacity = capacity;
+}
+
+static void sleep_until(unsigned long long wake_ns) {
+  struct timespec wake = { .tv_sec = wake_ns / 1000000000ULL, .tv_nsec = wake_ns % 1000000000ULL };
+  while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, NULL) == EINTR) {
+  }
+}
+
+// Every fiber starts here; it returns through uc_link to the scheduler
+static void trampoline() {
+  FiberSchedulerT* scheduler = running_scheduler;
+  FiberT* fiber = scheduler->fibers[scheduler->current];
+  fiber->entry(fiber->argument);
+  fiber->state = fiber_finished;
+}
+
+static FiberT* current_fiber() {
+  assert(running_scheduler && running_scheduler->current != NO_FIBER);
+  return running_scheduler->fibers[running_scheduler->current];
+}
+
+static void switch_to_scheduler(FiberT* fiber) {
+  swapcontext(&fiber->context, &running_scheduler->context);
+}
+
+FiberSchedulerT* fiber_scheduler_create(size_t stack_size) {
+  FiberSchedulerT* scheduler = checked_malloc(sizeof(FiberSchedulerT));
+  memset(scheduler, 0, sizeof(FiberSchedulerT));
+  scheduler->current = NO_FIBER;
+  scheduler->stack_size = stack_size;
+  heap_init(&scheduler->timers);
+  grow(scheduler);
+  return scheduler;
+}
+
+void fiber_scheduler_destroy(FiberSchedulerT* scheduler) {
+  assert(scheduler);
+  assert(running_scheduler != scheduler);
+  for(unsigned int i = 0; i != scheduler->count; ++i) {
+    if(scheduler->fibers[i]->stack) {
+      munmap(scheduler->fibers[i]->stack, scheduler->stack_size);
+    }
+    free(scheduler->fibers[i]);
+  }
+  free(scheduler->fibers);
+  free(scheduler->runnable.ids);
+  free(scheduler->parked.ids);
+  heap_destroy(&scheduler->timers);
+  free(scheduler);
+}
+
+bool fiber_spawn(FiberSchedulerT* scheduler, FiberEntryT entry, void* argument) {
+  assert(scheduler);
+  if(scheduler->count == scheduler->capacity) {
+    grow(scheduler);
+  }
+  FiberT* fiber = malloc(sizeof(FiberT));
+  if(!fiber) {
+    return false;
+  }
+  // Stacks are only committed as they are touched. Without guard pages
+  // neighbouring stacks merge into few mappings, so even a million fibers
+  // stay far from the kernel's mapping limit.
+  fiber->stack = mmap(NULL, scheduler->stack_size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK, -1, 0);
+  if(fiber->stack == MAP_FAILED) {
+    free(fiber);
+    return false;
+  }
+  if(!heap_add_member(&scheduler->timers)) {
+    munmap(fiber->stack, scheduler->stack_size);
+    free(fiber);
+    return false;
+  }
+  getcontext(&fiber->context);
+  fiber->context.uc_stack.ss_sp = fiber->stack;
+  fiber->context.uc_stack.ss_size = scheduler->stack_size;
+  fiber->context.uc_link = &scheduler->context;
+  makecontext(&fiber->context, trampoline, 0);
+  fiber->entry = entry;
+  fiber->argument = argument;
+  fiber->state = fiber_runnable;
+
+  scheduler->fibers[scheduler->count] = fiber;
+  ring_push(scheduler, &scheduler->runnable, scheduler->count);
+  scheduler->count++;
+  return true;
+}
+
+static void wake_due(FiberSchedulerT* scheduler, unsigned long long now) {
+  while(scheduler->timers.length && scheduler->timers.entries[0].key <= now) {
+    unsigned int const id = heap_pop(&scheduler->timers).id;
+    scheduler->fibers[id]->state = fiber_runnable;
+    ring_push(scheduler, &scheduler->runnable, id);
+  }
+}
+
+static unsigned int unpark(FiberSchedulerT* scheduler, unsigned int n) {
+  unsigned int woken = 0;
+  for(; woken != n && scheduler->parked.length; ++woken) {
+    unsigned int const id = ring_pop(scheduler, &scheduler->parked);
+    scheduler->fibers[id]->state = fiber_runnable;
+    ring_push(scheduler, &scheduler->runnable, id);
+  }
+  return woken;
+}
+
+void fiber_scheduler_run(FiberSchedulerT* scheduler, FiberIdleT idle, void* context) {
+  assert(scheduler);
+  assert(!running_scheduler);
+  running_scheduler = scheduler;
+
+  while(scheduler->finished != scheduler->count) {
+    if(scheduler->timers.length) {
+      wake_due(scheduler, monotonic_ns());
+    }
+    if(!scheduler->runnable.length) {
+      unsigned long long const wake_ns = scheduler->timers.length ? scheduler->timers.entries[0].key : 0;
+      if(!scheduler->parked.length) {
+        // Only sleepers remain, so nothing but time can make one runnable
+        assert(wake_ns);
+        sleep_until(wake_ns);
+      } else if(idle) {
+        unpark(scheduler, idle(context, scheduler->parked.length, wake_ns));
+      } else {
+        if(wake_ns) {
+          sleep_until(wake_ns);
+        }
+        unpark(scheduler, scheduler->parked.length);
+      }
+      continue;
+    }
+
+    unsigned int const id = ring_pop(scheduler, &scheduler->runnable);
+    FiberT* fiber = scheduler->fibers[id];
+    fiber->state = fiber_running;
+    scheduler->current = id;
+    swapcontext(&scheduler->context, &fiber->context);
+    scheduler->current = NO_FIBER;
+
+    if(fiber->state == fiber_finished) {
+      munmap(fiber->stack, scheduler->stack_size);
+      fiber->stack = NULL;
+      heap_remove_member(&scheduler->timers);
+      scheduler->finished++;
+    }
+  }
+
+  running_scheduler = NULL;
+}
+
+bool fiber_active() {
+  return running_scheduler && running_scheduler->current != NO_FIBER;
+}
+
+void fiber_sleep_until(unsigned long long wake_ns) {
+  FiberT* fiber = current_fiber();
+  if(wake_ns <= monotonic_ns()) {
+    fiber_yield();
+    return;
+  }
+  heap_push(&running_scheduler->timers, wake_ns, running_scheduler->current);
+  fiber->state = fiber_sleeping;
+  switch_to_scheduler(fiber);
+}
+
+void fiber_sleep(unsigned int microseconds) {
+  if(!fiber_active()) {
+    usleep(microseconds);
+    return;
+  }
+  fiber_sleep_until(monotonic_ns() + microseconds * 1000ULL);
+}
+
+void fiber_park() {
+  FiberT* fiber = current_fiber();
+  ring_push(running_scheduler, &running_scheduler->parked, running_scheduler->current);
+  fiber->state = fiber_parked;
+  switch_to_scheduler(fiber);
+}
+
+void fiber_yield() {
+  FiberT* fiber = current_fiber();
+  ring_push(running_scheduler, &running_scheduler->runnable, running_scheduler->current);
+  fiber->state = fiber_runnable;
+  switch_to_scheduler(fiber);
+}
+
+unsigned int fiber_unpark(unsigned int n) {
+  assert(running_scheduler);
+  return unpark(running_scheduler, n);
+}
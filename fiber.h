@@ -0,0 +1,53 @@
+#ifndef _FIBER_H_
+#define _FIBER_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Cooperative fibers multiplexed on one thread. A fiber runs until it
+// finishes, sleeps, parks or yields; sleepers are woken from a timer heap
+// keyed by wake time, parked fibers only when the scheduler's idle callback
+// or another fiber unparks them. A scheduler and its fibers belong to the
+// thread that runs it, and a fiber must not switch away while it holds a
+// lock another fiber of the same thread may take.
+
+typedef void (*FiberEntryT)(void* argument);
+
+// Called when no fiber is runnable and some are parked. wake_ns is the
+// monotonic time the earliest sleeper is due, 0 if none sleeps. Block at most
+// until then, and return how many parked fibers to resume.
+typedef unsigned int (*FiberIdleT)(void* context, unsigned int parked, unsigned long long wake_ns);
+
+typedef enum FiberState { fiber_runnable, fiber_running, fiber_sleeping, fiber_parked, fiber_finished } FiberStateT;
+
+typedef struct FiberScheduler FiberSchedulerT;
+
+// Construct a scheduler whose fibers get stack_size bytes of stack each
+FiberSchedulerT* fiber_scheduler_create(size_t stack_size);
+// Destroy a scheduler, which must not be running
+void fiber_scheduler_destroy(FiberSchedulerT* scheduler);
+
+// Add a fiber that calls entry(argument) when first run. Returns false if
+// its stack cannot be allocated.
+bool fiber_spawn(FiberSchedulerT* scheduler, FiberEntryT entry, void* argument);
+
+// Run fibers on the calling thread until all of them have finished, sleeping
+// the thread while only sleepers remain. With idle NULL, parked fibers are all
+// resumed whenever nothing else can run.
+void fiber_scheduler_run(FiberSchedulerT* scheduler, FiberIdleT idle, void* context);
+
+// True on a thread inside fiber_scheduler_run
+bool fiber_active();
+
+// From inside a fiber: suspend it until the monotonic clock reaches wake_ns
+void fiber_sleep_until(unsigned long long wake_ns);
+// Suspend for a number of microseconds - outside a fiber this sleeps the thread
+void fiber_sleep(unsigned int microseconds);
+// Suspend until unparked
+void fiber_park();
+// Let the other runnable fibers run first
+void fiber_yield();
+// Make up to n parked fibers runnable, longest parked first. Returns how many.
+unsigned int fiber_unpark(unsigned int n);
+
+#endif
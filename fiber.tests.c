@@ -0,0 +1,129 @@
+#include "fiber.h"
+#include "utilities.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+#define STACK_SIZE (64 * 1024)
+
+static unsigned int order[16];
+static unsigned int order_length;
+
+static void record(unsigned int value) {
+  assert(order_length < sizeof(order) / sizeof(order[0]));
+  order[order_length++] = value;
+}
+
+static void yield_twice(void* argument) {
+  unsigned int const id = (unsigned int)(size_t)argument;
+  record(id);
+  fiber_yield();
+  record(id + 10);
+}
+
+void test_yield() {
+  printf("Test yield\n");
+  FiberSchedulerT* scheduler = fiber_scheduler_create(STACK_SIZE);
+  order_length = 0;
+  assert(fiber_spawn(scheduler, yield_twice, (void*)1));
+  assert(fiber_spawn(scheduler, yield_twice, (void*)2));
+  assert(!fiber_active());
+  fiber_scheduler_run(scheduler, NULL, NULL);
+  assert(order_length == 4);
+  assert(order[0] == 1 && order[1] == 2 && order[2] == 11 && order[3] == 12);
+  fiber_scheduler_destroy(scheduler);
+}
+
+static void sleep_then_record(void* argument) {
+  unsigned int const milliseconds = (unsigned int)(size_t)argument;
+  assert(fiber_active());
+  fiber_sleep(milliseconds * 1000);
+  record(milliseconds);
+}
+
+// Sleepers wake in order of wake time, and they sleep side by side on one thread
+void test_sleep() {
+  printf("Test sleep\n");
+  FiberSchedulerT* scheduler = fiber_scheduler_create(STACK_SIZE);
+  order_length = 0;
+  unsigned int const sleeps[] = { 30, 10, 20 };
+  for(unsigned int i = 0; i != 3; ++i) {
+    assert(fiber_spawn(scheduler, sleep_then_record, (void*)(size_t)sleeps[i]));
+  }
+  unsigned long long const start = monotonic_ns();
+  fiber_scheduler_run(scheduler, NULL, NULL);
+  unsigned long long const elapsed = monotonic_ns() - start;
+  assert(order_length == 3);
+  assert(order[0] == 10 && order[1] == 20 && order[2] == 30);
+  assert(elapsed >= 30000000ULL && elapsed < 55000000ULL);
+  fiber_scheduler_destroy(scheduler);
+}
+
+static unsigned int unparked;
+static unsigned int idle_calls;
+
+static void park_once(void* argument) {
+  fiber_park();
+  unparked++;
+  (void)argument;
+}
+
+static void unpark_others(void* argument) {
+  fiber_yield();
+  assert(fiber_unpark(2) == 2);
+  (void)argument;
+}
+
+static unsigned int resume_one(void* context, unsigned int parked, unsigned long long wake_ns) {
+  assert(parked > 0);
+  assert(wake_ns == 0);
+  idle_calls++;
+  (void)context;
+  return 1;
+}
+
+void test_park() {
+  printf("Test park\n");
+  FiberSchedulerT* scheduler = fiber_scheduler_create(STACK_SIZE);
+  unparked = 0;
+  idle_calls = 0;
+  for(unsigned int i = 0; i != 4; ++i) {
+    assert(fiber_spawn(scheduler, park_once, NULL));
+  }
+  assert(fiber_spawn(scheduler, unpark_others, NULL));
+  fiber_scheduler_run(scheduler, resume_one, NULL);
+  // Two were unparked by a fiber, the rest one per idle call
+  assert(unparked == 4);
+  assert(idle_calls == 2);
+  fiber_scheduler_destroy(scheduler);
+}
+
+static unsigned int sleepers_done;
+
+static void sleep_briefly(void* argument) {
+  fiber_sleep(1000 + (unsigned int)(size_t)argument % 1000);
+  fiber_sleep(1000);
+  sleepers_done++;
+}
+
+// Many more fibers than a thread could ever be, all asleep at once
+void test_many() {
+  printf("Test many\n");
+  FiberSchedulerT* scheduler = fiber_scheduler_create(STACK_SIZE);
+  unsigned int const n = 20000;
+  sleepers_done = 0;
+  for(unsigned int i = 0; i != n; ++i) {
+    assert(fiber_spawn(scheduler, sleep_briefly, (void*)(size_t)i));
+  }
+  fiber_scheduler_run(scheduler, NULL, NULL);
+  assert(sleepers_done == n);
+  fiber_scheduler_destroy(scheduler);
+}
+
+int main() {
+  test_yield();
+  test_sleep();
+  test_park();
+  test_many();
+}
@@ -0,0 +1,114 @@
+#include "heap.h"
+
+#include <stdlib.h>
+
+// Ties go to the lower id, so equal keys are served in a fixed order
+static bool entry_before(HeapEntryT const* a, HeapEntryT const* b) {
+  return a->key < b->key || (a->key == b->key && a->id < b->id);
+}
+
+static void sift_up(HeapEntryT* entries, unsigned int i) {
+  HeapEntryT const entry = entries[i];
+  while (i > 0) {
+    unsigned int const parent = (i - 1) / 2;
+    if (!entry_before(&entry, &entries[parent])) {
+      break;
+    }
+    entries[i] = entries[parent];
+    i = parent;
+  }
+  entries[i] = entry;
+}
+
+static void sift_down(HeapEntryT* entries, unsigned int length, unsigned int i) {
+  HeapEntryT const entry = entries[i];
+  for (;;) {
+    unsigned int child = 2 * i + 1;
+    if (child >= length) {
+      break;
+    }
+    if (child + 1 < length && entry_before(&entries[child + 1], &entries[child])) {
+      child++;
+    }
+    if (!entry_before(&entries[child], &entry)) {
+      break;
+    }
+    entries[i] = entries[child];
+    i = child;
+  }
+  entries[i] = entry;
+}
+
+static unsigned int length_of(HeapT const* heap) {
+  return atomic_load_explicit(&heap->length, memory_order_relaxed);
+}
+
+static void set_length(HeapT* heap, unsigned int length) {
+  atomic_store_explicit(&heap->length, length, memory_order_relaxed);
+}
+
+void heap_init(HeapT* heap) {
+  heap->entries = NULL;
+  atomic_init(&heap->length, 0);
+  heap->capacity = 0;
+  heap->members = 0;
+}
+
+void heap_destroy(HeapT* heap) {
+  free(heap->entries);
+  heap_init(heap);
+}
+
+bool heap_add_member(HeapT* heap) {
+  if (heap->members == heap->capacity) {
+    unsigned int const capacity = heap->capacity ? heap->capacity * 2 : 64;
+    HeapEntryT* entries = (HeapEntryT*)realloc(heap->entries, sizeof(HeapEntryT) * capacity);
+    if (!entries) {
+      return false;
+    }
+    heap->entries = entries;
+    heap->capacity = capacity;
+  }
+  heap->members++;
+  return true;
+}
+
+void heap_remove_member(HeapT* heap) {
+  heap->members--;
+}
+
+void heap_push(HeapT* heap, unsigned long long key, unsigned int id) {
+  unsigned int const length = length_of(heap);
+  heap->entries[length] = (HeapEntryT){ key, id };
+  sift_up(heap->entries, length);
+  set_length(heap, length + 1);
+}
+
+HeapEntryT heap_pop(HeapT* heap) {
+  unsigned int const length = length_of(heap) - 1;
+  HeapEntryT const top = heap->entries[0];
+  heap->entries[0] = heap->entries[length];
+  if (length > 0) {
+    sift_down(heap->entries, length, 0);
+  }
+  set_length(heap, length);
+  return top;
+}
+
+unsigned int heap_filter(HeapT* heap, bool (*keep)(void* context, unsigned int id), void* context) {
+  unsigned int const length = length_of(heap);
+  unsigned int kept = 0;
+  for (unsigned int i = 0; i < length; i++) {
+    if (keep(context, heap->entries[i].id)) {
+      heap->entries[kept++] = heap->entries[i];
+    }
+  }
+  if (kept != length) {
+    // Rebuild bottom-up
+    for (unsigned int i = kept / 2; i-- > 0;) {
+      sift_down(heap->entries, kept, i);
+    }
+    set_length(heap, kept);
+  }
+  return length - kept;
+}
@@ -0,0 +1,39 @@
+#ifndef _HEAP_H_
+#define _HEAP_H_
+
+#include <stdatomic.h>
+#include <stdbool.h>
+
+// Binary min-heap of (key, id) entries behind the stride and deadline run
+// queues. Room is reserved per member when a process is created, so pushing
+// a member back never allocates. Not thread-safe, the caller serialises access.
+
+typedef struct HeapEntry {
+  unsigned long long key;
+  unsigned int id;
+} HeapEntryT;
+
+typedef struct Heap {
+  HeapEntryT* entries;   // Lowest key first, ties by lower id
+  atomic_uint length;    // Written by the serialised owner, may be peeked by others
+  unsigned int capacity;
+  unsigned int members;  // Entries room is reserved for
+} HeapT;
+
+void heap_init(HeapT* heap);
+void heap_destroy(HeapT* heap);
+
+// Reserve room for one more entry, false if the heap could not grow
+bool heap_add_member(HeapT* heap);
+void heap_remove_member(HeapT* heap);
+
+// Add an entry, within the room reserved by heap_add_member
+void heap_push(HeapT* heap, unsigned long long key, unsigned int id);
+// Remove and return the lowest entry - the heap must not be empty
+HeapEntryT heap_pop(HeapT* heap);
+
+// Drop every entry keep returns false for and restore the heap in O(n).
+// Returns how many were dropped.
+unsigned int heap_filter(HeapT* heap, bool (*keep)(void* context, unsigned int id), void* context);
+
+#endif
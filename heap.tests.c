@@ -0,0 +1,62 @@
+#include "heap.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static bool keep_below(void* context, unsigned int id) {
+  return id < *(unsigned int*)context;
+}
+
+void test_heap_order() {
+  printf("Test heap order\n");
+  HeapT heap;
+  heap_init(&heap);
+  unsigned int const n = 10000;
+  srand(2);
+  for (unsigned int i = 0; i < n; i++) {
+    assert(heap_add_member(&heap));
+    heap_push(&heap, rand() % 1000, i);
+  }
+  assert(heap.length == n);
+  assert(heap.capacity >= n && heap.members == n);
+
+  HeapEntryT last = { 0, 0 };
+  for (unsigned int i = 0; i < n; i++) {
+    HeapEntryT const entry = heap_pop(&heap);
+    assert(entry.key > last.key || (entry.key == last.key && (i == 0 || entry.id > last.id)));
+    last = entry;
+  }
+  assert(heap.length == 0);
+  heap_destroy(&heap);
+}
+
+void test_heap_filter() {
+  printf("Test heap filter\n");
+  HeapT heap;
+  heap_init(&heap);
+  for (unsigned int i = 0; i < 100; i++) {
+    assert(heap_add_member(&heap));
+    heap_push(&heap, 1000 - i, i);
+  }
+
+  unsigned int limit = 30;
+  assert(heap_filter(&heap, keep_below, &limit) == 70);
+  assert(heap.length == 30);
+  for (unsigned int i = 30; i-- > 0;) {
+    assert(heap_pop(&heap).id == i);
+  }
+
+  // Members stay reserved until removed, so pushes after a filter need no room
+  assert(heap.members == 100);
+  heap_push(&heap, 5, 1);
+  assert(heap_filter(&heap, keep_below, &limit) == 0);
+  heap_remove_member(&heap);
+  assert(heap.members == 99);
+  heap_destroy(&heap);
+}
+
+int main() {
+  test_heap_order();
+  test_heap_filter();
+}
@@ -0,0 +1,72 @@
+#include "list.h"
+#include "indexed_list.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// Times find and remove-by-value on ListT against IndexedListT. Each round
+// finds a random present value, removes its first occurrence and appends it
+// again, so the list keeps its size. The plain list scans, so it gets fewer
+// rounds at large sizes to keep the run short; times are per round.
+
+static double seconds_since(struct timespec const* start) {
+  struct timespec end;
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  return (end.tv_sec - start->tv_sec) + (end.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static double time_list(unsigned int size, unsigned int rounds) {
+  ListT* list = list_create();
+  for(unsigned int i = 0; i != size; ++i) {
+    list_append(list, i);
+  }
+  srand(1);
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for(unsigned int i = 0; i != rounds; ++i) {
+    unsigned int const value = rand() % size;
+    ListT* node = list_find_first(list, value);
+    if(!node) {
+      fprintf(stderr, "Error: %u missing from list\n", value);
+      exit(EXIT_FAILURE);
+    }
+    list_remove(list, node);
+    list_append(list, value);
+  }
+  double const elapsed = seconds_since(&start);
+  list_destroy(list);
+  return elapsed / rounds;
+}
+
+static double time_indexed_list(unsigned int size, unsigned int rounds) {
+  IndexedListT* list = indexed_list_create();
+  for(unsigned int i = 0; i != size; ++i) {
+    indexed_list_append(list, i);
+  }
+  srand(1);
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for(unsigned int i = 0; i != rounds; ++i) {
+    unsigned int const value = rand() % size;
+    if(!indexed_list_remove_value(list, value)) {
+      fprintf(stderr, "Error: %u missing from indexed list\n", value);
+      exit(EXIT_FAILURE);
+    }
+    indexed_list_append(list, value);
+  }
+  double const elapsed = seconds_since(&start);
+  indexed_list_destroy(list);
+  return elapsed / rounds;
+}
+
+int main() {
+  unsigned int const sizes[] = { 10, 1000, 1000000 };
+  for(unsigned int i = 0; i != sizeof(sizes) / sizeof(sizes[0]); ++i) {
+    unsigned int const size = sizes[i];
+    double const plain = time_list(size, size >= 1000000 ? 200 : 1000000);
+    double const indexed = time_indexed_list(size, 1000000);
+    printf("%8u elements: list %12.1f ns, indexed list %6.1f ns, %8.1fx\n",
+           size, plain * 1e9, indexed * 1e9, plain / indexed);
+  }
+}
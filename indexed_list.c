@@ -0,0 +1,209 @@
+#include "indexed_list.h"
+
+#include <stdlib.h>
+#include <assert.h>
+
+// Probing is linear and the table at most half full, so a lookup touches one
+// or two slots on average. Removal shifts later slots back into the gap
+// instead of leaving tombstones, so removals never slow down later lookups.
+#define INITIAL_CAPACITY 16
+
+static size_t home_of(IndexedListT const* list, unsigned int value) {
+  // Fibonacci hashing spreads consecutive PIDs across the table
+  return (size_t)(((unsigned long long)value * 0x9E3779B97F4A7C15ULL) >> 32) & (list->capacity - 1);
+}
+
+// The slot holding value, or the free slot it would take
+static size_t find_slot(IndexedListT const* list, unsigned int value) {
+  size_t const mask = list->capacity - 1;
+  size_t i = home_of(list, value);
+  while(list->slots[i].first && list->slots[i].value != value) {
+    i = (i + 1) & mask;
+  }
+  return i;
+}
+
+static void grow(IndexedListT* list) {
+  IndexedListSlotT* const old = list->slots;
+  size_t const old_capacity = list->capacity;
+  list->capacity = old_capacity * 2;
+  list->slots = calloc(list->capacity, sizeof(IndexedListSlotT));
+  assert(list->slots);
+  for(size_t i = 0; i != old_capacity; ++i) {
+    if(old[i].first) {
+      list->slots[find_slot(list, old[i].value)] = old[i];
+    }
+  }
+  free(old);
+}
+
+static void free_slot(IndexedListT* list, size_t i) {
+  size_t const mask = list->capacity - 1;
+  list->slots[i].first = NULL;
+  for(size_t j = (i + 1) & mask; list->slots[j].first; j = (j + 1) & mask) {
+    // Move the entry back unless its home lies cyclically in (i, j]
+    size_t const home = home_of(list, list->slots[j].value);
+    if(i <= j ? (home <= i || home > j) : (home <= i && home > j)) {
+      list->slots[i] = list->slots[j];
+      list->slots[j].first = NULL;
+      i = j;
+    }
+  }
+  --list->used;
+}
+
+static IndexedListNodeT* index_node(IndexedListT* list, unsigned int value, bool front) {
+  if(2 * (list->used + 1) > list->capacity) {
+    grow(list);
+  }
+  IndexedListNodeT* node = malloc(sizeof(IndexedListNodeT));
+  assert(node);
+  node->value = value;
+  node->same_pred = NULL;
+  node->same_succ = NULL;
+
+  IndexedListSlotT* slot = &list->slots[find_slot(list, value)];
+  if(!slot->first) {
+    slot->value = value;
+    slot->first = node;
+    slot->last = node;
+    ++list->used;
+  } else if(front) {
+    node->same_succ = slot->first;
+    slot->first->same_pred = node;
+    slot->first = node;
+  } else {
+    node->same_pred = slot->last;
+    slot->last->same_succ = node;
+    slot->last = node;
+  }
+  ++list->length;
+  return node;
+}
+
+void indexed_list_prepend(IndexedListT* list, unsigned int value) {
+  assert(list);
+  IndexedListNodeT* node = index_node(list, value, true);
+  node->succ = list->sentinel.succ;
+  list->sentinel.succ->pred = node;
+  list->sentinel.succ = node;
+  node->pred = &list->sentinel;
+}
+
+void indexed_list_append(IndexedListT* list, unsigned int value) {
+  assert(list);
+  IndexedListNodeT* node = index_node(list, value, false);
+  node->pred = list->sentinel.pred;
+  list->sentinel.pred->succ = node;
+  list->sentinel.pred = node;
+  node->succ = &list->sentinel;
+}
+
+void indexed_list_remove(IndexedListT* list, IndexedListNodeT* node) {
+  assert(list);
+  assert(node);
+  assert(node != &list->sentinel);
+  node->pred->succ = node->succ;
+  node->succ->pred = node->pred;
+
+  size_t const i = find_slot(list, node->value);
+  IndexedListSlotT* slot = &list->slots[i];
+  assert(slot->first);
+  if(node->same_pred) {
+    node->same_pred->same_succ = node->same_succ;
+  } else {
+    slot->first = node->same_succ;
+  }
+  if(node->same_succ) {
+    node->same_succ->same_pred = node->same_pred;
+  } else {
+    slot->last = node->same_pred;
+  }
+  if(!slot->first) {
+    free_slot(list, i);
+  }
+  --list->length;
+  free(node);
+}
+
+bool indexed_list_remove_value(IndexedListT* list, unsigned int value) {
+  IndexedListNodeT* node = indexed_list_find_first(list, value);
+  if(!node) {
+    return false;
+  }
+  indexed_list_remove(list, node);
+  return true;
+}
+
+IndexedListT* indexed_list_create() {
+  IndexedListT* list = malloc(sizeof(IndexedListT));
+  assert(list);
+  list->sentinel.value = 0;
+  list->sentinel.succ = &list->sentinel;
+  list->sentinel.pred = &list->sentinel;
+  list->capacity = INITIAL_CAPACITY;
+  list->slots = calloc(list->capacity, sizeof(IndexedListSlotT));
+  assert(list->slots);
+  list->used = 0;
+  list->length = 0;
+  return list;
+}
+
+int indexed_list_empty(IndexedListT* list) {
+  return list->sentinel.succ == &list->sentinel;
+}
+
+void indexed_list_destroy(IndexedListT* list) {
+  assert(list);
+  // Every node goes, so the index can go with it rather than be unwound
+  IndexedListNodeT* node = list->sentinel.succ;
+  while(node != &list->sentinel) {
+    IndexedListNodeT* succ = node->succ;
+    free(node);
+    node = succ;
+  }
+  free(list->slots);
+  free(list);
+}
+
+size_t indexed_list_length(IndexedListT* list) {
+  assert(list);
+  return list->length;
+}
+
+IndexedListNodeT* indexed_list_find_first(IndexedListT* list, unsigned int value) {
+  assert(list);
+  return list->slots[find_slot(list, value)].first;
+}
+
+IndexedListNodeT* indexed_list_find_last(IndexedListT* list, unsigned int value) {
+  assert(list);
+  IndexedListSlotT const* slot = &list->slots[find_slot(list, value)];
+  return slot->first ? slot->last : NULL;
+}
+
+unsigned int indexed_list_pop_front(IndexedListT* list) {
+  assert(list);
+  assert(!indexed_list_empty(list));
+  unsigned int const value = list->sentinel.succ->value;
+  indexed_list_remove(list, list->sentinel.succ);
+  return value;
+}
+
+unsigned int indexed_list_pop_back(IndexedListT* list) {
+  assert(list);
+  assert(!indexed_list_empty(list));
+  unsigned int const value = list->sentinel.pred->value;
+  indexed_list_remove(list, list->sentinel.pred);
+  return value;
+}
+
+void indexed_list_for_each(IndexedListT* list, void (*action)(unsigned int const*)) {
+  assert(list);
+  for(IndexedListNodeT* node = list->sentinel.succ;
+      node != &list->sentinel;
+      node = node->succ) {
+    assert(node);
+    action(&node->value);
+  }
+}
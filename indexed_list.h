@@ -0,0 +1,73 @@
+#ifndef _INDEXED_LIST_H_
+#define _INDEXED_LIST_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// A ListT variant indexed by value. Nodes keep insertion order exactly as in
+// list.h, and an open-addressing hash maps each distinct value to its first
+// and last node, with the nodes of equal value chained to one another. Find,
+// remove by value and length are O(1) expected rather than O(n).
+
+typedef struct IndexedListNode {
+  struct IndexedListNode* pred;
+  struct IndexedListNode* succ;
+  struct IndexedListNode* same_pred;  // Neighbouring nodes holding the same value
+  struct IndexedListNode* same_succ;
+  unsigned int value;
+} IndexedListNodeT;
+
+typedef struct IndexedListSlot {
+  unsigned int value;       // Kept beside the nodes so probing stays within the table
+  IndexedListNodeT* first;  // NULL while the slot is free
+  IndexedListNodeT* last;
+} IndexedListSlotT;
+
+typedef struct IndexedList {
+  IndexedListNodeT sentinel;
+  IndexedListSlotT* slots;
+  size_t capacity;          // Power of two
+  size_t used;              // Distinct values indexed
+  size_t length;
+} IndexedListT;
+
+// Construct an empty list
+IndexedListT* indexed_list_create();
+// Destroy a list and free all its memory
+void indexed_list_destroy(IndexedListT* list);
+
+// Prepend value to the front of the list
+void indexed_list_prepend(IndexedListT* list, unsigned int value);
+
+// Append value to the end of the list
+void indexed_list_append(IndexedListT* list, unsigned int value);
+
+// Remove the node from the list, and free its memory
+void indexed_list_remove(IndexedListT* list, IndexedListNodeT* node);
+
+// Remove the first occurrence of value, false if absent
+bool indexed_list_remove_value(IndexedListT* list, unsigned int value);
+
+// Test if the list is empty in constant time
+int indexed_list_empty(IndexedListT* list);
+
+// The list length in constant time
+size_t indexed_list_length(IndexedListT* list);
+
+// Find the first occurrence
+IndexedListNodeT* indexed_list_find_first(IndexedListT* list, unsigned int value);
+
+// Find the last occurrence
+IndexedListNodeT* indexed_list_find_last(IndexedListT* list, unsigned int value);
+
+// Remove the first element - undefined if absent
+unsigned int indexed_list_pop_front(IndexedListT* list);
+
+// Remove the last element - undefined if absent
+unsigned int indexed_list_pop_back(IndexedListT* list);
+
+// Run action on each element of the list. Values are indexed, so unlike
+// list_for_each the action cannot change them.
+void indexed_list_for_each(IndexedListT* list, void (*action)(unsigned int const*));
+
+#endif
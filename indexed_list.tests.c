@@ -0,0 +1,149 @@
+#include "indexed_list.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+void test_empty_creation_destruction() {
+  printf("Test empty creation/destruction\n");
+  IndexedListT* list = indexed_list_create();
+  assert(indexed_list_empty(list));
+  assert(indexed_list_length(list) == 0);
+  assert(!indexed_list_find_first(list, 0));
+  assert(!indexed_list_find_last(list, 0));
+  indexed_list_destroy(list);
+}
+
+void test_order() {
+  printf("Test order\n");
+  IndexedListT* list = indexed_list_create();
+  indexed_list_append(list, 2);
+  indexed_list_prepend(list, 1);
+  indexed_list_append(list, 3);
+  assert(indexed_list_length(list) == 3);
+  assert(indexed_list_pop_front(list) == 1);
+  assert(indexed_list_pop_back(list) == 3);
+  assert(indexed_list_pop_front(list) == 2);
+  assert(indexed_list_empty(list));
+  indexed_list_destroy(list);
+}
+
+void test_find() {
+  printf("Test find\n");
+  IndexedListT* list = indexed_list_create();
+  indexed_list_prepend(list, 101);
+  indexed_list_prepend(list, 202);
+  indexed_list_prepend(list, 101);
+
+  IndexedListNodeT* first = indexed_list_find_first(list, 101);
+  assert(first);
+  assert(first == list->sentinel.succ);
+  IndexedListNodeT* last = indexed_list_find_last(list, 101);
+  assert(last);
+  assert(last == list->sentinel.pred);
+  assert(first != last);
+  assert(!indexed_list_find_first(list, 303));
+  assert(!indexed_list_find_last(list, 303));
+
+  indexed_list_destroy(list);
+}
+
+void test_remove() {
+  printf("Test remove\n");
+  IndexedListT* list = indexed_list_create();
+  indexed_list_append(list, 101);
+  indexed_list_append(list, 202);
+  indexed_list_append(list, 101);
+  indexed_list_append(list, 101);
+
+  IndexedListNodeT* first = indexed_list_find_first(list, 101);
+  IndexedListNodeT* middle = first->succ->succ;
+  IndexedListNodeT* last = indexed_list_find_last(list, 101);
+  indexed_list_remove(list, middle);
+  assert(indexed_list_find_first(list, 101) == first);
+  assert(indexed_list_find_last(list, 101) == last);
+  indexed_list_remove(list, first);
+  assert(indexed_list_find_first(list, 101) == last);
+  assert(indexed_list_remove_value(list, 101));
+  assert(!indexed_list_find_first(list, 101));
+  assert(!indexed_list_find_last(list, 101));
+  assert(!indexed_list_remove_value(list, 101));
+  assert(indexed_list_length(list) == 1);
+  assert(indexed_list_pop_front(list) == 202);
+
+  indexed_list_destroy(list);
+}
+
+static unsigned long long sum;
+
+static void add_to_sum(unsigned int const* value) {
+  sum += *value;
+}
+
+void test_for_each() {
+  printf("Test for each\n");
+  IndexedListT* list = indexed_list_create();
+  for(unsigned int i = 1; i <= 100; ++i) {
+    indexed_list_append(list, i);
+  }
+  sum = 0;
+  indexed_list_for_each(list, add_to_sum);
+  assert(sum == 5050);
+  indexed_list_destroy(list);
+}
+
+// Check the index against a plain array through growth and heavy removal,
+// which exercises the backward shift on deletion
+void test_against_array() {
+  printf("Test against array\n");
+  IndexedListT* list = indexed_list_create();
+  unsigned int const n = 20000;
+  unsigned int* counts = calloc(n, sizeof(unsigned int));
+  assert(counts);
+  srand(3);
+  for(unsigned int i = 0; i < 200000; ++i) {
+    unsigned int const value = rand() % n;
+    if(rand() % 3) {
+      if(rand() % 2) {
+        indexed_list_append(list, value);
+      } else {
+        indexed_list_prepend(list, value);
+      }
+      counts[value]++;
+    } else {
+      assert(indexed_list_remove_value(list, value) == (counts[value] != 0));
+      counts[value] -= counts[value] != 0;
+    }
+  }
+
+  size_t length = 0;
+  for(unsigned int value = 0; value < n; ++value) {
+    length += counts[value];
+    IndexedListNodeT* node = indexed_list_find_first(list, value);
+    assert((node != NULL) == (counts[value] != 0));
+    unsigned int seen = 0;
+    for(; node; node = node->same_succ) {
+      assert(node->value == value);
+      ++seen;
+    }
+    assert(seen == counts[value]);
+  }
+  assert(indexed_list_length(list) == length);
+
+  while(!indexed_list_empty(list)) {
+    unsigned int const value = indexed_list_pop_back(list);
+    assert(counts[value]-- != 0);
+  }
+  assert(list->used == 0);
+  free(counts);
+  indexed_list_destroy(list);
+}
+
+int main() {
+  test_empty_creation_destruction();
+  test_order();
+  test_find();
+  test_remove();
+  test_for_each();
+  test_against_array();
+}
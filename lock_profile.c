@@ -0,0 +1,205 @@
+#include "lock_profile.h"
+
+#if LOCK_PROFILE
+
+#include "logger.h"
+#include "utilities.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+// Locks the calling thread holds, so unlock can charge the hold time to the
+// site that acquired it
+#define LOCK_PROFILE_DEPTH 8
+
+typedef struct HeldLock {
+  pthread_mutex_t* mutex;
+  LockSiteT* site;
+  unsigned long long since;
+} HeldLockT;
+
+static __thread HeldLockT held[LOCK_PROFILE_DEPTH];
+static __thread unsigned int held_count = 0;
+
+static LockSiteT* _Atomic sites = NULL;
+
+static unsigned int bucket(unsigned long long ns) {
+  unsigned int const b = ns ? 63 - __builtin_clzll(ns) : 0;
+  return b < LOCK_PROFILE_BUCKETS ? b : LOCK_PROFILE_BUCKETS - 1;
+}
+
+static void record(atomic_ullong* total, atomic_ullong* histogram, unsigned long long ns) {
+  atomic_fetch_add_explicit(total, ns, memory_order_relaxed);
+  atomic_fetch_add_explicit(&histogram[bucket(ns)], 1, memory_order_relaxed);
+}
+
+static void begin_hold(pthread_mutex_t* mutex, LockSiteT* site) {
+  if (held_count < LOCK_PROFILE_DEPTH) {
+    held[held_count++] = (HeldLockT){ mutex, site, monotonic_ns() };
+  }
+}
+
+static void end_hold(pthread_mutex_t* mutex) {
+  for (unsigned int i = held_count; i-- > 0;) {
+    if (held[i].mutex == mutex) {
+      record(&held[i].site->hold_ns, held[i].site->hold_histogram, monotonic_ns() - held[i].since);
+      held[i] = held[--held_count];
+      return;
+    }
+  }
+}
+
+static void register_site(LockSiteT* site) {
+  if (!atomic_exchange(&site->registered, true)) {
+    site->next = atomic_load(&sites);
+    while (!atomic_compare_exchange_weak(&sites, &site->next, site));
+  }
+}
+
+int lock_profile_lock(pthread_mutex_t* mutex, LockSiteT* site) {
+  register_site(site);
+
+  // Only a failed trylock counts as contended and pays for timing the wait
+  int result = pthread_mutex_trylock(mutex);
+  if (result == EBUSY) {
+    unsigned long long const start = monotonic_ns();
+    result = pthread_mutex_lock(mutex);
+    atomic_fetch_add_explicit(&site->contended, 1, memory_order_relaxed);
+    record(&site->wait_ns, site->wait_histogram, monotonic_ns() - start);
+  }
+  if (result == 0) {
+    atomic_fetch_add_explicit(&site->acquisitions, 1, memory_order_relaxed);
+    begin_hold(mutex, site);
+  }
+  return result;
+}
+
+// A trylock that finds the lock taken counts as contended but never waits
+int lock_profile_trylock(pthread_mutex_t* mutex, LockSiteT* site) {
+  register_site(site);
+
+  int const result = pthread_mutex_trylock(mutex);
+  if (result == EBUSY) {
+    atomic_fetch_add_explicit(&site->contended, 1, memory_order_relaxed);
+  } else if (result == 0) {
+    atomic_fetch_add_explicit(&site->acquisitions, 1, memory_order_relaxed);
+    begin_hold(mutex, site);
+  }
+  return result;
+}
+
+int lock_profile_unlock(pthread_mutex_t* mutex) {
+  end_hold(mutex);
+  return pthread_mutex_unlock(mutex);
+}
+
+// Time asleep on the condition is not held time, so the hold is split around it
+int lock_profile_wait(pthread_cond_t* cond, pthread_mutex_t* mutex, struct timespec const* deadline) {
+  LockSiteT* site = NULL;
+  for (unsigned int i = held_count; i-- > 0;) {
+    if (held[i].mutex == mutex) {
+      site = held[i].site;
+      break;
+    }
+  }
+  end_hold(mutex);
+  int const result = deadline ? pthread_cond_timedwait(cond, mutex, deadline) : pthread_cond_wait(cond, mutex);
+  if (site) {
+    begin_hold(mutex, site);
+  }
+  return result;
+}
+
+// Upper bound of the bucket holding the given fraction of samples
+static unsigned long long percentile(unsigned long long const* histogram, double fraction) {
+  unsigned long long total = 0;
+  for (int b = 0; b < LOCK_PROFILE_BUCKETS; b++) {
+    total += histogram[b];
+  }
+  unsigned long long seen = 0;
+  for (int b = 0; b < LOCK_PROFILE_BUCKETS; b++) {
+    seen += histogram[b];
+    if (total && seen >= fraction * total) {
+      return 2ULL << b;
+    }
+  }
+  return 0;
+}
+
+typedef struct LockTotals {
+  unsigned long long acquisitions, contended, wait_ns, hold_ns;
+  unsigned long long wait_histogram[LOCK_PROFILE_BUCKETS];
+  unsigned long long hold_histogram[LOCK_PROFILE_BUCKETS];
+} LockTotalsT;
+
+static void add_site(LockTotalsT* totals, LockSiteT* site) {
+  totals->acquisitions += atomic_load(&site->acquisitions);
+  totals->contended += atomic_load(&site->contended);
+  totals->wait_ns += atomic_load(&site->wait_ns);
+  totals->hold_ns += atomic_load(&site->hold_ns);
+  for (int b = 0; b < LOCK_PROFILE_BUCKETS; b++) {
+    totals->wait_histogram[b] += atomic_load(&site->wait_histogram[b]);
+    totals->hold_histogram[b] += atomic_load(&site->hold_histogram[b]);
+  }
+}
+
+static void log_totals(char const* label, LockTotalsT const* totals) {
+  char log_buffer[256];
+  sprintf(log_buffer,
+          "%s: %llu acquisitions, %llu contended (%.1f%%), wait %.3fms p50<%lluns p99<%lluns, "
+          "hold %.3fms p50<%lluns p99<%lluns",
+          label, totals->acquisitions, totals->contended,
+          totals->acquisitions ? 100.0 * totals->contended / totals->acquisitions : 0.0,
+          totals->wait_ns / 1e6, percentile(totals->wait_histogram, 0.5), percentile(totals->wait_histogram, 0.99),
+          totals->hold_ns / 1e6, percentile(totals->hold_histogram, 0.5), percentile(totals->hold_histogram, 0.99));
+  logger_write(log_buffer);
+}
+
+static void log_histogram(char const* name, unsigned long long const* histogram) {
+  char log_buffer[512];
+  int length = sprintf(log_buffer, "  %s histogram (ns<count):", name);
+  for (int b = 0; b < LOCK_PROFILE_BUCKETS; b++) {
+    if (histogram[b]) {
+      length += sprintf(log_buffer + length, " %llu<%llu", 2ULL << b, histogram[b]);
+    }
+  }
+  logger_write(log_buffer);
+}
+
+void lock_profile_report() {
+  LockSiteT* first = atomic_load(&sites);
+  for (LockSiteT* site = first; site; site = site->next) {
+    // Group by lock: report each lock once, at its first site in the list
+    bool seen = false;
+    for (LockSiteT* other = first; other != site; other = other->next) {
+      seen |= strcmp(other->file, site->file) == 0 && strcmp(other->lock, site->lock) == 0;
+    }
+    if (seen) {
+      continue;
+    }
+
+    LockTotalsT totals = { 0 };
+    for (LockSiteT* other = site; other; other = other->next) {
+      if (strcmp(other->file, site->file) == 0 && strcmp(other->lock, site->lock) == 0) {
+        add_site(&totals, other);
+      }
+    }
+    char label[128];
+    snprintf(label, sizeof(label), "Lock %s in %s", site->lock, site->file);
+    log_totals(label, &totals);
+    log_histogram("wait", totals.wait_histogram);
+    log_histogram("hold", totals.hold_histogram);
+
+    for (LockSiteT* other = site; other; other = other->next) {
+      if (strcmp(other->file, site->file) == 0 && strcmp(other->lock, site->lock) == 0) {
+        LockTotalsT site_totals = { 0 };
+        add_site(&site_totals, other);
+        snprintf(label, sizeof(label), "  at %s:%d", other->file, other->line);
+        log_totals(label, &site_totals);
+      }
+    }
+  }
+}
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef _LOCK_PROFILE_H_
+#define _LOCK_PROFILE_H_
+
+#include <pthread.h>
+
+// Lock contention profiler. Modules lock through the PROFILED_* macros; with
+// LOCK_PROFILE set to 1 every call site records acquisitions, contended
+// acquisitions and log2 histograms of wait and hold time, and
+// lock_profile_report logs them per lock and per site. With LOCK_PROFILE 0
+// (the default) the macros are the plain pthread calls.
+
+#ifndef LOCK_PROFILE
+#define LOCK_PROFILE 0
+#endif
+
+// Histogram bucket b counts times in [2^b, 2^(b+1)) ns, the last is open-ended
+#define LOCK_PROFILE_BUCKETS 32
+
+#if LOCK_PROFILE
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <time.h>
+
+typedef struct LockSite {
+  char const* lock;   // The locked expression, e.g. "&process_mutex"
+  char const* file;
+  int line;
+  atomic_ullong acquisitions;
+  atomic_ullong contended;
+  atomic_ullong wait_ns;
+  atomic_ullong hold_ns;
+  atomic_ullong wait_histogram[LOCK_PROFILE_BUCKETS];
+  atomic_ullong hold_histogram[LOCK_PROFILE_BUCKETS];
+  atomic_bool registered;
+  struct LockSite* next;
+} LockSiteT;
+
+int lock_profile_lock(pthread_mutex_t* mutex, LockSiteT* site);
+int lock_profile_trylock(pthread_mutex_t* mutex, LockSiteT* site);
+int lock_profile_unlock(pthread_mutex_t* mutex);
+int lock_profile_wait(pthread_cond_t* cond, pthread_mutex_t* mutex, struct timespec const* deadline);
+
+#define LOCK_PROFILE_SITE(mutex) \
+  ({ static LockSiteT _site = { .lock = #mutex, .file = __FILE__, .line = __LINE__ }; &_site; })
+
+#define PROFILED_LOCK(mutex) lock_profile_lock((mutex), LOCK_PROFILE_SITE(mutex))
+#define PROFILED_TRYLOCK(mutex) lock_profile_trylock((mutex), LOCK_PROFILE_SITE(mutex))
+#define PROFILED_UNLOCK(mutex) lock_profile_unlock(mutex)
+#define PROFILED_WAIT(cond, mutex) lock_profile_wait((cond), (mutex), NULL)
+#define PROFILED_TIMEDWAIT(cond, mutex, deadline) lock_profile_wait((cond), (mutex), (deadline))
+
+// Log every site seen so far, grouped by lock
+void lock_profile_report();
+
+#else
+
+#define PROFILED_LOCK(mutex) pthread_mutex_lock(mutex)
+#define PROFILED_TRYLOCK(mutex) pthread_mutex_trylock(mutex)
+#define PROFILED_UNLOCK(mutex) pthread_mutex_unlock(mutex)
+#define PROFILED_WAIT(cond, mutex) pthread_cond_wait((cond), (mutex))
+#define PROFILED_TIMEDWAIT(cond, mutex, deadline) pthread_cond_timedwait((cond), (mutex), (deadline))
+
+static inline void lock_profile_report() {}
+
+#endif
+
+#endif
@@ -1,5 +1,6 @@
 #include "logger.h"
 #include "utilities.h"
+#include "lock_profile.h"
 
 // Student : Salameh Alfasatleh ID: 20578169
 #include <stdio.h>
@@ -8,17 +9,28 @@
 
 static int message_c = 0;
 static pthread_mutex_t logger_mutex;
+static FILE* logger_output = NULL;
+static int logger_discard = 0;
 
 void logger_start() {
 	pthread_mutex_init(&logger_mutex, NULL);
 }
 
+void logger_set_output(FILE* output) {
+	logger_output = output;
+	logger_discard = output == NULL;
+}
+
 void logger_stop() {
 	pthread_mutex_destroy(&logger_mutex);
 }
 
 void logger_write(char const* message) {
-	pthread_mutex_lock(&logger_mutex);
+	if (logger_discard) {
+		return;
+	}
+
+	PROFILED_LOCK(&logger_mutex);
 
 	time_t raw_time;
 	struct tm* time_info;
@@ -28,9 +40,9 @@ void logger_write(char const* message) {
 	time_info = localtime(&raw_time);
 	strftime(time_buffer, sizeof(time_buffer), "%H:%M:%S", time_info);
 
-	printf("%d : %s : %s\n", message_c, time_buffer, message);
+	fprintf(logger_output ? logger_output : stdout, "%d : %s : %s\n", message_c, time_buffer, message);
 
 	message_c++;
 
-	pthread_mutex_unlock(&logger_mutex);
+	PROFILED_UNLOCK(&logger_mutex);
 }
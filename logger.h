@@ -1,7 +1,11 @@
 #ifndef _LOGGER_H_
 #define _LOGGER_H_
 
+#include <stdio.h>
+
 void logger_start();
+// Send messages to output instead of stdout, NULL discards them
+void logger_set_output(FILE* output);
 void logger_stop();
 void logger_write(char const* message);
 
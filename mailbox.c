@@ -0,0 +1,90 @@
+#include "mailbox.h"
+#include "utilities.h"
+
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <assert.h>
+
+// head and tail count every message ever received and sent, and wrap with
+// unsigned arithmetic; the slot is the count masked by the capacity. Each
+// side keeps a stale copy of the other's index and only reloads it when the
+// ring looks full or empty, so the shared line is read once per lap rather
+// than once per message.
+struct Mailbox {
+  // Receiver's line
+  atomic_uint head __attribute__((aligned(CACHE_LINE_SIZE)));
+  unsigned int cached_tail;
+  // Sender's line
+  atomic_uint tail __attribute__((aligned(CACHE_LINE_SIZE)));
+  unsigned int cached_head;
+  // Read-only after creation
+  unsigned int mask __attribute__((aligned(CACHE_LINE_SIZE)));
+  uintptr_t* slots;
+};
+
+MailboxT* mailbox_create(unsigned int capacity) {
+  assert(capacity > 0 && capacity <= 0x80000000U);
+  unsigned int size = 1;
+  while(size < capacity) {
+    size *= 2;
+  }
+  void* memory = NULL;
+  if(posix_memalign(&memory, CACHE_LINE_SIZE, sizeof(MailboxT)) != 0) {
+    return NULL;
+  }
+  MailboxT* mailbox = (MailboxT*)memory;
+  mailbox->slots = (uintptr_t*)malloc(sizeof(uintptr_t) * size);
+  if(!mailbox->slots) {
+    free(mailbox);
+    return NULL;
+  }
+  atomic_init(&mailbox->head, 0);
+  atomic_init(&mailbox->tail, 0);
+  mailbox->cached_head = 0;
+  mailbox->cached_tail = 0;
+  mailbox->mask = size - 1;
+  return mailbox;
+}
+
+void mailbox_destroy(MailboxT* mailbox) {
+  assert(mailbox);
+  free(mailbox->slots);
+  free(mailbox);
+}
+
+bool mailbox_send(MailboxT* mailbox, uintptr_t message) {
+  unsigned int const tail = atomic_load_explicit(&mailbox->tail, memory_order_relaxed);
+  if(tail - mailbox->cached_head > mailbox->mask) {
+    mailbox->cached_head = atomic_load_explicit(&mailbox->head, memory_order_acquire);
+    if(tail - mailbox->cached_head > mailbox->mask) {
+      return false;
+    }
+  }
+  mailbox->slots[tail & mailbox->mask] = message;
+  // Publishes the slot to the receiver
+  atomic_store_explicit(&mailbox->tail, tail + 1, memory_order_release);
+  return true;
+}
+
+bool mailbox_receive(MailboxT* mailbox, uintptr_t* message) {
+  unsigned int const head = atomic_load_explicit(&mailbox->head, memory_order_relaxed);
+  if(head == mailbox->cached_tail) {
+    mailbox->cached_tail = atomic_load_explicit(&mailbox->tail, memory_order_acquire);
+    if(head == mailbox->cached_tail) {
+      return false;
+    }
+  }
+  *message = mailbox->slots[head & mailbox->mask];
+  // Hands the slot back to the sender only once the message is read
+  atomic_store_explicit(&mailbox->head, head + 1, memory_order_release);
+  return true;
+}
+
+unsigned int mailbox_length(MailboxT* mailbox) {
+  unsigned int const head = atomic_load_explicit(&mailbox->head, memory_order_acquire);
+  return atomic_load_explicit(&mailbox->tail, memory_order_acquire) - head;
+}
+
+unsigned int mailbox_capacity(MailboxT const* mailbox) {
+  return mailbox->mask + 1;
+}
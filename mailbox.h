@@ -0,0 +1,29 @@
+#ifndef _MAILBOX_H_
+#define _MAILBOX_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Bounded single-producer single-consumer ring of message words. One thread
+// may send while another receives, with no lock: each side owns one index
+// and only reads the other's. Messages are stored in the slots themselves,
+// so a pointer-sized payload moves without copying what it points to.
+// Several senders, or several receivers, must serialise among themselves.
+
+typedef struct Mailbox MailboxT;
+
+// Construct a mailbox holding at least capacity messages, rounded up to a
+// power of two. Returns NULL if it cannot be allocated.
+MailboxT* mailbox_create(unsigned int capacity);
+void mailbox_destroy(MailboxT* mailbox);
+
+// Append a message, false if the mailbox is full
+bool mailbox_send(MailboxT* mailbox, uintptr_t message);
+// Take the oldest message, false if the mailbox is empty
+bool mailbox_receive(MailboxT* mailbox, uintptr_t* message);
+
+// Messages held - exact only while neither side is active
+unsigned int mailbox_length(MailboxT* mailbox);
+unsigned int mailbox_capacity(MailboxT const* mailbox);
+
+#endif
@@ -0,0 +1,96 @@
+#include "mailbox.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <pthread.h>
+#include <sched.h>
+
+void test_empty_creation_destruction() {
+  printf("Test empty creation/destruction\n");
+  MailboxT* mailbox = mailbox_create(5);
+  assert(mailbox);
+  assert(mailbox_capacity(mailbox) == 8);
+  assert(mailbox_length(mailbox) == 0);
+  uintptr_t message;
+  assert(!mailbox_receive(mailbox, &message));
+  mailbox_destroy(mailbox);
+}
+
+// Fill to capacity and drain, several laps, so the indices wrap the slots
+void test_full_and_empty() {
+  printf("Test full and empty\n");
+  MailboxT* mailbox = mailbox_create(4);
+  uintptr_t next_sent = 0;
+  uintptr_t next_received = 0;
+  for(unsigned int lap = 0; lap != 5; ++lap) {
+    while(mailbox_send(mailbox, next_sent)) {
+      next_sent++;
+    }
+    assert(mailbox_length(mailbox) == 4);
+    uintptr_t message;
+    // One out makes room for exactly one in
+    assert(mailbox_receive(mailbox, &message) && message == next_received++);
+    assert(mailbox_send(mailbox, next_sent++));
+    assert(!mailbox_send(mailbox, next_sent));
+    while(mailbox_receive(mailbox, &message)) {
+      assert(message == next_received++);
+    }
+    assert(mailbox_length(mailbox) == 0);
+  }
+  assert(next_received == next_sent);
+  mailbox_destroy(mailbox);
+}
+
+// Pointers travel as they are, the pointee is never copied
+void test_pointer_payload() {
+  printf("Test pointer payload\n");
+  MailboxT* mailbox = mailbox_create(2);
+  unsigned int values[2] = { 101, 202 };
+  assert(mailbox_send(mailbox, (uintptr_t)&values[0]));
+  assert(mailbox_send(mailbox, (uintptr_t)&values[1]));
+  uintptr_t message;
+  assert(mailbox_receive(mailbox, &message) && (unsigned int*)message == &values[0]);
+  assert(mailbox_receive(mailbox, &message) && *(unsigned int*)message == 202);
+  mailbox_destroy(mailbox);
+}
+
+#define STREAM_LENGTH 2000000
+
+static void* send_stream(void* argument) {
+  MailboxT* mailbox = (MailboxT*)argument;
+  for(uintptr_t i = 1; i <= STREAM_LENGTH; ++i) {
+    while(!mailbox_send(mailbox, i)) {
+      sched_yield();
+    }
+  }
+  return NULL;
+}
+
+// One thread sends while another receives: every message arrives once, in order
+void test_two_threads() {
+  printf("Test two threads\n");
+  MailboxT* mailbox = mailbox_create(64);
+  pthread_t sender;
+  assert(pthread_create(&sender, NULL, send_stream, mailbox) == 0);
+  uintptr_t expected = 1;
+  while(expected <= STREAM_LENGTH) {
+    uintptr_t message;
+    if(mailbox_receive(mailbox, &message)) {
+      assert(message == expected);
+      expected++;
+    } else {
+      sched_yield();
+    }
+  }
+  pthread_join(sender, NULL);
+  assert(mailbox_length(mailbox) == 0);
+  mailbox_destroy(mailbox);
+}
+
+int main() {
+  test_empty_creation_destruction();
+  test_full_and_empty();
+  test_pointer_payload();
+  test_two_threads();
+}
@@ -1,5 +1,6 @@
 #include "non_blocking_queue.h"
 #include "utilities.h"
+#include "lock_profile.h"
 
 #include <assert.h>
 // Student : Salameh Alfasatleh ID: 20578169
@@ -19,35 +20,35 @@ void non_blocking_queue_destroy(NonBlockingQueueT* queue) {
 }
 
 void non_blocking_queue_push(NonBlockingQueueT* queue, unsigned int value) {
-  pthread_mutex_lock(&queue->mutex);
+  PROFILED_LOCK(&queue->mutex);
   list_append(queue->list, value);
   queue->length++;
-  pthread_mutex_unlock(&queue->mutex);
+  PROFILED_UNLOCK(&queue->mutex);
 }
 
 int non_blocking_queue_pop(NonBlockingQueueT* queue, unsigned int* value) {
-  pthread_mutex_lock(&queue->mutex);
+  PROFILED_LOCK(&queue->mutex);
   if(list_empty(queue->list)){
-    pthread_mutex_unlock(&queue->mutex);
+    PROFILED_UNLOCK(&queue->mutex);
     return -1;
   }
   *value = list_pop_front(queue->list);
   queue->length--;
-  pthread_mutex_unlock(&queue->mutex);
+  PROFILED_UNLOCK(&queue->mutex);
 
   return 0;
 }
 
 int non_blocking_queue_empty(NonBlockingQueueT* queue) {
-  pthread_mutex_lock(&queue->mutex);        
+  PROFILED_LOCK(&queue->mutex);        
   int is_empty = list_empty(queue->list);  
-  pthread_mutex_unlock(&queue->mutex);   
+  PROFILED_UNLOCK(&queue->mutex);   
   return is_empty;
 }
 
 int non_blocking_queue_length(NonBlockingQueueT* queue) {
-  pthread_mutex_lock(&queue->mutex);        
+  PROFILED_LOCK(&queue->mutex);        
   int length = queue->length;               
-  pthread_mutex_unlock(&queue->mutex);      
+  PROFILED_UNLOCK(&queue->mutex);      
   return length;
 }
@@ -0,0 +1,134 @@
+#include "evaluator.h"
+#include "utilities.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// Compares the old packed PCB array, where a worker writes its running
+// process's PC in place on every step, with the dispatch path of the
+// column-wise process table. Both take a shared mutex around dispatch and
+// completion as simulator_routine does. The column variant mirrors the hot
+// arrays of ProcessChunkT: it moves flags ready -> running with a CAS and
+// copies PC under the mutex, steps a private copy, and writes PC and flags
+// back under the mutex. Workers run neighbouring slots, so their PCBs share
+// lines in both layouts; only the writes during the slice differ.
+//
+// This measures the cost of the private-copy dispatch path, not coherence
+// traffic: the column layout does not isolate running processes' lines (see
+// ProcessChunkT). On a single-CPU host it ran at 0.67x of the packed layout;
+// the comparison still needs a run with 8 or more workers on a multi-core host.
+
+#ifndef BENCH_WORKERS
+#define BENCH_WORKERS 8
+#endif
+
+#ifndef BENCH_SLICES
+#define BENCH_SLICES 200000
+#endif
+
+#ifndef BENCH_STEPS_PER_SLICE
+#define BENCH_STEPS_PER_SLICE 64
+#endif
+
+#define BENCH_CHUNK_SIZE 1024
+
+enum { slot_ready = 1, slot_running = 2 };
+
+typedef struct {
+  unsigned int pid;
+  unsigned int state;
+  EvaluatorCodeT code;
+  unsigned int PC;
+} PackedPCB;
+
+// The hot columns of ProcessChunkT, laid out the same way
+typedef struct {
+  atomic_uchar flags[BENCH_CHUNK_SIZE];
+  unsigned int PC[BENCH_CHUNK_SIZE];
+  unsigned int next[BENCH_CHUNK_SIZE];
+} BenchChunkT;
+
+static PackedPCB* packed;
+static BenchChunkT* chunk;
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+
+void* packed_worker(void* arg) {
+  volatile PackedPCB* pcb = &packed[(size_t)arg];
+  for(unsigned int slice = 0; slice != BENCH_SLICES; ++slice) {
+    pthread_mutex_lock(&mutex);
+    pcb->state = slot_running;
+    pthread_mutex_unlock(&mutex);
+    for(unsigned int step = 0; step != BENCH_STEPS_PER_SLICE; ++step) {
+      pcb->PC = pcb->PC + 1;
+    }
+    pthread_mutex_lock(&mutex);
+    pcb->state = slot_ready;
+    pthread_mutex_unlock(&mutex);
+  }
+  return NULL;
+}
+
+void* column_worker(void* arg) {
+  size_t const slot = (size_t)arg;
+  for(unsigned int slice = 0; slice != BENCH_SLICES; ++slice) {
+    pthread_mutex_lock(&mutex);
+    unsigned char expected = slot_ready;
+    if(!atomic_compare_exchange_strong(&chunk->flags[slot], &expected, slot_running)) abort();
+    volatile unsigned int PC = chunk->PC[slot];
+    pthread_mutex_unlock(&mutex);
+
+    for(unsigned int step = 0; step != BENCH_STEPS_PER_SLICE; ++step) {
+      PC = PC + 1;
+    }
+
+    pthread_mutex_lock(&mutex);
+    chunk->PC[slot] = PC;
+    atomic_store(&chunk->flags[slot], slot_ready);
+    pthread_mutex_unlock(&mutex);
+  }
+  return NULL;
+}
+
+double run(void* (*routine)(void*), int workers) {
+  pthread_t threads[workers];
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for(long i = 0; i != workers; ++i) {
+    pthread_create(&threads[i], NULL, routine, (void*)i);
+  }
+  for(int i = 0; i != workers; ++i) {
+    pthread_join(threads[i], NULL);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  double const ns = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+  return ns / ((double)workers * BENCH_SLICES);
+}
+
+int main(int argc, char** argv) {
+  int const workers = argc > 1 ? atoi(argv[1]) : BENCH_WORKERS;
+  if(workers < 1 || workers > BENCH_CHUNK_SIZE) {
+    fprintf(stderr, "Error: workers must be between 1 and %d\n", BENCH_CHUNK_SIZE);
+    exit(EXIT_FAILURE);
+  }
+  packed = checked_malloc(sizeof(PackedPCB) * workers);
+  if(posix_memalign((void**)&chunk, CACHE_LINE_SIZE, sizeof(BenchChunkT))) abort();
+  for(int i = 0; i != workers; ++i) {
+    packed[i].PC = chunk->PC[i] = 0;
+    packed[i].state = slot_ready;
+    atomic_init(&chunk->flags[i], slot_ready);
+  }
+
+  double const packed_ns = run(packed_worker, workers);
+  double const column_ns = run(column_worker, workers);
+  printf("workers %d, %d steps per slice\n", workers, BENCH_STEPS_PER_SLICE);
+  printf("packed, PC written in place : %8.2f ns/slice\n", packed_ns);
+  printf("columns, private PC copy    : %8.2f ns/slice\n", column_ns);
+  printf("speedup                     : %8.2fx\n", packed_ns / column_ns);
+
+  free(chunk);
+  checked_free(packed);
+  return 0;
+}
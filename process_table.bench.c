@@ -0,0 +1,56 @@
+#include "simulator.h"
+#include "logger.h"
+#include "utilities.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// Reports process table memory per live process. No worker threads are
+// started, so every process stays queued in task_queue while it is measured.
+
+#define BATCH 65536
+
+void measure(unsigned int processes) {
+  SimulatorT* simulator = simulator_start(0, 0, NULL);
+  size_t const empty = simulator_table_bytes(simulator);
+
+  EvaluatorCodeT* codes = checked_malloc(sizeof(EvaluatorCodeT) * BATCH);
+  ProcessIdT* pids = checked_malloc(sizeof(ProcessIdT) * BATCH);
+  for(unsigned int i = 0; i != BATCH; ++i) {
+    // A handful of distinct programs, as a real workload would have
+    codes[i] = evaluator_terminates_after(1 + i % 16);
+  }
+
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for(unsigned int created = 0; created < processes; created += BATCH) {
+    unsigned int const n = processes - created < BATCH ? processes - created : BATCH;
+    if(simulator_create_processes(simulator, codes, n, pids) != n) {
+      fprintf(stderr, "Error: could not create %u processes\n", processes);
+      exit(EXIT_FAILURE);
+    }
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  size_t const full = simulator_table_bytes(simulator);
+  double const seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+  printf("%9u processes: %8.1f MiB, %5.2f bytes/process, created in %.2fs\n",
+         processes, full / (1024.0 * 1024.0), (double)(full - empty) / processes, seconds);
+
+  checked_free(pids);
+  checked_free(codes);
+  simulator_stop(simulator);
+}
+
+int main(int argc, char** argv) {
+  logger_start();
+  if(argc > 1) {
+    measure(atoi(argv[1]));
+  } else {
+    measure(1000000);
+    measure(10000000);
+  }
+  logger_stop();
+  return 0;
+}
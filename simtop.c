@@ -0,0 +1,58 @@
+#include "stats.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// Live view of a running simulator's stats file: totals, per-second rates
+// over the last interval and the current gauges.
+//
+// usage: simtop <stats file> [interval ms] [updates, 0 for no limit]
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s <stats file> [interval ms] [updates]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  unsigned int const interval_ms = argc > 2 ? (unsigned int)atoi(argv[2]) : 1000;
+  unsigned int const updates = argc > 3 ? (unsigned int)atoi(argv[3]) : 0;
+
+  int const fd = open(argv[1], O_RDONLY);
+  if (fd < 0) {
+    fprintf(stderr, "Error: Unable to open %s\n", argv[1]);
+    return EXIT_FAILURE;
+  }
+  StatsFileT const* file = mmap(NULL, sizeof(StatsFileT), PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (file == MAP_FAILED || file->magic != STATS_FILE_MAGIC || file->version != STATS_FILE_VERSION) {
+    fprintf(stderr, "Error: %s is not a version %d stats file\n", argv[1], STATS_FILE_VERSION);
+    return EXIT_FAILURE;
+  }
+
+  StatsFileT previous;
+  stats_read(file, &previous);
+  for (unsigned int update = 0; updates == 0 || update != updates; ++update) {
+    usleep(interval_ms * 1000);
+
+    StatsFileT current;
+    stats_read(file, &current);
+    double const seconds = (current.timestamp_ns - previous.timestamp_ns) / 1e9;
+
+    printf("\n%-14s %14s %12s\n", "counter", "total", "per second");
+    for (int i = 0; i != stats_counter_count; ++i) {
+      unsigned long long const delta = current.counters[i] - previous.counters[i];
+      printf("%-14s %14llu %12.1f\n", stats_counter_names[i], current.counters[i],
+             seconds > 0 ? delta / seconds : 0.0);
+    }
+    for (int i = 0; i != stats_gauge_count; ++i) {
+      printf("%-14s %14llu\n", stats_gauge_names[i], current.gauges[i]);
+    }
+    printf("%-14s %14u\n", "threads", current.threads);
+    fflush(stdout);
+    previous = current;
+  }
+  return EXIT_SUCCESS;
+}
@@ -1,234 +1,3571 @@
 #include "simulator.h"
-#include "list.h"
 #include "logger.h"
 #include "evaluator.h"
+#include "utilities.h"
+#include "affinity.h"
+#include "stats.h"
+#include "lock_profile.h"
+#include "trace.h"
+#include "stride.h"
+#include "heap.h"
+#include "fiber.h"
+#include "mailbox.h"
 #include <pthread.h>
 #include <unistd.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <stdbool.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <time.h>
+#include <stdint.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
-ListT* blocked_queue = NULL;
+// A parked worker above the pool minimum exits after this long without work
+#ifndef SIMULATOR_IDLE_TIMEOUT_MS
+#define SIMULATOR_IDLE_TIMEOUT_MS 100
+#endif
 
-// Data structures for thread and process management
-pthread_t* worker_threads = NULL;  
-int total_threads = 0;            
+// Another worker is added once more than this many processes are ready per
+// worker, none of the current workers is parked and the pool was at least
+// SIMULATOR_GROW_UTILIZATION percent busy over the last window
+#ifndef SIMULATOR_GROW_DEPTH
+#define SIMULATOR_GROW_DEPTH 4
+#endif
 
-ProcessControlBlock* processes = NULL;  
-ListT* task_queue = NULL;              
+#ifndef SIMULATOR_GROW_UTILIZATION
+#define SIMULATOR_GROW_UTILIZATION 75
+#endif
 
-pthread_mutex_t process_mutex;         
-pthread_cond_t process_condition;      
+// A worker above the pool minimum that runs out of work retires at once,
+// without waiting out the idle timeout, while the pool was less than this
+// percent busy over the last window
+#ifndef SIMULATOR_SHRINK_UTILIZATION
+#define SIMULATOR_SHRINK_UTILIZATION 25
+#endif
 
-unsigned int max_tasks;                
-bool simulator_active = true;          
+// Length of the window pool utilization is measured over
+#ifndef SIMULATOR_UTILIZATION_WINDOW_MS
+#define SIMULATOR_UTILIZATION_WINDOW_MS 50
+#endif
+
+// Units of CPU time between load balancer runs over the simulated cores
+#ifndef SIMULATOR_BALANCE_INTERVAL
+#define SIMULATOR_BALANCE_INTERVAL 1000
+#endif
+
+// Stack reserved per fiber in fiber mode, committed only as it is touched
+#ifndef SIMULATOR_FIBER_STACK_SIZE
+#define SIMULATOR_FIBER_STACK_SIZE (64 * 1024)
+#endif
+
+// Messages a process's mailbox holds when the config leaves it 0
+#ifndef SIMULATOR_MAILBOX_CAPACITY
+#define SIMULATOR_MAILBOX_CAPACITY 64
+#endif
+
+#ifndef PROCESS_CHUNK_SIZE
+#define PROCESS_CHUNK_SIZE 1024
+#endif
+
+// Distinct codes are interned once and referenced by an 8-bit index
+#define MAX_PROGRAMS 256
+// Likewise distinct (share group, tickets) pairs
+#define MAX_SHARE_CLASSES 256
+
+// Layout of the per-process flags byte
+#define PCB_STATE_MASK     0x07  // ProcessStateT
+#define PCB_KILL_REQUESTED 0x08  // Killed while running, honored after the slice
+#define PCB_QUEUED         0x10  // Held by the ready set or blocked_queue
+#define PCB_REAPED         0x20  // Waited on while still queued, released when unlinked
+#define PCB_QUANTUM_SHIFT  6     // Top two bits: quantum is TIME_SLICE_LENGTH << level
+#define PCB_QUANTUM_MASK   0xC0
+#define MAX_QUANTUM_LEVEL  3
+
+#define CORE_NONE 0xFF  // Last core of a process that has not run yet
+
+// Data structures for thread and process management. The pool has one slot
+// per potential worker and keeps between min_threads and max_threads alive.
+typedef enum WorkerSlotState {
+    slot_empty,
+    slot_active,
+    slot_exited   // Thread has returned but has not been joined yet
+} WorkerSlotStateT;
+
+
+// What a process blocked in a mailbox exchange is waiting for
+typedef enum ExchangeWait {
+    exchange_none,
+    exchange_send,     // Room in its peer's mailbox, or a peer
+    exchange_receive   // A message in its own mailbox
+} ExchangeWaitT;
+
+// A process's ends of simulated message passing, see simulator_connect.
+// outbox, inbox and received are read by the process's worker without
+// process_mutex; everything is only written under it, received only while
+// the process is not in a slice.
+typedef struct ProcessLink {
+    MailboxT* _Atomic outbox;  // The peer's mailbox, NULL while there is none
+    MailboxT* _Atomic inbox;   // Allocated when first connected to or received on
+    ProcessIdT peer;           // Receiver of this process's sends, 0 for none
+    ProcessIdT sender;         // The one process sending to inbox, 0 for none
+    unsigned int pending;      // Message of a send blocked in exchange_send
+    unsigned int received;     // Last message taken from inbox, 0 before the first
+    unsigned char waiting;     // ExchangeWaitT
+    bool closed;               // The sender has gone, so an empty inbox no longer blocks
+    bool severed;              // The peer has gone, so sends are dropped
+    bool linked;               // Counted in linked_processes
+} ProcessLinkT;
+
+// The process table is a directory of fixed-size chunks. Chunks are never
+// moved once allocated, so a (chunk, slot) pair stays valid while a process
+// is live. Each chunk stores its PCBs as parallel arrays: the fields written
+// on every dispatch are kept apart from the program index, which is written
+// once at creation. Every array starts on its own cache line.
+// flags is atomic: kill and wait move processes between states with CAS
+// without taking process_mutex. Every other field is accessed under
+// process_mutex; workers evaluate from a private copy of the code and PC so
+// nothing shared is written during a slice.
+//
+// This layout does not keep concurrently running processes off each other's
+// lines. Slots are not padded apart, so a line of flags holds 64 processes
+// and a line of PC 16: dispatch and write-back under the lock, and a
+// lock-free kill's CAS on flags, still move lines that other workers'
+// processes sit on. Padding every slot to a line would cost 64 bytes per
+// process rather than 11, against the density the table is built for, and
+// no multi-core measurement has shown the sharing to matter next to
+// process_mutex itself. The split buys race-free access and density, not
+// line isolation.
+//
+// A process costs 11 bytes here, queue membership included: the run queues
+// are threaded through `next` rather than allocating a list node per entry.
+// Simulated cores add a byte for the last core it ran on.
+typedef struct ProcessChunk {
+    // Hot: state transitions, PC write-back and queue links on every dispatch
+    atomic_uchar flags[PROCESS_CHUNK_SIZE];   // State and PCB_* bits
+    unsigned int PC[PROCESS_CHUNK_SIZE];
+    ProcessIdT next[PROCESS_CHUNK_SIZE];      // Next PID in the same queue, 0 at the tail
+    // Cold: written at creation
+    unsigned char program[PROCESS_CHUNK_SIZE];  // Index into programs
+    unsigned char share[PROCESS_CHUNK_SIZE];    // Index into share_classes
+    // Absolute deadline per slot, 0 for none. Allocated when the chunk first
+    // holds a deadline process, so tables without them pay one pointer per chunk.
+    unsigned long long* deadline;
+    // Last simulated core per slot, allocated with the chunk when cores are
+    // modelled, and affinity masks, allocated when first set; 0 allows any core
+    unsigned char* core;
+    unsigned long long* affinity;
+    // Message passing state per slot, allocated when a process of the chunk
+    // first connects or receives. Published atomically, since a worker reads
+    // its process's link without process_mutex.
+    ProcessLinkT* _Atomic links;
+    ProcessIdT base_pid;  // PID of slot 0
+    unsigned int live;    // PCBs in this chunk that are not unallocated
+    struct ProcessChunk* retired;  // Next in the simulator's retired list
+} ProcessChunkT;
+
+typedef ProcessChunkT* _Atomic ChunkPointerT;
+
+// A chunk directory replaced by a larger one, kept until no lock-free reader can hold it
+typedef struct RetiredDirectory {
+    ChunkPointerT* directory;
+    struct RetiredDirectory* next;
+} RetiredDirectoryT;
+
+// A released process's mailbox, kept until no worker sending into it without the lock can hold it
+typedef struct RetiredMailbox {
+    MailboxT* mailbox;
+    struct RetiredMailbox* next;
+} RetiredMailboxT;
+
+// A share group and the tickets one process holds within it
+typedef struct ShareClass {
+    unsigned int group;
+    unsigned int tickets;
+    unsigned long long stride;
+} ShareClassT;
+
+// FIFO of PIDs linked through ProcessChunkT.next
+typedef struct ProcessQueue {
+    ProcessIdT head;  // 0 when empty
+    ProcessIdT tail;
+    atomic_ulong length;  // Written under process_mutex, may be peeked without it
+} ProcessQueueT;
+
+// A simulated core: its ready queue, and what it ran since the last reconfigure
+typedef struct SimulatedCore {
+    ProcessQueueT queue;
+    bool running;          // Claimed by a worker for a dispatch
+    unsigned long long dispatches;
+    unsigned long long cpu_time;
+    unsigned long long migrations;
+} SimulatedCoreT;
+
+// A creator waiting for a PCB. Each sleeps on its own condition, so a
+// release wakes only the creator at the head of the queue.
+typedef struct AdmissionWaiter {
+    pthread_cond_t condition;
+    struct AdmissionWaiter* next;
+} AdmissionWaiterT;
+
+// Everything one simulator instance owns. Several can run side by side in a
+// process; nothing here is shared between them.
+struct Simulator {
+    // The process table. The directory is only changed under process_mutex
+    // but is read without it by kill and wait.
+    ChunkPointerT* _Atomic process_chunks;  // NULL entries are released chunks
+    atomic_uint chunk_slots;                // Length of the chunk directory
+    unsigned int allocated_chunks;
+    unsigned long free_pcbs;         // Unallocated PCBs in allocated chunks
+
+    // Admission control, see SimulatorConfigT.max_live_processes
+    unsigned long max_live;          // 0 for no limit
+    unsigned long high_watermark;    // Live processes that set throttled
+    unsigned long low_watermark;     // Live processes that clear it
+    unsigned long peak_live;
+    unsigned long long admission_timeouts;
+    atomic_bool throttled;
+    AdmissionWaiterT* admission_head;  // Creators waiting for a PCB, oldest first
+    AdmissionWaiterT* admission_tail;
+    atomic_uint admission_waiting;     // Length of that queue, peeked by wait
+
+    EvaluatorCodeT programs[MAX_PROGRAMS];
+    unsigned int program_refs[MAX_PROGRAMS];  // Live PCBs running each program, 0 once it may be reused
+    unsigned int program_count;
+    bool program_table_full;                  // Already logged, until an entry is freed
+
+    // Ready processes wait in task_queue, or with stride scheduling in the
+    // stride heaps, which then carry each process's pass
+    ProcessQueueT task_queue;
+    ProcessQueueT blocked_queue;
+    bool stride_scheduling;   // Fixed at simulator_start
+    StrideSchedulerT stride;
+    ShareClassT share_classes[MAX_SHARE_CLASSES];
+    unsigned int share_class_count;
+
+    // Simulated cores, see SimulatorConfigT.simulated_cores. FIFO ready
+    // processes wait in the core queues instead of task_queue.
+    SimulatedCoreT* cores;
+    unsigned int core_count;             // Fixed at simulator_start, 0 when not modelled
+    unsigned long long all_cores;        // Mask with a bit per core
+    unsigned int core_cursor;            // Where the next search for a free core starts
+    SimulatorCorePlacementT core_placement;
+    unsigned int migration_penalty;
+    unsigned long long balance_interval;
+    unsigned long long next_balance;     // virtual_time of the next balancer run
+    unsigned long long migrations;
+    unsigned long long balancer_moves;
+
+    // Ready deadline processes keyed by absolute deadline. They run before
+    // the rest of the ready set, earliest deadline first.
+    HeapT deadline_queue;
+    bool deadline_real_time;     // Deadlines in microseconds rather than virtual_time
+    bool drop_late_deadlines;    // Drop deadline processes that can only finish late
+    unsigned long long virtual_time;   // CPU time simulated since start, never reset
+    unsigned long long deadlines_met;
+    unsigned long long deadlines_missed;
+    unsigned long long deadlines_dropped;
+    unsigned long long lateness_histogram[SIMULATOR_LATENESS_BUCKETS];
+
+    pthread_mutex_t process_mutex;
+    pthread_cond_t work_condition;   // Signalled when the ready set gains work
+
+    // Kill and wait count themselves in lockfree_readers while they use the
+    // chunk directory. Chunks and directories unlinked while any of them may
+    // be looking are retired, and freed once the count drops to zero.
+    atomic_uint lockfree_readers;
+    ProcessChunkT* retired_chunks;
+    RetiredDirectoryT* retired_directories;
+    RetiredMailboxT* retired_mailboxes;
+
+    // Message passing, see simulator_connect
+    unsigned int mailbox_capacity;
+    unsigned long linked_processes;   // Processes with link state, checkpoint refuses while any are
+    unsigned long long messages_sent;
+    unsigned long long messages_received;
+    unsigned long long messages_dropped;
+    unsigned long long send_blocks;
+    unsigned long long receive_blocks;
+
+    // Terminated PCBs reaped while no queue held them, linked through next and
+    // released by the next holder of process_mutex
+    _Atomic ProcessIdT pending_releases;
+
+    // simulator_wait sleeps here, so waiting never contends for process_mutex.
+    // Threads that terminate a process only take wait_mutex while waiters > 0.
+    pthread_mutex_t wait_mutex;
+    pthread_cond_t wait_condition;
+    atomic_uint waiters;
+
+    atomic_bool active;
+
+    // The worker pool
+    pthread_t* worker_threads;
+    unsigned char* worker_slots;     // WorkerSlotStateT per slot
+    int total_threads;               // Number of slots, i.e. max_threads
+    unsigned int min_threads;
+    unsigned int max_threads;
+    unsigned int active_workers;
+    unsigned int parked_workers;     // Active workers waiting for work
+    // Time workers spent running slices over the current window, and the
+    // share of the pool's time that was over the last complete one
+    unsigned long long window_start;
+    unsigned long long window_busy_ns;
+    unsigned int utilization;        // Percent
+
+    // Consecutive slices a worker may run of one process while nothing else is ready
+    unsigned int coalesce_slices;
+    // Bumped whenever a running process is asked to die, so coalescing workers
+    // notice kills without taking process_mutex
+    atomic_uint kill_epoch;
+
+    // Ready processes a worker takes per dispatch and evaluates as one batch
+    unsigned int dispatch_batch;
+
+    // Fibers each worker runs, 0 for plain workers. Fixed at simulator_start.
+    unsigned int fibers_per_worker;
+
+    // Whether quanta adapt to each process's CPU usage
+    bool adaptive_quantum;
+
+    // Per-slice accounting, added by workers after each dispatch
+    unsigned long long total_slices;
+    unsigned long long total_dispatches;
+    unsigned long long total_cpu_time;
+
+    // Workers are pinned one per CPU of this set when it is not empty
+    cpu_set_t worker_cpus;
+
+    bool tracing;   // This instance owns the process-wide trace recording
+};
+
+// A worker's start argument
+typedef struct WorkerArgument {
+    SimulatorT* simulator;
+    int thread_id;
+} WorkerArgumentT;
+
+static char const* const reason_names[] = { "terminated", "timeslice", "blocked", "send", "receive" };
 
 void* simulator_routine(void* arg);
+static void* fiber_worker_routine(void* arg);
+static void unlink_process_locked(SimulatorT* simulator, ProcessChunkT* chunk, unsigned int slot);
+
+static ProcessStateT pcb_state(ProcessChunkT* chunk, unsigned int slot) {
+    return (ProcessStateT)(atomic_load_explicit(&chunk->flags[slot], memory_order_acquire) & PCB_STATE_MASK);
+}
+
+// Move a PCB from state `from` to `to`, also setting the `add` bits. Fails if
+// another thread - a lock-free kill - changed the state first.
+static bool transition_pcb(ProcessChunkT* chunk, unsigned int slot, ProcessStateT from, ProcessStateT to,
+                           unsigned char add) {
+    unsigned char flags = atomic_load_explicit(&chunk->flags[slot], memory_order_relaxed);
+    do {
+        if ((flags & PCB_STATE_MASK) != from) {
+            return false;
+        }
+    } while (!atomic_compare_exchange_weak_explicit(&chunk->flags[slot], &flags,
+                                                    (flags & ~PCB_STATE_MASK) | to | add,
+                                                    memory_order_acq_rel, memory_order_relaxed));
+    return true;
+}
+
+// Bracket lock-free use of the chunk directory
+static void enter_lockfree(SimulatorT* simulator) {
+    atomic_fetch_add(&simulator->lockfree_readers, 1);
+}
+
+static void exit_lockfree(SimulatorT* simulator) {
+    atomic_fetch_sub(&simulator->lockfree_readers, 1);
+}
+
+// Wake simulator_wait callers after a process terminated. The termination is
+// only an acq_rel CAS of flags, while a waiter increments waiters and then
+// reads flags: a store-buffering pattern. The fence orders the flags update
+// before the waiters load, so against the waiter's seq_cst increment and
+// reload either the waiter count is seen here or the waiter sees the
+// termination before it sleeps.
+static void notify_waiters(SimulatorT* simulator) {
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load(&simulator->waiters) > 0) {
+        PROFILED_LOCK(&simulator->wait_mutex);
+        pthread_cond_broadcast(&simulator->wait_condition);
+        PROFILED_UNLOCK(&simulator->wait_mutex);
+    }
+}
+
+static void free_chunk(SimulatorT* simulator, ProcessChunkT* chunk) {
+    // Only chunks freed at stop can still hold live mailboxes
+    ProcessLinkT* const links = chunk->links;
+    if (links) {
+        for (unsigned int i = 0; i < PROCESS_CHUNK_SIZE; i++) {
+            if (links[i].inbox) {
+                mailbox_destroy(links[i].inbox);
+            }
+        }
+        free(links);
+    }
+    free(chunk->deadline);
+    free(chunk->core);
+    free(chunk->affinity);
+    free(chunk);
+}
+
+// Allocate chunk `index` of the process table - caller holds process_mutex
+static ProcessChunkT* allocate_chunk_locked(SimulatorT* simulator, unsigned int index) {
+    if (index >= simulator->chunk_slots) {
+        unsigned int slots = simulator->chunk_slots ? simulator->chunk_slots * 2 : 4;
+        while (slots <= index) {
+            slots *= 2;
+        }
+        // Lock-free readers may still be indexing the old directory, so it
+        // is copied and retired rather than reallocated
+        ChunkPointerT* directory = (ChunkPointerT*)malloc(sizeof(ChunkPointerT) * slots);
+        RetiredDirectoryT* retired = (RetiredDirectoryT*)malloc(sizeof(RetiredDirectoryT));
+        if (!directory || !retired) {
+            free(directory);
+            free(retired);
+            return NULL;
+        }
+        ChunkPointerT* const old = simulator->process_chunks;
+        for (unsigned int i = 0; i < slots; i++) {
+            atomic_init(&directory[i], i < simulator->chunk_slots ? old[i] : NULL);
+        }
+        // Published before the new length, so a reader never indexes past the directory it loads
+        simulator->process_chunks = directory;
+        simulator->chunk_slots = slots;
+        if (old) {
+            retired->directory = old;
+            retired->next = simulator->retired_directories;
+            simulator->retired_directories = retired;
+        } else {
+            free(retired);
+        }
+    }
+
+    void* memory = NULL;
+    if (posix_memalign(&memory, CACHE_LINE_SIZE, sizeof(ProcessChunkT)) != 0) {
+        return NULL;
+    }
+    ProcessChunkT* chunk = (ProcessChunkT*)memory;
+    for (unsigned int i = 0; i < PROCESS_CHUNK_SIZE; i++) {
+        atomic_init(&chunk->flags[i], unallocated);
+    }
+    chunk->base_pid = index * PROCESS_CHUNK_SIZE + 1;
+    chunk->live = 0;
+    chunk->retired = NULL;
+    chunk->deadline = NULL;
+    chunk->affinity = NULL;
+    chunk->core = NULL;
+    atomic_init(&chunk->links, NULL);
+    if (simulator->core_count) {
+        chunk->core = (unsigned char*)malloc(PROCESS_CHUNK_SIZE);
+        if (!chunk->core) {
+            free_chunk(simulator, chunk);
+            return NULL;
+        }
+        memset(chunk->core, CORE_NONE, PROCESS_CHUNK_SIZE);
+    }
+
+    simulator->process_chunks[index] = chunk;
+    simulator->allocated_chunks++;
+    simulator->free_pcbs += PROCESS_CHUNK_SIZE;
+    return chunk;
+}
+
+// Free retired chunks and directories once no lock-free reader can reach
+// them - caller holds process_mutex
+static void reclaim_retired_locked(SimulatorT* simulator) {
+    if (atomic_load(&simulator->lockfree_readers) != 0) {
+        return;
+    }
+    while (simulator->retired_chunks) {
+        ProcessChunkT* chunk = simulator->retired_chunks;
+        simulator->retired_chunks = chunk->retired;
+        free_chunk(simulator, chunk);
+    }
+    while (simulator->retired_directories) {
+        RetiredDirectoryT* retired = simulator->retired_directories;
+        simulator->retired_directories = retired->next;
+        free(retired->directory);
+        free(retired);
+    }
+    while (simulator->retired_mailboxes) {
+        RetiredMailboxT* retired = simulator->retired_mailboxes;
+        simulator->retired_mailboxes = retired->next;
+        mailbox_destroy(retired->mailbox);
+        free(retired);
+    }
+}
+
+// Find the chunk and slot holding pid, or NULL if it is outside the table -
+// caller holds process_mutex or is between enter_lockfree and exit_lockfree
+static ProcessChunkT* lookup_process(SimulatorT* simulator, ProcessIdT pid, unsigned int* slot) {
+    if (pid == 0) {
+        return NULL;
+    }
+    unsigned int index = (pid - 1) / PROCESS_CHUNK_SIZE;
+    if (index >= atomic_load(&simulator->chunk_slots)) {
+        return NULL;
+    }
+    ProcessChunkT* chunk = atomic_load(&simulator->process_chunks)[index];
+    if (!chunk) {
+        return NULL;
+    }
+    *slot = (pid - 1) % PROCESS_CHUNK_SIZE;
+    return chunk;
+}
+
+// A process's absolute deadline, 0 if it has none
+static unsigned long long process_deadline(ProcessChunkT const* chunk, unsigned int slot) {
+    return chunk->deadline ? chunk->deadline[slot] : 0;
+}
+
+// Reserve room for a new process in the heap that will hold it while it is
+// ready, so requeueing never allocates - caller holds process_mutex
+static bool reserve_ready_locked(SimulatorT* simulator, unsigned char share, unsigned long long deadline) {
+    if (deadline) {
+        return heap_add_member(&simulator->deadline_queue);
+    }
+    if (simulator->stride_scheduling) {
+        return stride_add_member(&simulator->stride, simulator->share_classes[share].group);
+    }
+    return true;
+}
+
+static void unreserve_ready_locked(SimulatorT* simulator, unsigned char share, unsigned long long deadline) {
+    if (deadline) {
+        heap_remove_member(&simulator->deadline_queue);
+    } else if (simulator->stride_scheduling) {
+        stride_remove_member(&simulator->stride, simulator->share_classes[share].group);
+    }
+}
+
+static unsigned long live_processes_locked(SimulatorT const* simulator) {
+    return (unsigned long)simulator->allocated_chunks * PROCESS_CHUNK_SIZE - simulator->free_pcbs;
+}
+
+// Track the peak and move throttled across the watermarks after a PCB is
+// claimed or released - caller holds process_mutex
+static void update_occupancy_locked(SimulatorT* simulator) {
+    unsigned long const live = live_processes_locked(simulator);
+    if (live > simulator->peak_live) {
+        simulator->peak_live = live;
+    }
+    if (!simulator->max_live) {
+        return;
+    }
+    bool const throttled = atomic_load_explicit(&simulator->throttled, memory_order_relaxed);
+    if (!throttled && live >= simulator->high_watermark) {
+        atomic_store_explicit(&simulator->throttled, true, memory_order_relaxed);
+    } else if (throttled && live <= simulator->low_watermark) {
+        atomic_store_explicit(&simulator->throttled, false, memory_order_relaxed);
+    }
+}
+
+// Whether the creator self, or with NULL one that is not queued, may claim a
+// PCB now: none older is waiting and the limit leaves room - caller holds process_mutex
+static bool admission_open_locked(SimulatorT const* simulator, AdmissionWaiterT const* self) {
+    return simulator->admission_head == self &&
+           (!simulator->max_live || live_processes_locked(simulator) < simulator->max_live);
+}
+
+// Return a terminated PCB to the table, releasing its chunk once it is empty
+// and enough spare capacity remains elsewhere - caller holds process_mutex
+static void release_process_locked(SimulatorT* simulator, ProcessChunkT* chunk, unsigned int slot) {
+    unsigned int index = (chunk->base_pid - 1) / PROCESS_CHUNK_SIZE;
+
+    unreserve_ready_locked(simulator, chunk->share[slot], process_deadline(chunk, slot));
+    if (chunk->deadline) {
+        chunk->deadline[slot] = 0;
+    }
+    unlink_process_locked(simulator, chunk, slot);
+    if (--simulator->program_refs[chunk->program[slot]] == 0) {
+        simulator->program_table_full = false;
+    }
+    atomic_store_explicit(&chunk->flags[slot], unallocated, memory_order_release);
+    chunk->live--;
+    simulator->free_pcbs++;
+    update_occupancy_locked(simulator);
+    if (simulator->admission_head) {
+        pthread_cond_signal(&simulator->admission_head->condition);
+    }
+
+    // Chunk 0 is kept so an idle simulator does not thrash the allocator
+    if (chunk->live == 0 && index != 0 && simulator->free_pcbs >= 2 * PROCESS_CHUNK_SIZE) {
+        // Unlinked before the reader count is checked, so any reader that
+        // missed the unlink is counted and the chunk waits on the retired list
+        simulator->process_chunks[index] = NULL;
+        chunk->retired = simulator->retired_chunks;
+        simulator->retired_chunks = chunk;
+        simulator->allocated_chunks--;
+        simulator->free_pcbs -= PROCESS_CHUNK_SIZE;
+        reclaim_retired_locked(simulator);
+    }
+}
+
+// Hand a reaped PCB that no queue holds to the next holder of process_mutex -
+// caller is between enter_lockfree and exit_lockfree
+static void defer_release(SimulatorT* simulator, ProcessChunkT* chunk, unsigned int slot) {
+    ProcessIdT head = atomic_load_explicit(&simulator->pending_releases, memory_order_relaxed);
+    do {
+        chunk->next[slot] = head;
+    } while (!atomic_compare_exchange_weak_explicit(&simulator->pending_releases, &head, chunk->base_pid + slot,
+                                                    memory_order_release, memory_order_relaxed));
+}
+
+// Release every PCB handed over by defer_release - caller holds process_mutex
+static void drain_releases_locked(SimulatorT* simulator) {
+    if (!atomic_load_explicit(&simulator->pending_releases, memory_order_relaxed)) {
+        return;
+    }
+    ProcessIdT pid = atomic_exchange_explicit(&simulator->pending_releases, 0, memory_order_acquire);
+    while (pid) {
+        unsigned int slot;
+        ProcessChunkT* chunk = lookup_process(simulator, pid, &slot);
+        pid = chunk->next[slot];
+        release_process_locked(simulator, chunk, slot);
+    }
+}
+
+// Index of code in the program table, or -1 if every entry is held by a
+// live process. Entries no process holds are reused - caller holds process_mutex
+static int intern_program_locked(SimulatorT* simulator, EvaluatorCodeT const code) {
+    int unused = -1;
+    for (unsigned int i = 0; i < simulator->program_count; i++) {
+        if (simulator->programs[i].implementation == code.implementation && simulator->programs[i].parameter == code.parameter) {
+            return i;
+        }
+        if (unused < 0 && !simulator->program_refs[i]) {
+            unused = i;
+        }
+    }
+    if (unused < 0 && simulator->program_count < MAX_PROGRAMS) {
+        unused = simulator->program_count++;
+    }
+    if (unused < 0) {
+        if (!simulator->program_table_full) {
+            simulator->program_table_full = true;
+            char log_buffer[96];
+            sprintf(log_buffer, "Program table full, %d distinct codes are live.", MAX_PROGRAMS);
+            logger_write(log_buffer);
+        }
+        return -1;
+    }
+    simulator->programs[unused] = code;
+    return unused;
+}
+
+// Index of the share class for tickets in group, or -1 if the table is full - caller holds process_mutex
+static int intern_share_locked(SimulatorT* simulator, unsigned int group, unsigned int tickets) {
+    for (unsigned int i = 0; i < simulator->share_class_count; i++) {
+        if (simulator->share_classes[i].group == group && simulator->share_classes[i].tickets == tickets) {
+            return i;
+        }
+    }
+    if (simulator->share_class_count == MAX_SHARE_CLASSES) {
+        return -1;
+    }
+    simulator->share_classes[simulator->share_class_count] = (ShareClassT){ group, tickets, stride_of(tickets) };
+    return simulator->share_class_count++;
+}
+
+// Append a process to the back of a queue - caller holds process_mutex
+static void queue_push_locked(SimulatorT* simulator, ProcessQueueT* queue, ProcessChunkT* chunk, unsigned int slot) {
+    ProcessIdT const pid = chunk->base_pid + slot;
+    chunk->next[slot] = 0;
+    atomic_fetch_or_explicit(&chunk->flags[slot], PCB_QUEUED, memory_order_relaxed);
+
+    if (queue->tail) {
+        unsigned int tail_slot;
+        ProcessChunkT* tail_chunk = lookup_process(simulator, queue->tail, &tail_slot);
+        tail_chunk->next[tail_slot] = pid;
+    } else {
+        queue->head = pid;
+    }
+    queue->tail = pid;
+    queue->length++;
+}
+
+// Drop a queue's hold on a PCB it no longer links, finishing the release of
+// one killed while queued. Returns true if the process is still live -
+// caller holds process_mutex
+static bool unqueue_locked(SimulatorT* simulator, ProcessChunkT* chunk, unsigned int slot) {
+    // Clearing PCB_QUEUED and setting PCB_REAPED are both read-modify-writes
+    // of flags, so exactly one of this and reap_if_terminated releases the PCB
+    unsigned char const flags = atomic_fetch_and_explicit(&chunk->flags[slot], ~PCB_QUEUED, memory_order_acq_rel);
+    if (flags & PCB_REAPED) {
+        release_process_locked(simulator, chunk, slot);
+        return false;
+    }
+    return (flags & PCB_STATE_MASK) != terminated;
+}
+
+// Unlink the front of a queue, skipping entries that were killed while
+// queued. Returns the first live PID, or 0 if none is left - caller holds process_mutex
+static ProcessIdT queue_pop_locked(SimulatorT* simulator, ProcessQueueT* queue) {
+    while (queue->head) {
+        ProcessIdT const pid = queue->head;
+        unsigned int slot;
+        ProcessChunkT* chunk = lookup_process(simulator, pid, &slot);
+
+        queue->head = chunk->next[slot];
+        if (!queue->head) {
+            queue->tail = 0;
+        }
+        queue->length--;
+
+        if (unqueue_locked(simulator, chunk, slot)) {
+            return pid;
+        }
+    }
+    return 0;
+}
+
+// Unlink every terminated entry of a queue in a single pass - caller holds process_mutex
+static void queue_purge_terminated_locked(SimulatorT* simulator, ProcessQueueT* queue) {
+    ProcessChunkT* prev_chunk = NULL;
+    unsigned int prev_slot = 0;
+    ProcessIdT pid = queue->head;
+
+    while (pid) {
+        unsigned int slot;
+        ProcessChunkT* chunk = lookup_process(simulator, pid, &slot);
+        ProcessIdT const next = chunk->next[slot];
+
+        if (pcb_state(chunk, slot) == terminated) {
+            if (prev_chunk) {
+                prev_chunk->next[prev_slot] = next;
+            } else {
+                queue->head = next;
+            }
+            if (queue->tail == pid) {
+                queue->tail = prev_chunk ? prev_chunk->base_pid + prev_slot : 0;
+            }
+            queue->length--;
+            unqueue_locked(simulator, chunk, slot);
+        } else {
+            prev_chunk = chunk;
+            prev_slot = slot;
+        }
+        pid = next;
+    }
+}
+
+// Pass a process starts from when it joins the ready set after creation or
+// a wake-up, so time spent blocked earns it no credit
+static unsigned long long join_pass_locked(SimulatorT* simulator, ProcessChunkT* chunk, unsigned int slot) {
+    ShareClassT const* share = &simulator->share_classes[chunk->share[slot]];
+    return stride_join_pass(&simulator->stride, share->group, share->stride);
+}
+
+// Mask of the simulated cores a process may run on
+static unsigned long long allowed_cores(SimulatorT const* simulator, ProcessChunkT const* chunk, unsigned int slot) {
+    unsigned long long const mask = chunk->affinity ? chunk->affinity[slot] & simulator->all_cores : 0;
+    return mask ? mask : simulator->all_cores;
+}
+
+// Processes queued on a core or running on it
+static unsigned long core_load(SimulatedCoreT const* core) {
+    return core->queue.length + core->running;
+}
+
+// The core a process is queued on when it becomes ready: with
+// core_placement_last the one it last ran on, otherwise the least loaded
+// core it may run on, its last one on a tie - caller holds process_mutex
+static unsigned int pick_core_locked(SimulatorT* simulator, ProcessChunkT const* chunk, unsigned int slot) {
+    unsigned long long const allowed = allowed_cores(simulator, chunk, slot);
+    unsigned int const last = chunk->core[slot];
+    bool const warm = last != CORE_NONE && (allowed >> last & 1);
+    if (warm && simulator->core_placement == core_placement_last) {
+        return last;
+    }
+    unsigned int best = warm ? last : (unsigned int)__builtin_ctzll(allowed);
+    for (unsigned long long rest = allowed; rest; rest &= rest - 1) {
+        unsigned int const core = __builtin_ctzll(rest);
+        if (core_load(&simulator->cores[core]) < core_load(&simulator->cores[best])) {
+            best = core;
+        }
+    }
+    return best;
+}
+
+// Make a process ready to be dispatched. pass orders it within its share
+// group under stride scheduling and is ignored otherwise - caller holds process_mutex
+static void ready_push_locked(SimulatorT* simulator, ProcessChunkT* chunk, unsigned int slot, unsigned long long pass) {
+    unsigned long long const deadline = process_deadline(chunk, slot);
+    if (!deadline && !simulator->stride_scheduling) {
+        ProcessQueueT* queue = simulator->core_count ? &simulator->cores[pick_core_locked(simulator, chunk, slot)].queue
+                                                     : &simulator->task_queue;
+        queue_push_locked(simulator, queue, chunk, slot);
+        return;
+    }
+    atomic_fetch_or_explicit(&chunk->flags[slot], PCB_QUEUED, memory_order_relaxed);
+    if (deadline) {
+        heap_push(&simulator->deadline_queue, deadline, chunk->base_pid + slot);
+    } else {
+        stride_push(&simulator->stride, simulator->share_classes[chunk->share[slot]].group, chunk->base_pid + slot, pass);
+    }
+}
+
+// Now on the clock deadlines are measured against - caller holds process_mutex
+static unsigned long long deadline_now_locked(SimulatorT* simulator) {
+    return simulator->deadline_real_time ? monotonic_ns() / 1000 : simulator->virtual_time;
+}
+
+// Take the front process of a core's queue that may run there. One whose
+// affinity has changed since it was queued moves to a core it may run on -
+// caller holds process_mutex
+static ProcessIdT core_pop_locked(SimulatorT* simulator, unsigned int core) {
+    ProcessIdT pid;
+    while ((pid = queue_pop_locked(simulator, &simulator->cores[core].queue))) {
+        unsigned int slot;
+        ProcessChunkT* chunk = lookup_process(simulator, pid, &slot);
+        if (allowed_cores(simulator, chunk, slot) >> core & 1) {
+            return pid;
+        }
+        // Requeued only if no kill got in since it was unlinked
+        if (transition_pcb(chunk, slot, ready, ready, PCB_QUEUED)) {
+            queue_push_locked(simulator, &simulator->cores[pick_core_locked(simulator, chunk, slot)].queue, chunk, slot);
+        }
+    }
+    return 0;
+}
+
+// True if a ready process would miss deadline even if it ran from now on
+// without interruption: the CPU time its code still needs is certain work,
+// so it cannot finish sooner - caller holds process_mutex
+static bool hopeless_locked(SimulatorT* simulator, ProcessChunkT* chunk, unsigned int slot, unsigned long long deadline) {
+    EvaluatorCodeT const code = simulator->programs[chunk->program[slot]];
+    unsigned long long remaining = evaluator_remaining_cpu_time(code, chunk->PC[slot]);
+    if (simulator->deadline_real_time) {
+        remaining *= SLEEP_PER_CPU_CYCLE;
+    }
+    unsigned long long const now = deadline_now_locked(simulator);
+    return now >= deadline || remaining > deadline - now;
+}
+
+// Take the next ready process: the earliest deadline, then the front of
+// task_queue - or with simulated cores of the queue of `core` - or the
+// lowest pass of the share group with the lowest pass - caller holds process_mutex
+static ProcessIdT ready_pop_locked(SimulatorT* simulator, unsigned long long* pass, unsigned int core) {
+    *pass = 0;
+    while (simulator->deadline_queue.length > 0) {
+        HeapEntryT const entry = heap_pop(&simulator->deadline_queue);
+        unsigned int slot;
+        ProcessChunkT* chunk = lookup_process(simulator, entry.id, &slot);
+        if (!unqueue_locked(simulator, chunk, slot)) {
+            continue;
+        }
+        // Under overload, a process that can no longer finish by its deadline
+        // is dropped rather than delaying the ones that can still make it
+        if (simulator->drop_late_deadlines && hopeless_locked(simulator, chunk, slot, entry.key)) {
+            if (transition_pcb(chunk, slot, ready, terminated, 0)) {
+                simulator->deadlines_dropped++;
+                unlink_process_locked(simulator, chunk, slot);
+                if (simulator->tracing) {
+                    trace_instant_event("drop", entry.id);
+                }
+                notify_waiters(simulator);
+            }
+            continue;
+        }
+        return entry.id;
+    }
+    if (!simulator->stride_scheduling) {
+        return simulator->core_count ? core_pop_locked(simulator, core) : queue_pop_locked(simulator, &simulator->task_queue);
+    }
+    ProcessIdT pid;
+    unsigned int group;
+    while (stride_pop(&simulator->stride, &pid, pass, &group)) {
+        unsigned int slot;
+        ProcessChunkT* chunk = lookup_process(simulator, pid, &slot);
+        if (unqueue_locked(simulator, chunk, slot)) {
+            return pid;
+        }
+    }
+    return 0;
+}
+
+// Ready processes, may be peeked without process_mutex
+static unsigned long ready_length(SimulatorT* simulator) {
+    unsigned long length = atomic_load_explicit(&simulator->deadline_queue.length, memory_order_relaxed) +
+                           atomic_load_explicit(simulator->stride_scheduling ? &simulator->stride.length
+                                                                             : &simulator->task_queue.length,
+                                                memory_order_relaxed);
+    if (!simulator->stride_scheduling) {
+        for (unsigned int i = 0; i < simulator->core_count; i++) {
+            length += atomic_load_explicit(&simulator->cores[i].queue.length, memory_order_relaxed);
+        }
+    }
+    return length;
+}
+
+static bool keep_live_entry(void* context, unsigned int pid) {
+    SimulatorT* simulator = (SimulatorT*)context;
+    unsigned int slot;
+    ProcessChunkT* chunk = lookup_process(simulator, pid, &slot);
+    return pcb_state(chunk, slot) != terminated || unqueue_locked(simulator, chunk, slot);
+}
+
+// Drop every terminated process from the ready set - caller holds process_mutex
+static void ready_purge_terminated_locked(SimulatorT* simulator) {
+    heap_filter(&simulator->deadline_queue, keep_live_entry, simulator);
+    if (simulator->stride_scheduling) {
+        stride_filter(&simulator->stride, keep_live_entry, simulator);
+    } else {
+        queue_purge_terminated_locked(simulator, &simulator->task_queue);
+        for (unsigned int i = 0; i < simulator->core_count; i++) {
+            queue_purge_terminated_locked(simulator, &simulator->cores[i].queue);
+        }
+    }
+}
+
+// Charge a process's share group for CPU time: its quantum when dispatched,
+// then the difference once the time it actually used is known. Deadline
+// processes run outside the shares - caller holds process_mutex
+static void charge_share_locked(SimulatorT* simulator, ProcessChunkT* chunk, unsigned int slot, long long units) {
+    if (simulator->stride_scheduling && !process_deadline(chunk, slot)) {
+        stride_charge(&simulator->stride, simulator->share_classes[chunk->share[slot]].group, units);
+    }
+}
+
+// Start a worker in a free pool slot - caller holds process_mutex
+static bool spawn_worker_locked(SimulatorT* simulator) {
+    int i = 0;
+    while (i < simulator->total_threads && simulator->worker_slots[i] == slot_active) {
+        i++;
+    }
+    if (i == simulator->total_threads) {
+        return false;
+    }
+    // A worker that shrank out of the pool has already returned, so this join is immediate
+    if (simulator->worker_slots[i] == slot_exited) {
+        pthread_join(simulator->worker_threads[i], NULL);
+    }
+
+    WorkerArgumentT* argument = (WorkerArgumentT*)malloc(sizeof(WorkerArgumentT));
+    argument->simulator = simulator;
+    argument->thread_id = i;
+
+    // Each worker gets a CPU of its own from the configured set
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    if (CPU_COUNT(&simulator->worker_cpus) > 0) {
+        cpu_set_t cpu;
+        CPU_ZERO(&cpu);
+        CPU_SET(affinity_nth_cpu(&simulator->worker_cpus, i), &cpu);
+        affinity_apply(&attr, &cpu);
+    }
+
+    int const created = pthread_create(&simulator->worker_threads[i], &attr,
+                                       simulator->fibers_per_worker > 1 ? fiber_worker_routine : simulator_routine, argument);
+    pthread_attr_destroy(&attr);
+    if (created != 0) {
+        free(argument);
+        simulator->worker_slots[i] = slot_empty;
+        return false;
+    }
+
+    simulator->worker_slots[i] = slot_active;
+    simulator->active_workers++;
+    return true;
+}
+
+// Add a worker's busy time to the pool's, closing the window once it has run
+// its length. The pool size is taken as it is at the close - caller holds process_mutex
+static void account_busy_locked(SimulatorT* simulator, unsigned long long busy_ns) {
+    simulator->window_busy_ns += busy_ns;
+    unsigned long long const now = monotonic_ns();
+    unsigned long long const elapsed = now - simulator->window_start;
+    if (elapsed < SIMULATOR_UTILIZATION_WINDOW_MS * 1000000ULL) {
+        return;
+    }
+    unsigned long long const capacity = elapsed * (simulator->active_workers ? simulator->active_workers : 1);
+    unsigned long long const percent = 100 * simulator->window_busy_ns / capacity;
+    simulator->utilization = percent < 100 ? (unsigned int)percent : 100;
+    simulator->window_start = now;
+    simulator->window_busy_ns = 0;
+}
+
+// Whether a worker that found nothing to run should leave the pool at once
+// rather than park, the pool having been mostly idle - caller holds process_mutex
+static bool underused_locked(SimulatorT* simulator) {
+    return simulator->active_workers > simulator->min_threads && simulator->utilization < SIMULATOR_SHRINK_UTILIZATION &&
+           ready_length(simulator) == 0;
+}
+
+// Wake parked workers for `added` new ready processes, and grow the pool when
+// every worker is busy, mostly running slices, and the run queue is deep - caller holds process_mutex
+static void notify_work_locked(SimulatorT* simulator, unsigned int added) {
+    if (added == 0) {
+        return;
+    }
+    if (simulator->tracing) {
+        trace_queue_counter(ready_length(simulator), simulator->blocked_queue.length);
+    }
+    if (simulator->parked_workers > 0) {
+        if (added == 1) {
+            pthread_cond_signal(&simulator->work_condition);
+        } else {
+            pthread_cond_broadcast(&simulator->work_condition);
+        }
+    } else {
+        // New workers are not parked yet, so this adds enough of them for the backlog.
+        // A fiber worker runs as many processes at once as it has fibers.
+        unsigned long const per_worker = simulator->fibers_per_worker > 1 ? simulator->fibers_per_worker : 1;
+        while (simulator->active && simulator->active_workers < simulator->max_threads &&
+               simulator->utilization >= SIMULATOR_GROW_UTILIZATION &&
+               ready_length(simulator) > (unsigned long)SIMULATOR_GROW_DEPTH * per_worker * simulator->active_workers) {
+            if (!spawn_worker_locked(simulator)) {
+                break;
+            }
+        }
+    }
+}
+
+static unsigned int pcb_quantum(ProcessChunkT* chunk, unsigned int slot) {
+    unsigned char const flags = atomic_load_explicit(&chunk->flags[slot], memory_order_relaxed);
+    return TIME_SLICE_LENGTH << ((flags & PCB_QUANTUM_MASK) >> PCB_QUANTUM_SHIFT);
+}
+
+// Processes that used their whole quantum get a longer one next time, so
+// batch work is switched less often. Ones that blocked or terminated early
+// drop back to a single slice, so they are not held up behind long quanta.
+// Returns flags with the quantum level updated.
+static unsigned char adapt_quantum(unsigned char flags, EvaluatorResultT const result, unsigned int quantum) {
+    unsigned int level = (flags & PCB_QUANTUM_MASK) >> PCB_QUANTUM_SHIFT;
+    if (result.reason == reason_timeslice_ended && result.cpu_time >= quantum) {
+        if (level < MAX_QUANTUM_LEVEL) {
+            level++;
+        }
+    } else {
+        level = 0;
+    }
+    return (flags & ~PCB_QUANTUM_MASK) | (level << PCB_QUANTUM_SHIFT);
+}
+
+// Slices of TIME_SLICE_LENGTH a dispatch ran for, counting a part slice as
+// one and at least one however little it ran
+static unsigned int slices_used(unsigned long long cpu_time) {
+    unsigned long long const slices = (cpu_time + TIME_SLICE_LENGTH - 1) / TIME_SLICE_LENGTH;
+    return slices ? (unsigned int)slices : 1;
+}
+
+// Count a deadline process that ran to completion as met or missed, and how late it was
+static void account_deadline_locked(SimulatorT* simulator, ProcessChunkT* chunk, unsigned int slot) {
+    unsigned long long const now = deadline_now_locked(simulator);
+    unsigned long long const deadline = chunk->deadline[slot];
+    if (now <= deadline) {
+        simulator->deadlines_met++;
+        return;
+    }
+    unsigned long long const lateness = now - deadline;
+    unsigned int const bucket = 63 - __builtin_clzll(lateness);
+    simulator->deadlines_missed++;
+    simulator->lateness_histogram[bucket < SIMULATOR_LATENESS_BUCKETS ? bucket : SIMULATOR_LATENESS_BUCKETS - 1]++;
+    if (simulator->tracing) {
+        trace_instant_event("miss", chunk->base_pid + slot);
+    }
+}
+
+// Mailboxes. Each is a single-producer single-consumer ring: a process
+// receives only from its own, and only its one connected sender sends to it.
+// A worker moves a message through the ring straight after the slice,
+// without process_mutex; the lock is only needed when the ring was full or
+// empty, to block the process, or to wake the other side. A blocked side is
+// woken straight from the link, never through blocked_queue, and while it
+// is blocked the waker stands in for it on its end of the ring.
+
+// A process's link, allocating the chunk's links the first time - caller holds process_mutex
+static ProcessLinkT* process_link_locked(SimulatorT* simulator, ProcessChunkT* chunk, unsigned int slot) {
+    ProcessLinkT* links = chunk->links;
+    if (!links) {
+        links = (ProcessLinkT*)calloc(PROCESS_CHUNK_SIZE, sizeof(ProcessLinkT));
+        if (!links) {
+            return NULL;
+        }
+        atomic_store(&chunk->links, links);
+    }
+    if (!links[slot].linked) {
+        links[slot].linked = true;
+        simulator->linked_processes++;
+    }
+    return &links[slot];
+}
+
+// The link of pid, or NULL if it has none - caller holds process_mutex
+static ProcessLinkT* find_link_locked(SimulatorT* simulator, ProcessIdT pid, ProcessChunkT** chunk, unsigned int* slot) {
+    *chunk = lookup_process(simulator, pid, slot);
+    ProcessLinkT* links = *chunk ? (*chunk)->links : NULL;
+    return links && links[*slot].linked ? &links[*slot] : NULL;
+}
+
+// Make a process blocked in a send or receive ready again. False if a
+// lock-free kill got to it first - caller holds process_mutex
+static bool wake_exchange_locked(SimulatorT* simulator, ProcessChunkT* chunk, unsigned int slot) {
+    chunk->links[slot].waiting = exchange_none;
+    if (!transition_pcb(chunk, slot, blocked, ready, PCB_QUEUED)) {
+        return false;
+    }
+    ready_push_locked(simulator, chunk, slot, join_pass_locked(simulator, chunk, slot));
+    notify_work_locked(simulator, 1);
+    stats_add(stats_wakes, 1);
+    if (simulator->tracing) {
+        trace_instant_event("wake", chunk->base_pid + slot);
+    }
+    return true;
+}
+
+// After a message went into receiver's mailbox: if the receiver is blocked
+// on it, take the message for it and wake it - caller holds process_mutex
+static void deliver_locked(SimulatorT* simulator, ProcessIdT receiver) {
+    ProcessChunkT* chunk;
+    unsigned int slot;
+    ProcessLinkT* link = find_link_locked(simulator, receiver, &chunk, &slot);
+    if (!link || link->waiting != exchange_receive) {
+        return;
+    }
+    // Killed while blocked, so the message stays for release to drop
+    if (pcb_state(chunk, slot) != blocked) {
+        link->waiting = exchange_none;
+        return;
+    }
+    uintptr_t message;
+    if (mailbox_receive(link->inbox, &message)) {
+        link->received = (unsigned int)message;
+        simulator->messages_received++;
+        wake_exchange_locked(simulator, chunk, slot);
+    }
+}
+
+// After a message left the mailbox of link: if its sender is blocked on the
+// full mailbox, send its message for it and wake it - caller holds process_mutex
+static void refill_locked(SimulatorT* simulator, ProcessLinkT* link) {
+    ProcessChunkT* chunk;
+    unsigned int slot;
+    ProcessLinkT* sender = find_link_locked(simulator, link->sender, &chunk, &slot);
+    if (!sender || sender->waiting != exchange_send) {
+        return;
+    }
+    if (pcb_state(chunk, slot) != blocked) {
+        sender->waiting = exchange_none;
+        simulator->messages_dropped++;
+        return;
+    }
+    if (mailbox_send(link->inbox, sender->pending)) {
+        simulator->messages_sent++;
+        wake_exchange_locked(simulator, chunk, slot);
+    }
+}
+
+// The lock-free half of a send or receive that ended a slice, run by the
+// worker before it takes process_mutex again. A send of
+// EVALUATOR_MESSAGE_RECEIVED has the process's last received message put in
+// result, and a receive that went through has the message it took put there.
+// Returns whether the message went through the ring; if not,
+// exchange_locked retries under the lock.
+static bool exchange_unlocked(SimulatorT* simulator, ProcessChunkT* chunk, unsigned int slot, EvaluatorResultT* result) {
+    if (result->reason != reason_send && result->reason != reason_receive) {
+        return false;
+    }
+    ProcessLinkT* links = chunk->links;
+    if (result->reason == reason_send && result->message == EVALUATOR_MESSAGE_RECEIVED) {
+        result->message = links ? links[slot].received : 0;
+    }
+    if (!links) {
+        return false;
+    }
+    if (result->reason == reason_receive) {
+        // The mailbox of a process that is running is never released
+        MailboxT* inbox = atomic_load(&links[slot].inbox);
+        uintptr_t message;
+        if (!inbox || !mailbox_receive(inbox, &message)) {
+            return false;
+        }
+        result->message = (unsigned int)message;
+        return true;
+    }
+    // The peer can be released meanwhile. Its mailbox is then retired rather
+    // than freed, until no lock-free reader is left.
+    enter_lockfree(simulator);
+    MailboxT* outbox = atomic_load(&links[slot].outbox);
+    bool const sent = outbox && mailbox_send(outbox, result->message);
+    exit_lockfree(simulator);
+    return sent;
+}
+
+// Finish a send or receive that ended a slice, exchanged saying whether
+// exchange_unlocked already moved the message. Returns false if the process
+// must block, with what it waits for recorded in its link - caller holds process_mutex
+static bool exchange_locked(SimulatorT* simulator, ProcessChunkT* chunk, unsigned int slot, EvaluatorResultT const result,
+                            bool exchanged) {
+    ProcessLinkT* link = process_link_locked(simulator, chunk, slot);
+    if (result.reason == reason_send) {
+        // Retried under the lock, the receiver may have made room since
+        if (!exchanged && link && link->peer) {
+            exchanged = mailbox_send(link->outbox, result.message);
+        }
+        if (exchanged) {
+            simulator->messages_sent++;
+            deliver_locked(simulator, link ? link->peer : 0);
+            return true;
+        }
+        if (!link || link->severed) {
+            simulator->messages_dropped++;
+            return true;
+        }
+        link->pending = result.message;
+        link->waiting = exchange_send;
+        simulator->send_blocks++;
+        return false;
+    }
+
+    if (link && !link->inbox) {
+        atomic_store(&link->inbox, mailbox_create(simulator->mailbox_capacity));
+    }
+    if (!link || !link->inbox) {
+        return true;
+    }
+    uintptr_t message = result.message;
+    if (exchanged || mailbox_receive(link->inbox, &message)) {
+        link->received = (unsigned int)message;
+        simulator->messages_received++;
+        refill_locked(simulator, link);
+        return true;
+    }
+    // Nothing will ever arrive once the sender has gone
+    if (link->closed) {
+        return true;
+    }
+    link->waiting = exchange_receive;
+    simulator->receive_blocks++;
+    return false;
+}
+
+// Disconnect a process from its peer and its sender once it terminates, and
+// retire its mailbox. Whichever of them is blocked on it returns. Idempotent -
+// caller holds process_mutex
+static void unlink_process_locked(SimulatorT* simulator, ProcessChunkT* chunk, unsigned int slot) {
+    ProcessLinkT* link = chunk->links ? &chunk->links[slot] : NULL;
+    if (!link || !link->linked) {
+        return;
+    }
+    ProcessChunkT* other_chunk;
+    unsigned int other_slot;
+    if (link->waiting == exchange_send) {
+        simulator->messages_dropped++;
+    }
+    ProcessLinkT* receiver = find_link_locked(simulator, link->peer, &other_chunk, &other_slot);
+    if (receiver) {
+        receiver->sender = 0;
+        receiver->closed = true;
+        if (receiver->waiting == exchange_receive) {
+            wake_exchange_locked(simulator, other_chunk, other_slot);
+        }
+    }
+    ProcessLinkT* sender = find_link_locked(simulator, link->sender, &other_chunk, &other_slot);
+    if (sender) {
+        atomic_store(&sender->outbox, NULL);
+        sender->peer = 0;
+        sender->severed = true;
+        if (sender->waiting == exchange_send) {
+            simulator->messages_dropped++;
+            wake_exchange_locked(simulator, other_chunk, other_slot);
+        }
+    }
+
+    MailboxT* inbox = link->inbox;
+    if (inbox) {
+        simulator->messages_dropped += mailbox_length(inbox);
+        RetiredMailboxT* retired = (RetiredMailboxT*)checked_malloc(sizeof(RetiredMailboxT));
+        retired->mailbox = inbox;
+        retired->next = simulator->retired_mailboxes;
+        simulator->retired_mailboxes = retired;
+    }
+    atomic_store(&link->outbox, NULL);
+    atomic_store(&link->inbox, NULL);
+    link->peer = 0;
+    link->sender = 0;
+    link->received = 0;
+    link->waiting = exchange_none;
+    link->closed = false;
+    link->severed = false;
+    link->linked = false;
+    simulator->linked_processes--;
+    reclaim_retired_locked(simulator);
+}
+
+// Apply the outcome of a slice to a process. quantum and pass are the ones
+// it was dispatched with, used the CPU time it took over the whole dispatch
+// and exchanged what exchange_unlocked returned. adapt lets the slice move
+// the process's quantum level, which only dispatches that ran that quantum
+// should - caller holds process_mutex
+static void complete_slice_locked(SimulatorT* simulator, ProcessChunkT* chunk, unsigned int slot, EvaluatorResultT const result,
+                                  unsigned int quantum, bool adapt, unsigned long long pass, unsigned long long used,
+                                  bool exchanged) {
+    chunk->PC[slot] = result.PC;
+    simulator->virtual_time += used;
+    charge_share_locked(simulator, chunk, slot, (long long)used - (long long)quantum);
+
+    // A process that must wait in a send or receive blocks without joining blocked_queue
+    bool const waits = (result.reason == reason_send || result.reason == reason_receive) &&
+                       !exchange_locked(simulator, chunk, slot, result, exchanged);
+
+    stats_add(result.reason == reason_terminated ? stats_slices_terminated
+              : result.reason == reason_blocked ? stats_slices_blocked
+              : stats_slices_timeslice, 1);
+
+    // A kill that arrived during the slice takes effect now. The process
+    // leaves running in one CAS, so no later kill can set PCB_KILL_REQUESTED
+    // on it, and a requeued process is marked queued before a kill can see it.
+    unsigned char flags = atomic_load_explicit(&chunk->flags[slot], memory_order_relaxed);
+    bool dies;
+    unsigned char next;
+    do {
+        dies = result.reason == reason_terminated || (flags & PCB_KILL_REQUESTED);
+        ProcessStateT const state = dies ? terminated
+                                  : result.reason == reason_blocked || waits ? blocked : ready;
+        next = adapt ? adapt_quantum(flags, result, quantum) : flags;
+        next = (next & ~(PCB_STATE_MASK | PCB_KILL_REQUESTED)) | state | (dies || waits ? 0 : PCB_QUEUED);
+    } while (!atomic_compare_exchange_weak(&chunk->flags[slot], &flags, next));
+
+    if (dies) {
+        if (result.reason == reason_terminated && process_deadline(chunk, slot)) {
+            account_deadline_locked(simulator, chunk, slot);
+        }
+        // Its peer and sender learn now rather than when it is waited on
+        unlink_process_locked(simulator, chunk, slot);
+        notify_waiters(simulator);
+    } else if (waits) {
+        // Woken by the other side of the mailbox through the link
+        if (simulator->tracing) {
+            trace_instant_event("block", chunk->base_pid + slot);
+        }
+    } else if (result.reason == reason_blocked) {
+        // Blocked processes wait for simulator_event to make them ready again
+        queue_push_locked(simulator, &simulator->blocked_queue, chunk, slot); // Add to blocked queue
+        if (simulator->tracing) {
+            trace_instant_event("block", chunk->base_pid + slot);
+        }
+    } else {
+        // No wake-up needed, this worker pops again straight away
+        ShareClassT const* share = &simulator->share_classes[chunk->share[slot]];
+        ready_push_locked(simulator, chunk, slot, pass + share->stride * (used ? used : 1));
+    }
+}
+
+// Whether a worker could run something on a core now: it is free, and has
+// a process queued or the shared ready sets do - caller holds process_mutex
+static bool core_claimable_locked(SimulatorT* simulator, unsigned int core) {
+    if (simulator->cores[core].running) {
+        return false;
+    }
+    return simulator->cores[core].queue.length > 0 || simulator->deadline_queue.length > 0 ||
+           (simulator->stride_scheduling && simulator->stride.length > 0);
+}
+
+// Whether a dispatch would find a process - caller holds process_mutex
+static bool work_claimable_locked(SimulatorT* simulator) {
+    if (!simulator->core_count) {
+        return ready_length(simulator) > 0;
+    }
+    for (unsigned int i = 0; i < simulator->core_count; i++) {
+        if (core_claimable_locked(simulator, i)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Take the next process to dispatch. With simulated cores, claim a free core
+// with work, searching round-robin, and take the process from it; the core
+// stays claimed until release_core_locked. 0 if every core with work is
+// running - caller holds process_mutex
+static ProcessIdT dispatch_pop_locked(SimulatorT* simulator, unsigned long long* pass, unsigned int* core) {
+    *core = 0;
+    if (!simulator->core_count) {
+        return ready_pop_locked(simulator, pass, 0);
+    }
+    for (unsigned int i = 0; i < simulator->core_count; i++) {
+        unsigned int const candidate = (simulator->core_cursor + i) % simulator->core_count;
+        if (!core_claimable_locked(simulator, candidate)) {
+            continue;
+        }
+        ProcessIdT const pid = ready_pop_locked(simulator, pass, candidate);
+        if (pid) {
+            simulator->cores[candidate].running = true;
+            simulator->core_cursor = candidate + 1;
+            *core = candidate;
+            return pid;
+        }
+    }
+    return 0;
+}
+
+// Record that a process is dispatched on a core. Returns the CPU time it is
+// charged for a cold cache if it last ran on another one - caller holds process_mutex
+static unsigned int enter_core_locked(SimulatorT* simulator, ProcessChunkT* chunk, unsigned int slot, unsigned int core) {
+    if (!simulator->core_count) {
+        return 0;
+    }
+    unsigned int const last = chunk->core[slot];
+    chunk->core[slot] = core;
+    simulator->cores[core].dispatches++;
+    if (last == CORE_NONE || last == core) {
+        return 0;
+    }
+    simulator->cores[core].migrations++;
+    simulator->migrations++;
+    if (simulator->tracing) {
+        trace_instant_event("migrate", chunk->base_pid + slot);
+    }
+    return simulator->migration_penalty;
+}
+
+// Unlink the first live process of a queue that may run on core - caller holds process_mutex
+static ProcessChunkT* queue_take_allowed_locked(SimulatorT* simulator, ProcessQueueT* queue, unsigned int core,
+                                                unsigned int* slot) {
+    ProcessChunkT* prev_chunk = NULL;
+    unsigned int prev_slot = 0;
+    for (ProcessIdT pid = queue->head; pid;) {
+        ProcessChunkT* chunk = lookup_process(simulator, pid, slot);
+        ProcessIdT const next = chunk->next[*slot];
+        if (pcb_state(chunk, *slot) != terminated && (allowed_cores(simulator, chunk, *slot) >> core & 1)) {
+            if (prev_chunk) {
+                prev_chunk->next[prev_slot] = next;
+            } else {
+                queue->head = next;
+            }
+            if (queue->tail == pid) {
+                queue->tail = prev_chunk ? prev_chunk->base_pid + prev_slot : 0;
+            }
+            queue->length--;
+            return chunk;
+        }
+        prev_chunk = chunk;
+        prev_slot = *slot;
+        pid = next;
+    }
+    return NULL;
+}
+
+// Even out the core queues: while the most and least loaded cores differ by
+// more than one process, move the first process of the busier queue that may
+// run on the other. Moved processes stay queued throughout, so kills need no
+// care - caller holds process_mutex
+static void balance_cores_locked(SimulatorT* simulator) {
+    if (simulator->stride_scheduling) {
+        return;
+    }
+    for (;;) {
+        unsigned int busiest = 0;
+        unsigned int idlest = 0;
+        for (unsigned int i = 1; i < simulator->core_count; i++) {
+            if (core_load(&simulator->cores[i]) > core_load(&simulator->cores[busiest])) {
+                busiest = i;
+            }
+            if (core_load(&simulator->cores[i]) < core_load(&simulator->cores[idlest])) {
+                idlest = i;
+            }
+        }
+        if (core_load(&simulator->cores[busiest]) <= core_load(&simulator->cores[idlest]) + 1) {
+            return;
+        }
+        unsigned int slot;
+        ProcessChunkT* chunk = queue_take_allowed_locked(simulator, &simulator->cores[busiest].queue, idlest, &slot);
+        if (!chunk) {
+            return;
+        }
+        queue_push_locked(simulator, &simulator->cores[idlest].queue, chunk, slot);
+        simulator->balancer_moves++;
+    }
+}
+
+// Free a core after a dispatch that used `used` units of CPU time on it,
+// running the load balancer when it is due. A parked worker is woken if the
+// core still has work, as the worker that freed it may not take it next -
+// caller holds process_mutex
+static void release_core_locked(SimulatorT* simulator, unsigned int core, unsigned long long used) {
+    if (!simulator->core_count) {
+        return;
+    }
+    simulator->cores[core].running = false;
+    simulator->cores[core].cpu_time += used;
+    if (simulator->virtual_time >= simulator->next_balance) {
+        balance_cores_locked(simulator);
+        simulator->next_balance = simulator->virtual_time + simulator->balance_interval;
+    }
+    if (simulator->parked_workers > 0 && simulator->cores[core].queue.length > 0) {
+        pthread_cond_signal(&simulator->work_condition);
+    }
+}
+
+// Gauges for the stats publisher, sampled once per snapshot
+static void sample_stats(void* context, unsigned long long gauges[stats_gauge_count]) {
+    SimulatorT* simulator = (SimulatorT*)context;
+    PROFILED_LOCK(&simulator->process_mutex);
+    drain_releases_locked(simulator);
+    gauges[stats_ready_depth] = ready_length(simulator);
+    gauges[stats_blocked_depth] = simulator->blocked_queue.length;
+    gauges[stats_live_processes] = (unsigned long long)simulator->allocated_chunks * PROCESS_CHUNK_SIZE - simulator->free_pcbs;
+    gauges[stats_active_workers] = simulator->active_workers;
+    gauges[stats_parked_workers] = simulator->parked_workers;
+    PROFILED_UNLOCK(&simulator->process_mutex);
+}
+
+// Apply the tunable part of a configuration, returning the number of workers
+// the pool should start with. Pool bounds are clamped to the pool slots.
+static unsigned int configure(SimulatorT* simulator, int threads, SimulatorConfigT const* config) {
+    // Without pool bounds the pool stays at the thread count
+    unsigned int const slots = (unsigned int)simulator->total_threads;
+    bool const bounded = config->max_threads > 0;
+    unsigned int min = bounded ? config->min_threads : (unsigned int)threads;
+    unsigned int max = bounded ? config->max_threads : (unsigned int)threads;
+    if (max < min) {
+        max = min;
+    }
+    if (max > slots) {
+        max = slots;
+    }
+    if (min > max) {
+        min = max;
+    }
+    simulator->min_threads = min;
+    simulator->max_threads = max;
+    simulator->coalesce_slices = config->coalesce_slices ? config->coalesce_slices : 1;
+    simulator->adaptive_quantum = config->adaptive_quantum;
+    simulator->dispatch_batch = config->dispatch_batch ? config->dispatch_batch : 1;
+    simulator->drop_late_deadlines = config->drop_late_deadlines;
+    simulator->core_placement = config->core_placement;
+    simulator->migration_penalty = config->migration_penalty;
+    simulator->balance_interval = config->balance_interval ? config->balance_interval : SIMULATOR_BALANCE_INTERVAL;
+    simulator->next_balance = simulator->virtual_time + simulator->balance_interval;
+    simulator->mailbox_capacity = config->mailbox_capacity ? config->mailbox_capacity : SIMULATOR_MAILBOX_CAPACITY;
+
+    unsigned int const high = config->high_watermark ? config->high_watermark : 90;
+    unsigned int const low = config->low_watermark ? config->low_watermark : 70;
+    simulator->max_live = config->max_live_processes;
+    simulator->high_watermark = (unsigned long long)simulator->max_live * high / 100;
+    simulator->low_watermark = (unsigned long long)simulator->max_live * (low < high ? low : high) / 100;
+    atomic_store(&simulator->throttled, false);
+    update_occupancy_locked(simulator);
+    // A raised limit may admit creators already waiting
+    if (simulator->admission_head) {
+        pthread_cond_signal(&simulator->admission_head->condition);
+    }
+
+    unsigned int initial = (unsigned int)threads;
+    if (initial < min) {
+        initial = min;
+    }
+    if (initial > max) {
+        initial = max;
+    }
+    return initial;
+}
+
+// Initialize a simulator instance
+SimulatorT* simulator_start(int threads, int max_processes, SimulatorConfigT const* config) {
+    SimulatorConfigT const defaults = { 0 };
+    if (!config) {
+        config = &defaults;
+    }
+
+    SimulatorT* simulator = NULL;
+    if (posix_memalign((void**)&simulator, CACHE_LINE_SIZE, sizeof(SimulatorT)) != 0) {
+        fprintf(stderr, "Error: Unable to allocate simulator.\n");
+        exit(EXIT_FAILURE);
+    }
+    memset(simulator, 0, sizeof(SimulatorT));
+
+    // Every process belongs to a share group, the default one unless created in another
+    simulator->stride_scheduling = config->stride_scheduling;
+    simulator->fibers_per_worker = config->fibers_per_worker > 1 ? config->fibers_per_worker : 0;
+    stride_init(&simulator->stride);
+    stride_add_group(&simulator->stride, "default", SIMULATOR_DEFAULT_TICKETS);
+    intern_share_locked(simulator, 0, SIMULATOR_DEFAULT_TICKETS);
+    heap_init(&simulator->deadline_queue);
+    simulator->deadline_real_time = config->deadline_real_time;
+    simulator->core_count = config->simulated_cores < SIMULATOR_MAX_CORES ? config->simulated_cores : SIMULATOR_MAX_CORES;
+    if (simulator->core_count) {
+        simulator->cores = (SimulatedCoreT*)calloc(simulator->core_count, sizeof(SimulatedCoreT));
+        if (!simulator->cores) {
+            fprintf(stderr, "Error: Unable to allocate simulated cores.\n");
+            exit(EXIT_FAILURE);
+        }
+        simulator->all_cores = simulator->core_count == 64 ? ~0ULL : (1ULL << simulator->core_count) - 1;
+    }
+
+    if (affinity_parse(config->cpus ? config->cpus : "", &simulator->worker_cpus) != 0) {
+        fprintf(stderr, "Error: Invalid simulator CPU list \"%s\".\n", config->cpus);
+        exit(EXIT_FAILURE);
+    }
+    // One pool slot per thread the pool may ever reach
+    simulator->total_threads = config->max_threads > 0 ? config->max_threads : (unsigned int)threads;
+    if ((unsigned int)simulator->total_threads < config->min_threads) {
+        simulator->total_threads = config->min_threads;
+    }
+    simulator->active = true;
+    // Until a window has been measured the pool counts as busy, so it can grow
+    simulator->utilization = 100;
+    simulator->window_start = monotonic_ns();
+
+    // Tracing is process-wide, so only one instance at a time can record, and
+    // every event is gated on this instance owning it. Set before any worker starts.
+    if (config->trace_path && config->trace_path[0]) {
+        simulator->tracing = trace_start(config->trace_path);
+        if (!simulator->tracing) {
+            logger_write("Trace already being recorded by another simulator, not tracing this one.");
+        }
+    }
+
+    // max_processes only sizes the initial table, it grows on demand
+    unsigned int initial_chunks = (max_processes + PROCESS_CHUNK_SIZE - 1) / PROCESS_CHUNK_SIZE;
+    if (initial_chunks == 0) {
+        initial_chunks = 1;
+    }
+    for (unsigned int i = 0; i < initial_chunks; i++) {
+        if (!allocate_chunk_locked(simulator, i)) {
+            fprintf(stderr, "Error: Unable to allocate process table.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    pthread_mutex_init(&simulator->process_mutex, NULL);
+    pthread_mutex_init(&simulator->wait_mutex, NULL);
+    pthread_cond_init(&simulator->wait_condition, NULL);
+    pthread_cond_init(&simulator->work_condition, NULL);
+
+    simulator->worker_threads = (pthread_t*)malloc(sizeof(pthread_t) * (simulator->total_threads ? simulator->total_threads : 1));
+    simulator->worker_slots = (unsigned char*)calloc(simulator->total_threads ? simulator->total_threads : 1, 1);
+    if (!simulator->worker_threads || !simulator->worker_slots) {
+        fprintf(stderr, "Error: Unable to allocate memory for threads.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // Pool bounds and tuning are applied once the locks exist, since
+    // configuring updates occupancy and may signal admission waiters
+    PROFILED_LOCK(&simulator->process_mutex);
+    unsigned int const initial = configure(simulator, threads, config);
+    for (unsigned int i = 0; i < initial; i++) {
+        if (!spawn_worker_locked(simulator)) {
+            fprintf(stderr, "Error: Failed to create thread %u\n", i);
+            exit(EXIT_FAILURE);
+        }
+    }
+    PROFILED_UNLOCK(&simulator->process_mutex);
+
+    stats_set_sampler(sample_stats, simulator);
+    return simulator;
+}
+
+// Retune a running instance, keeping its process table and worker threads
+void simulator_reconfigure(SimulatorT* simulator, int threads, SimulatorConfigT const* config) {
+    SimulatorConfigT const defaults = { 0 };
+    if (!config) {
+        config = &defaults;
+    }
+
+    PROFILED_LOCK(&simulator->process_mutex);
+
+    unsigned int const initial = configure(simulator, threads, config);
+    simulator->total_slices = 0;
+    simulator->total_dispatches = 0;
+    simulator->total_cpu_time = 0;
+    simulator->deadlines_met = 0;
+    simulator->deadlines_missed = 0;
+    simulator->deadlines_dropped = 0;
+    memset(simulator->lateness_histogram, 0, sizeof(simulator->lateness_histogram));
+    simulator->peak_live = live_processes_locked(simulator);
+    simulator->admission_timeouts = 0;
+    simulator->migrations = 0;
+    simulator->balancer_moves = 0;
+    simulator->messages_sent = 0;
+    simulator->messages_received = 0;
+    simulator->messages_dropped = 0;
+    simulator->send_blocks = 0;
+    simulator->receive_blocks = 0;
+    for (unsigned int i = 0; i < simulator->core_count; i++) {
+        simulator->cores[i].dispatches = 0;
+        simulator->cores[i].cpu_time = 0;
+        simulator->cores[i].migrations = 0;
+    }
+
+    while (simulator->active_workers < initial && spawn_worker_locked(simulator)) {
+    }
+    // Parked workers above a lowered maximum leave when woken
+    pthread_cond_broadcast(&simulator->work_condition);
+
+    PROFILED_UNLOCK(&simulator->process_mutex);
+}
+
+// Work done since simulator_start or the last simulator_reconfigure
+SimulatorReportT simulator_report(SimulatorT* simulator) {
+    PROFILED_LOCK(&simulator->process_mutex);
+    SimulatorReportT report = {
+        .slices = simulator->total_slices,
+        .dispatches = simulator->total_dispatches,
+        .cpu_time = simulator->total_cpu_time,
+        .workers = simulator->active_workers,
+        .deadlines_met = simulator->deadlines_met,
+        .deadlines_missed = simulator->deadlines_missed,
+        .deadlines_dropped = simulator->deadlines_dropped,
+        .migrations = simulator->migrations,
+        .balancer_moves = simulator->balancer_moves,
+        .messages_sent = simulator->messages_sent,
+        .messages_received = simulator->messages_received,
+        .messages_dropped = simulator->messages_dropped,
+        .send_blocks = simulator->send_blocks,
+        .receive_blocks = simulator->receive_blocks,
+    };
+    memcpy(report.lateness_histogram, simulator->lateness_histogram, sizeof(report.lateness_histogram));
+    PROFILED_UNLOCK(&simulator->process_mutex);
+    return report;
+}
+
+// Fill per-core reports from the core counters - caller holds process_mutex
+static void core_report_locked(SimulatorT* simulator, SimulatorCoreReportT* cores, unsigned int n) {
+    unsigned long long busiest = 0;
+    for (unsigned int i = 0; i < simulator->core_count; i++) {
+        if (simulator->cores[i].cpu_time > busiest) {
+            busiest = simulator->cores[i].cpu_time;
+        }
+    }
+    for (unsigned int i = 0; i < n && i < simulator->core_count; i++) {
+        SimulatedCoreT const* core = &simulator->cores[i];
+        cores[i] = (SimulatorCoreReportT){
+            .dispatches = core->dispatches,
+            .cpu_time = core->cpu_time,
+            .migrations = core->migrations,
+            .utilization = busiest ? (double)core->cpu_time / busiest : 0.0,
+        };
+    }
+}
+
+// Per-core work since simulator_start or the last simulator_reconfigure
+unsigned int simulator_core_report(SimulatorT* simulator, SimulatorCoreReportT* cores, unsigned int n) {
+    PROFILED_LOCK(&simulator->process_mutex);
+    core_report_locked(simulator, cores, n);
+    unsigned int const count = simulator->core_count;
+    PROFILED_UNLOCK(&simulator->process_mutex);
+    return count;
+}
+
+// Pin a process to a set of simulated cores
+bool simulator_set_affinity(SimulatorT* simulator, ProcessIdT pid, unsigned long long mask) {
+    if (!simulator->core_count || (mask && !(mask & simulator->all_cores))) {
+        return false;
+    }
+    PROFILED_LOCK(&simulator->process_mutex);
+    unsigned int slot;
+    ProcessChunkT* chunk = lookup_process(simulator, pid, &slot);
+    bool set = false;
+    if (chunk && pcb_state(chunk, slot) != unallocated && pcb_state(chunk, slot) != terminated) {
+        if (mask && !chunk->affinity) {
+            chunk->affinity = (unsigned long long*)calloc(PROCESS_CHUNK_SIZE, sizeof(unsigned long long));
+        }
+        if (chunk->affinity) {
+            chunk->affinity[slot] = mask;
+        }
+        set = chunk->affinity || !mask;
+    }
+    PROFILED_UNLOCK(&simulator->process_mutex);
+    return set;
+}
+
+static bool process_live(ProcessChunkT* chunk, unsigned int slot) {
+    ProcessStateT const state = pcb_state(chunk, slot);
+    return state != unallocated && state != terminated;
+}
+
+// Route one process's sends to another's mailbox
+bool simulator_connect(SimulatorT* simulator, ProcessIdT sender, ProcessIdT receiver) {
+    if (sender == receiver) {
+        return false;
+    }
+    PROFILED_LOCK(&simulator->process_mutex);
+    drain_releases_locked(simulator);
+    ProcessChunkT* sender_chunk;
+    ProcessChunkT* receiver_chunk;
+    unsigned int sender_slot, receiver_slot;
+    ProcessLinkT* from = find_link_locked(simulator, sender, &sender_chunk, &sender_slot);
+    ProcessLinkT* to = find_link_locked(simulator, receiver, &receiver_chunk, &receiver_slot);
+    bool connected = false;
+    if (sender_chunk && receiver_chunk && process_live(sender_chunk, sender_slot) &&
+        process_live(receiver_chunk, receiver_slot) && !(from && from->peer) && !(to && to->sender)) {
+        from = process_link_locked(simulator, sender_chunk, sender_slot);
+        to = from ? process_link_locked(simulator, receiver_chunk, receiver_slot) : NULL;
+        if (to && !to->inbox) {
+            atomic_store(&to->inbox, mailbox_create(simulator->mailbox_capacity));
+        }
+        connected = to && to->inbox;
+    }
+    if (connected) {
+        to->sender = sender;
+        to->closed = false;
+        from->peer = receiver;
+        from->severed = false;
+        atomic_store(&from->outbox, to->inbox);
+        // A send that was waiting for a peer goes through now, or waits for room
+        if (from->waiting == exchange_send && pcb_state(sender_chunk, sender_slot) == blocked &&
+            mailbox_send(to->inbox, from->pending)) {
+            simulator->messages_sent++;
+            wake_exchange_locked(simulator, sender_chunk, sender_slot);
+            deliver_locked(simulator, receiver);
+        }
+    }
+    PROFILED_UNLOCK(&simulator->process_mutex);
+    return connected;
+}
+
+// Read the last message a process received
+unsigned int simulator_received(SimulatorT* simulator, ProcessIdT pid) {
+    PROFILED_LOCK(&simulator->process_mutex);
+    ProcessChunkT* chunk;
+    unsigned int slot;
+    ProcessLinkT* link = find_link_locked(simulator, pid, &chunk, &slot);
+    unsigned int const message = link && process_live(chunk, slot) ? link->received : 0;
+    PROFILED_UNLOCK(&simulator->process_mutex);
+    return message;
+}
+
+// Processes a worker has taken for one batched dispatch
+typedef struct DispatchBatch {
+    unsigned int capacity;
+    ProcessChunkT** chunks;
+    unsigned int* slots;
+    EvaluatorCodeT* codes;
+    unsigned int* PCs;
+    unsigned long long* passes;
+    EvaluatorResultT* results;
+    bool* exchanged;
+} DispatchBatchT;
+
+static void free_dispatch_batch(DispatchBatchT* batch) {
+    if (batch) {
+        checked_free(batch->chunks);
+        checked_free(batch->slots);
+        checked_free(batch->codes);
+        checked_free(batch->PCs);
+        checked_free(batch->passes);
+        checked_free(batch->results);
+        checked_free(batch->exchanged);
+        checked_free(batch);
+    }
+}
+
+// Grow a worker's private batch buffers to hold n processes, the batch size
+// can change when the simulator is reconfigured
+static DispatchBatchT* reserve_dispatch_batch(DispatchBatchT* batch, unsigned int n) {
+    if (batch && batch->capacity >= n) {
+        return batch;
+    }
+    free_dispatch_batch(batch);
+    batch = (DispatchBatchT*)checked_malloc(sizeof(DispatchBatchT));
+    batch->capacity = n;
+    batch->chunks = (ProcessChunkT**)checked_malloc(sizeof(ProcessChunkT*) * n);
+    batch->slots = (unsigned int*)checked_malloc(sizeof(unsigned int) * n);
+    batch->codes = (EvaluatorCodeT*)checked_malloc(sizeof(EvaluatorCodeT) * n);
+    batch->PCs = (unsigned int*)checked_malloc(sizeof(unsigned int) * n);
+    batch->passes = (unsigned long long*)checked_malloc(sizeof(unsigned long long) * n);
+    batch->results = (EvaluatorResultT*)checked_malloc(sizeof(EvaluatorResultT) * n);
+    batch->exchanged = (bool*)checked_malloc(sizeof(bool) * n);
+    return batch;
+}
+
+// Main worker thread function
+void* simulator_routine(void* arg) {
+    SimulatorT* simulator = ((WorkerArgumentT*)arg)->simulator;
+    int thread_id = ((WorkerArgumentT*)arg)->thread_id;
+    free(arg);
+
+    char log_buffer[128];
+    sprintf(log_buffer, "Thread %d started.", thread_id);
+    logger_write(log_buffer);
+    sprintf(log_buffer, "worker %d", thread_id);
+    if (simulator->tracing) {
+        trace_name_thread(log_buffer);
+    }
+
+    unsigned long long const started = monotonic_ns();
+    unsigned long long busy_ns = 0;
+
+    // Private dispatch buffers for batched evaluation, sized on first use
+    DispatchBatchT* batch = NULL;
+
+    PROFILED_LOCK(&simulator->process_mutex);
+
+    while (simulator->active) {
+        drain_releases_locked(simulator);
+        unsigned long long pass;
+        unsigned int core;
+        ProcessIdT task_id = dispatch_pop_locked(simulator, &pass, &core);
+
+        // Park until work is enqueued; above the pool minimum, give up after a
+        // quiet period, or at once while the pool is mostly idle
+        if (!task_id) {
+            if (underused_locked(simulator)) {
+                break;
+            }
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_nsec += (SIMULATOR_IDLE_TIMEOUT_MS % 1000) * 1000000L;
+            deadline.tv_sec += SIMULATOR_IDLE_TIMEOUT_MS / 1000 + deadline.tv_nsec / 1000000000L;
+            deadline.tv_nsec %= 1000000000L;
+
+            simulator->parked_workers++;
+            int const waited = PROFILED_TIMEDWAIT(&simulator->work_condition, &simulator->process_mutex, &deadline);
+            simulator->parked_workers--;
+
+            // Reconfiguring can also lower the pool maximum below the running workers
+            if (simulator->active_workers > simulator->max_threads ||
+                (waited == ETIMEDOUT && simulator->active_workers > simulator->min_threads &&
+                 ready_length(simulator) == 0)) {
+                break;
+            }
+            continue;
+        }
+        if (simulator->tracing) {
+            trace_queue_counter(ready_length(simulator), simulator->blocked_queue.length);
+        }
+
+        if (simulator->dispatch_batch > 1) {
+            // Take up to dispatch_batch ready processes, one slice each
+            batch = reserve_dispatch_batch(batch, simulator->dispatch_batch);
+            unsigned int n = 0;
+            do {
+                // A lock-free kill may have terminated the process since it was popped
+                batch->chunks[n] = lookup_process(simulator, task_id, &batch->slots[n]);
+                if (!transition_pcb(batch->chunks[n], batch->slots[n], ready, running, 0)) {
+                    continue;
+                }
+                charge_share_locked(simulator, batch->chunks[n], batch->slots[n], TIME_SLICE_LENGTH);
+                batch->codes[n] = simulator->programs[batch->chunks[n]->program[batch->slots[n]]];
+                batch->PCs[n] = batch->chunks[n]->PC[batch->slots[n]];
+                batch->passes[n] = pass;
+                n++;
+            } while (n < simulator->dispatch_batch && (task_id = ready_pop_locked(simulator, &pass, core)));
+            if (n == 0) {
+                release_core_locked(simulator, core, 0);
+                continue;
+            }
+
+            PROFILED_UNLOCK(&simulator->process_mutex);
+
+            unsigned long long const slice_start = monotonic_ns();
+            evaluator_evaluate_batch(batch->codes, batch->PCs, n, batch->results);
+            unsigned long long const slice_end = monotonic_ns();
+            busy_ns += slice_end - slice_start;
+            if (simulator->tracing) {
+                trace_slice_event("batch", slice_start, slice_end, 0, n, NULL);
+            }
+            for (unsigned int i = 0; i < n; i++) {
+                batch->exchanged[i] = exchange_unlocked(simulator, batch->chunks[i], batch->slots[i], &batch->results[i]);
+            }
+
+            PROFILED_LOCK(&simulator->process_mutex);
+            stats_add(stats_lock_wait_ns, monotonic_ns() - slice_end);
+            stats_add(stats_dispatches, 1);
+            account_busy_locked(simulator, slice_end - slice_start);
+
+            simulator->total_dispatches++;
+            unsigned long long batch_used = 0;
+            for (unsigned int i = 0; i < n; i++) {
+                simulator->total_slices += slices_used(batch->results[i].cpu_time);
+                unsigned long long const used = batch->results[i].cpu_time +
+                                                enter_core_locked(simulator, batch->chunks[i], batch->slots[i], core);
+                batch_used += used;
+                simulator->total_cpu_time += used;
+                // Batches run a single slice whatever the quantum level, so they leave it alone
+                complete_slice_locked(simulator, batch->chunks[i], batch->slots[i], batch->results[i], TIME_SLICE_LENGTH,
+                                      false, batch->passes[i], used, batch->exchanged[i]);
+            }
+            release_core_locked(simulator, core, batch_used);
+            continue;
+        }
+
+        unsigned int slot;
+        ProcessChunkT* chunk = lookup_process(simulator, task_id, &slot);
+        if (!transition_pcb(chunk, slot, ready, running, 0)) {
+            release_core_locked(simulator, core, 0);
+            continue;
+        }
+
+        // Run from a private copy so the slice writes nothing shared
+        EvaluatorCodeT const code = simulator->programs[chunk->program[slot]];
+        unsigned int const PC = chunk->PC[slot];
+        unsigned int const quantum = simulator->adaptive_quantum ? pcb_quantum(chunk, slot) : TIME_SLICE_LENGTH;
+        charge_share_locked(simulator, chunk, slot, quantum);
+        unsigned int const epoch = atomic_load_explicit(&simulator->kill_epoch, memory_order_acquire);
+        unsigned int const coalesce_slices = simulator->coalesce_slices;
+
+        PROFILED_UNLOCK(&simulator->process_mutex);
+
+        unsigned long long const slice_start = monotonic_ns();
+        EvaluatorResultT result = evaluator_evaluate_quantum(code, PC, quantum);
+        unsigned long long cpu_time = result.cpu_time;
+
+        unsigned long long call_start = slice_start;
+        if (simulator->tracing) {
+            unsigned long long const now = monotonic_ns();
+            trace_slice_event("slice", call_start, now, task_id, PC, reason_names[result.reason]);
+            call_start = now;
+        }
+
+        // Keep running the same process while nobody else is waiting for a
+        // worker and no kill has been requested since it was dispatched
+        for (unsigned int run = 1;
+             run < coalesce_slices && result.reason == reason_timeslice_ended &&
+             ready_length(simulator) == 0 &&
+             atomic_load_explicit(&simulator->kill_epoch, memory_order_acquire) == epoch &&
+             simulator->active;
+             run++) {
+            stats_add(stats_slices_timeslice, 1);
+            unsigned int const resumed_PC = result.PC;
+            result = evaluator_evaluate_quantum(code, resumed_PC, quantum);
+            cpu_time += result.cpu_time;
+
+            if (simulator->tracing) {
+                unsigned long long const now = monotonic_ns();
+                trace_slice_event("slice", call_start, now, task_id, resumed_PC, reason_names[result.reason]);
+                call_start = now;
+            }
+        }
+        bool const exchanged = exchange_unlocked(simulator, chunk, slot, &result);
+        unsigned long long const slice_end = monotonic_ns();
+        busy_ns += slice_end - slice_start;
+
+        PROFILED_LOCK(&simulator->process_mutex);
+        stats_add(stats_lock_wait_ns, monotonic_ns() - slice_end);
+        stats_add(stats_dispatches, 1);
+        account_busy_locked(simulator, slice_end - slice_start);
+
+        simulator->total_slices += slices_used(cpu_time);
+        // A slice on a core the process did not last run on costs a cache refill
+        cpu_time += enter_core_locked(simulator, chunk, slot, core);
+        simulator->total_dispatches++;
+        simulator->total_cpu_time += cpu_time;
+
+        complete_slice_locked(simulator, chunk, slot, result, quantum, simulator->adaptive_quantum, pass, cpu_time, exchanged);
+        release_core_locked(simulator, core, cpu_time);
+    }
+
+    simulator->active_workers--;
+    simulator->worker_slots[thread_id] = slot_exited;
+    PROFILED_UNLOCK(&simulator->process_mutex);
+
+    free_dispatch_batch(batch);
+
+    unsigned long long const lifetime = monotonic_ns() - started;
+    sprintf(log_buffer, "Thread %d stopping, busy %.1f%% of %.3fs.", thread_id,
+            lifetime ? 100.0 * busy_ns / lifetime : 0.0, lifetime / 1e9);
+    logger_write(log_buffer);
+    return NULL;
+}
+
+// A fiber worker's state, shared by its fibers
+typedef struct FiberWorker {
+    SimulatorT* simulator;
+    unsigned long long idle_ns;     // Spent with every fiber parked
+    unsigned long long busy_since;  // When the thread last stopped idling
+    bool retired;                   // Left the pool, fibers exit after their slice
+} FiberWorkerT;
+
+static void fiber_evaluator_sleep(void* context, unsigned int microseconds) {
+    (void)context;
+    fiber_sleep(microseconds);
+}
+
+// Whether a fiber worker's fibers should exit, retiring the worker if the
+// pool maximum was lowered below the running workers - caller holds process_mutex
+static bool fiber_worker_leaving_locked(FiberWorkerT* worker) {
+    SimulatorT* simulator = worker->simulator;
+    if (!worker->retired && simulator->active_workers > simulator->max_threads) {
+        worker->retired = true;
+        simulator->active_workers--;
+    }
+    return !simulator->active || worker->retired;
+}
+
+// One fiber of a fiber worker: the single-process dispatch loop, parking
+// the fiber rather than the thread while nothing is ready
+static void fiber_dispatch_routine(void* argument) {
+    FiberWorkerT* worker = (FiberWorkerT*)argument;
+    SimulatorT* simulator = worker->simulator;
+
+    PROFILED_LOCK(&simulator->process_mutex);
+    while (!fiber_worker_leaving_locked(worker)) {
+        drain_releases_locked(simulator);
+        unsigned long long pass;
+        unsigned int core;
+        ProcessIdT task_id = dispatch_pop_locked(simulator, &pass, &core);
+        if (!task_id) {
+            // Never switch fibers holding the lock, the next fiber would take it again
+            PROFILED_UNLOCK(&simulator->process_mutex);
+            fiber_park();
+            PROFILED_LOCK(&simulator->process_mutex);
+            continue;
+        }
+        if (simulator->tracing) {
+            trace_queue_counter(ready_length(simulator), simulator->blocked_queue.length);
+        }
+
+        unsigned int slot;
+        ProcessChunkT* chunk = lookup_process(simulator, task_id, &slot);
+        if (!transition_pcb(chunk, slot, ready, running, 0)) {
+            release_core_locked(simulator, core, 0);
+            continue;
+        }
+        EvaluatorCodeT const code = simulator->programs[chunk->program[slot]];
+        unsigned int const PC = chunk->PC[slot];
+        unsigned int const quantum = simulator->adaptive_quantum ? pcb_quantum(chunk, slot) : TIME_SLICE_LENGTH;
+        charge_share_locked(simulator, chunk, slot, quantum);
+        bool const more = work_claimable_locked(simulator);
+
+        PROFILED_UNLOCK(&simulator->process_mutex);
+
+        // More is ready, so another parked fiber of this worker can take it
+        if (more) {
+            fiber_unpark(1);
+        }
+        unsigned long long const slice_start = monotonic_ns();
+        EvaluatorResultT result = evaluator_evaluate_quantum(code, PC, quantum);
+        unsigned long long const slice_end = monotonic_ns();
+        if (simulator->tracing) {
+            trace_slice_event("slice", slice_start, slice_end, task_id, PC, reason_names[result.reason]);
+        }
+        bool const exchanged = exchange_unlocked(simulator, chunk, slot, &result);
+
+        PROFILED_LOCK(&simulator->process_mutex);
+        stats_add(stats_lock_wait_ns, monotonic_ns() - slice_end);
+        stats_add(stats_dispatches, 1);
+
+        unsigned long long const used = result.cpu_time + enter_core_locked(simulator, chunk, slot, core);
+        simulator->total_dispatches++;
+        simulator->total_slices += slices_used(result.cpu_time);
+        simulator->total_cpu_time += used;
+
+        complete_slice_locked(simulator, chunk, slot, result, quantum, simulator->adaptive_quantum, pass, used, exchanged);
+        release_core_locked(simulator, core, used);
+    }
+    PROFILED_UNLOCK(&simulator->process_mutex);
+
+    // The rest of the worker's fibers are leaving too
+    fiber_unpark(UINT_MAX);
+}
+
+// Called by the fiber scheduler when every fiber that is not asleep is
+// parked. Parks the thread until work arrives or the earliest sleeper is
+// due; above the pool minimum, a worker with no sleepers retires after a
+// quiet period, or at once while the pool is mostly idle. Returns how many
+// parked fibers to resume.
+static unsigned int fiber_worker_idle(void* context, unsigned int parked, unsigned long long wake_ns) {
+    FiberWorkerT* worker = (FiberWorkerT*)context;
+    SimulatorT* simulator = worker->simulator;
+    unsigned long long const idle_start = monotonic_ns();
+
+    PROFILED_LOCK(&simulator->process_mutex);
+    drain_releases_locked(simulator);
+    // Fibers overlap, so the thread counts as busy whenever it is not idling here
+    account_busy_locked(simulator, idle_start - worker->busy_since);
+    if (!fiber_worker_leaving_locked(worker) && !work_claimable_locked(simulator) && !wake_ns &&
+        underused_locked(simulator)) {
+        worker->retired = true;
+        simulator->active_workers--;
+    }
+    if (!fiber_worker_leaving_locked(worker) && !work_claimable_locked(simulator)) {
+        unsigned long long wait_ns = SIMULATOR_IDLE_TIMEOUT_MS * 1000000ULL;
+        if (wake_ns) {
+            unsigned long long const due_ns = wake_ns > idle_start ? wake_ns - idle_start : 0;
+            wait_ns = due_ns < wait_ns ? due_ns : wait_ns;
+        }
+        // The work condition times out on the realtime clock
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += wait_ns % 1000000000ULL;
+        deadline.tv_sec += wait_ns / 1000000000ULL + deadline.tv_nsec / 1000000000L;
+        deadline.tv_nsec %= 1000000000L;
+
+        simulator->parked_workers++;
+        int const waited = PROFILED_TIMEDWAIT(&simulator->work_condition, &simulator->process_mutex, &deadline);
+        simulator->parked_workers--;
+
+        if (waited == ETIMEDOUT && !wake_ns && simulator->active_workers > simulator->min_threads &&
+            ready_length(simulator) == 0) {
+            worker->retired = true;
+            simulator->active_workers--;
+        }
+    }
+    // Ready processes on running simulated cores are no use to a fiber
+    unsigned long const ready = work_claimable_locked(simulator) ? ready_length(simulator) : 0;
+    unsigned int const resume = fiber_worker_leaving_locked(worker) || ready > parked ? parked : (unsigned int)ready;
+    PROFILED_UNLOCK(&simulator->process_mutex);
+
+    worker->busy_since = monotonic_ns();
+    worker->idle_ns += worker->busy_since - idle_start;
+    return resume;
+}
+
+// Worker thread function in fiber mode. Evaluator sleeps suspend the
+// calling fiber, and the thread runs whichever fiber is ready next.
+static void* fiber_worker_routine(void* arg) {
+    SimulatorT* simulator = ((WorkerArgumentT*)arg)->simulator;
+    int thread_id = ((WorkerArgumentT*)arg)->thread_id;
+    free(arg);
+
+    char log_buffer[128];
+    sprintf(log_buffer, "Thread %d started with %u fibers.", thread_id, simulator->fibers_per_worker);
+    logger_write(log_buffer);
+    sprintf(log_buffer, "worker %d", thread_id);
+    if (simulator->tracing) {
+        trace_name_thread(log_buffer);
+    }
+
+    unsigned long long const started = monotonic_ns();
+    FiberWorkerT worker = { .simulator = simulator, .idle_ns = 0, .busy_since = started, .retired = false };
+
+    FiberSchedulerT* scheduler = fiber_scheduler_create(SIMULATOR_FIBER_STACK_SIZE);
+    unsigned int fibers = 0;
+    while (fibers < simulator->fibers_per_worker && fiber_spawn(scheduler, fiber_dispatch_routine, &worker)) {
+        fibers++;
+    }
+    if (fibers < simulator->fibers_per_worker) {
+        sprintf(log_buffer, "Thread %d could only start %u fibers.", thread_id, fibers);
+        logger_write(log_buffer);
+    }
+    evaluator_set_sleep_hook(fiber_evaluator_sleep, NULL);
+    fiber_scheduler_run(scheduler, fiber_worker_idle, &worker);
+    evaluator_set_sleep_hook(NULL, NULL);
+    fiber_scheduler_destroy(scheduler);
+
+    PROFILED_LOCK(&simulator->process_mutex);
+    if (!worker.retired) {
+        simulator->active_workers--;
+    }
+    simulator->worker_slots[thread_id] = slot_exited;
+    PROFILED_UNLOCK(&simulator->process_mutex);
+
+    unsigned long long const lifetime = monotonic_ns() - started;
+    sprintf(log_buffer, "Thread %d stopping, busy %.1f%% of %.3fs.", thread_id,
+            lifetime ? 100.0 * (lifetime - worker.idle_ns) / lifetime : 0.0, lifetime / 1e9);
+    logger_write(log_buffer);
+    return NULL;
+}
+
+
+
+// Turn an unallocated PCB into a ready process - caller holds process_mutex
+static ProcessIdT claim_process_locked(SimulatorT* simulator, ProcessChunkT* chunk, unsigned int slot, unsigned char program,
+                                       unsigned char share, unsigned long long deadline) {
+    chunk->program[slot] = program;
+    simulator->program_refs[program]++;
+    chunk->share[slot] = share;
+    if (chunk->deadline) {
+        chunk->deadline[slot] = deadline;
+    }
+    chunk->PC[slot] = 0;
+    if (chunk->core) {
+        chunk->core[slot] = CORE_NONE;
+    }
+    if (chunk->affinity) {
+        chunk->affinity[slot] = 0;
+    }
+    // Marked queued in the same store, so a reap never releases it before it is linked
+    atomic_store_explicit(&chunk->flags[slot], ready | PCB_QUEUED, memory_order_release);
+    chunk->live++;
+    simulator->free_pcbs--;
+    update_occupancy_locked(simulator);
 
-// Initialize simulator resources
-void simulator_start(int threads, int max_processes) {
-    total_threads = threads;
-    simulator_active = true;
+    ready_push_locked(simulator, chunk, slot, join_pass_locked(simulator, chunk, slot));
+    return chunk->base_pid + slot;
+}
 
-    // Allocate and initialize resources
-    processes = (ProcessControlBlock*)malloc(sizeof(ProcessControlBlock) * max_processes);
-    task_queue = list_create();
-    blocked_queue = list_create();  // Initialize blocked queue
+// First unallocated PCB at or after slot *cursor, growing the table when
+// every allocated chunk is full. NULL if the table could not grow - caller holds process_mutex
+static ProcessChunkT* find_free_pcb_locked(SimulatorT* simulator, unsigned int const* cursor, unsigned int* slot) {
+    if (simulator->free_pcbs > 0) {
+        for (unsigned int index = *cursor / PROCESS_CHUNK_SIZE; index < simulator->chunk_slots; index++) {
+            ProcessChunkT* chunk = simulator->process_chunks[index];
+            if (!chunk || chunk->live == PROCESS_CHUNK_SIZE) {
+                continue;
+            }
+            unsigned int first = index == *cursor / PROCESS_CHUNK_SIZE ? *cursor % PROCESS_CHUNK_SIZE : 0;
+            for (unsigned int i = first; i < PROCESS_CHUNK_SIZE; i++) {
+                if (pcb_state(chunk, i) == unallocated) {
+                    *slot = i;
+                    return chunk;
+                }
+            }
+        }
+    }
 
-    if (!processes || !task_queue || !blocked_queue) {
-        fprintf(stderr, "Error: Unable to allocate resources for simulator.\n");
-        exit(EXIT_FAILURE);
+    // Nothing free past the cursor: refill the first released chunk, or append one
+    unsigned int index = 0;
+    while (index < simulator->chunk_slots && simulator->process_chunks[index]) {
+        index++;
     }
+    *slot = 0;
+    return allocate_chunk_locked(simulator, index);
+}
 
-    for (unsigned int i = 0; i < max_processes; i++) {
-        processes[i].pid = i + 1;  
-        processes[i].state = unallocated;
+// Claim a PCB for a new process, with an absolute deadline or 0 for none.
+// *cursor is where the search for a free PCB starts and is left at the PID
+// claimed - caller holds process_mutex
+static ProcessIdT allocate_process_locked(SimulatorT* simulator, EvaluatorCodeT const code, unsigned char share,
+                                          unsigned long long deadline, unsigned int* cursor) {
+    drain_releases_locked(simulator);
+    if (simulator->max_live && live_processes_locked(simulator) >= simulator->max_live) {
+        return 0;
+    }
+    int const program = intern_program_locked(simulator, code);
+    if (program < 0 || !reserve_ready_locked(simulator, share, deadline)) {
+        return 0;
     }
-    max_tasks = max_processes;
 
-    pthread_mutex_init(&process_mutex, NULL);
-    pthread_cond_init(&process_condition, NULL);
+    unsigned int slot;
+    ProcessChunkT* chunk = find_free_pcb_locked(simulator, cursor, &slot);
+    if (chunk && deadline && !chunk->deadline) {
+        chunk->deadline = (unsigned long long*)calloc(PROCESS_CHUNK_SIZE, sizeof(unsigned long long));
+    }
+    if (!chunk || (deadline && !chunk->deadline)) {
+        unreserve_ready_locked(simulator, share, deadline);
+        return 0;
+    }
+    *cursor = chunk->base_pid + slot;
+    return claim_process_locked(simulator, chunk, slot, program, share, deadline);
+}
 
-    worker_threads = (pthread_t*)malloc(sizeof(pthread_t) * total_threads);
-    if (!worker_threads) {
-        fprintf(stderr, "Error: Unable to allocate memory for threads.\n");
-        exit(EXIT_FAILURE);
+// Wait until the creator self may claim a PCB, queueing it behind older
+// creators on first need. A timeout of 0 never waits, a negative one waits
+// indefinitely. Returns false on timeout - caller holds process_mutex
+static bool admit_locked(SimulatorT* simulator, AdmissionWaiterT* self, bool* queued, long timeout_ms,
+                         struct timespec const* give_up) {
+    for (;;) {
+        drain_releases_locked(simulator);
+        if (admission_open_locked(simulator, *queued ? self : NULL)) {
+            return true;
+        }
+        if (timeout_ms == 0) {
+            return false;
+        }
+        if (!*queued) {
+            pthread_cond_init(&self->condition, NULL);
+            self->next = NULL;
+            if (simulator->admission_tail) {
+                simulator->admission_tail->next = self;
+            } else {
+                simulator->admission_head = self;
+            }
+            simulator->admission_tail = self;
+            atomic_fetch_add(&simulator->admission_waiting, 1);
+            *queued = true;
+            continue;
+        }
+        int const waited = timeout_ms < 0 ? PROFILED_WAIT(&self->condition, &simulator->process_mutex)
+                                          : PROFILED_TIMEDWAIT(&self->condition, &simulator->process_mutex, give_up);
+        if (waited == ETIMEDOUT) {
+            drain_releases_locked(simulator);
+            if (admission_open_locked(simulator, self)) {
+                return true;
+            }
+            simulator->admission_timeouts++;
+            return false;
+        }
     }
+}
 
-    for (int i = 0; i < total_threads; i++) {
-        int* thread_id = (int*)malloc(sizeof(int));
-        *thread_id = i;
-        if (pthread_create(&worker_threads[i], NULL, simulator_routine, thread_id) != 0) {
-            fprintf(stderr, "Error: Failed to create thread %d\n", i);
-            exit(EXIT_FAILURE);
+// Leave the admission queue, handing the head on - caller holds process_mutex
+static void leave_admission_locked(SimulatorT* simulator, AdmissionWaiterT* self) {
+    AdmissionWaiterT* pred = NULL;
+    for (AdmissionWaiterT* waiter = simulator->admission_head; waiter != self; waiter = waiter->next) {
+        pred = waiter;
+    }
+    if (pred) {
+        pred->next = self->next;
+    } else {
+        simulator->admission_head = self->next;
+    }
+    if (simulator->admission_tail == self) {
+        simulator->admission_tail = pred;
+    }
+    atomic_fetch_sub(&simulator->admission_waiting, 1);
+    pthread_cond_destroy(&self->condition);
+    if (!pred && simulator->admission_head) {
+        pthread_cond_signal(&simulator->admission_head->condition);
+    }
+}
+
+// Kick waiting creators after wait reaped processes without process_mutex,
+// since those PCBs are only released by its next holder
+static void admit_after_reap(SimulatorT* simulator) {
+    if (atomic_load(&simulator->admission_waiting) > 0 &&
+        atomic_load_explicit(&simulator->pending_releases, memory_order_relaxed)) {
+        PROFILED_LOCK(&simulator->process_mutex);
+        drain_releases_locked(simulator);
+        PROFILED_UNLOCK(&simulator->process_mutex);
+    }
+}
+
+// Create n processes in one critical section, with relative deadlines when
+// deadlines is not NULL, waiting up to timeout_ms for admission as
+// admit_locked does. Returns how many were created.
+static unsigned int create_processes(SimulatorT* simulator, EvaluatorCodeT const* codes,
+                                     unsigned long long const* deadlines, unsigned int n, ProcessIdT* pids,
+                                     long timeout_ms) {
+    unsigned int created = 0;
+    unsigned int cursor = 0;
+    AdmissionWaiterT self;
+    bool queued = false;
+    struct timespec give_up;
+    if (timeout_ms > 0) {
+        clock_gettime(CLOCK_REALTIME, &give_up);
+        give_up.tv_sec += timeout_ms / 1000;
+        give_up.tv_nsec += (timeout_ms % 1000) * 1000000L;
+        give_up.tv_sec += give_up.tv_nsec / 1000000000L;
+        give_up.tv_nsec %= 1000000000L;
+    }
+
+    PROFILED_LOCK(&simulator->process_mutex);
+
+    unsigned long long const now = deadlines ? deadline_now_locked(simulator) : 0;
+    unsigned int i = 0;
+    for (; i < n && admit_locked(simulator, &self, &queued, timeout_ms, &give_up); i++) {
+        unsigned long long const deadline = deadlines && deadlines[i] ? now + deadlines[i] : 0;
+        pids[i] = allocate_process_locked(simulator, codes[i], 0, deadline, &cursor);
+        if (pids[i]) {
+            created++;
+            // Waking a worker per admission lets a waiting batch make progress
+            if (queued) {
+                notify_work_locked(simulator, 1);
+            }
+        }
+    }
+    for (; i < n; i++) {
+        pids[i] = 0;
+    }
+    if (queued) {
+        leave_admission_locked(simulator, &self);
+    } else {
+        notify_work_locked(simulator, created);
+    }
+    stats_add(stats_creates, created);
+
+    PROFILED_UNLOCK(&simulator->process_mutex);
+    return created;
+}
+
+// Create a new process
+ProcessIdT simulator_create_process(SimulatorT* simulator, EvaluatorCodeT const code) {
+    ProcessIdT pid;
+    create_processes(simulator, &code, NULL, 1, &pid, 0);
+    return pid;
+}
+
+ProcessIdT simulator_create_process_timed(SimulatorT* simulator, EvaluatorCodeT const code, long timeout_ms) {
+    ProcessIdT pid;
+    create_processes(simulator, &code, NULL, 1, &pid, timeout_ms);
+    return pid;
+}
+
+// Add a share group for processes created with simulator_create_shared_process
+int simulator_share_group_create(SimulatorT* simulator, char const* name, unsigned int tickets) {
+    PROFILED_LOCK(&simulator->process_mutex);
+    int const group = stride_add_group(&simulator->stride, name, tickets ? tickets : SIMULATOR_DEFAULT_TICKETS);
+    PROFILED_UNLOCK(&simulator->process_mutex);
+    return group;
+}
+
+// Create a process holding tickets within a share group
+ProcessIdT simulator_create_shared_process(SimulatorT* simulator, EvaluatorCodeT const code, int group, unsigned int tickets) {
+    PROFILED_LOCK(&simulator->process_mutex);
+
+    ProcessIdT pid = 0;
+    if (group >= 0 && (unsigned int)group < simulator->stride.group_count) {
+        int const share = intern_share_locked(simulator, group, tickets ? tickets : SIMULATOR_DEFAULT_TICKETS);
+        unsigned int cursor = 0;
+        if (share >= 0 && admission_open_locked(simulator, NULL)) {
+            pid = allocate_process_locked(simulator, code, share, 0, &cursor);
         }
     }
+    notify_work_locked(simulator, pid ? 1 : 0);
+    stats_add(stats_creates, pid ? 1 : 0);
+
+    PROFILED_UNLOCK(&simulator->process_mutex);
+    return pid;
 }
 
-// Main worker thread function
-void* simulator_routine(void* arg) {
-    int thread_id = *(int*)arg;
-    free(arg);
+unsigned int simulator_create_processes(SimulatorT* simulator, EvaluatorCodeT const* codes, unsigned int n, ProcessIdT* pids) {
+    return create_processes(simulator, codes, NULL, n, pids, 0);
+}
 
-    char log_buffer[128];
-    sprintf(log_buffer, "Thread %d started.", thread_id);
-    logger_write(log_buffer);
+unsigned int simulator_create_processes_timed(SimulatorT* simulator, EvaluatorCodeT const* codes, unsigned int n,
+                                              ProcessIdT* pids, long timeout_ms) {
+    return create_processes(simulator, codes, NULL, n, pids, timeout_ms);
+}
+
+ProcessIdT simulator_create_deadline_process(SimulatorT* simulator, EvaluatorCodeT const code, unsigned long long relative_deadline) {
+    ProcessIdT pid;
+    create_processes(simulator, &code, &relative_deadline, 1, &pid, 0);
+    return pid;
+}
+
+unsigned int simulator_create_deadline_processes(SimulatorT* simulator, EvaluatorCodeT const* codes,
+                                                 unsigned long long const* relative_deadlines, unsigned int n, ProcessIdT* pids) {
+    return create_processes(simulator, codes, relative_deadlines, n, pids, 0);
+}
+
+// Occupancy since simulator_start or the last simulator_reconfigure
+SimulatorOccupancyT simulator_occupancy(SimulatorT* simulator) {
+    PROFILED_LOCK(&simulator->process_mutex);
+    drain_releases_locked(simulator);
+    SimulatorOccupancyT occupancy = {
+        .live = live_processes_locked(simulator),
+        .capacity = simulator->max_live,
+        .peak = simulator->peak_live,
+        .waiting = atomic_load(&simulator->admission_waiting),
+        .timeouts = simulator->admission_timeouts,
+        .throttled = atomic_load(&simulator->throttled),
+    };
+    PROFILED_UNLOCK(&simulator->process_mutex);
+    return occupancy;
+}
+
+bool simulator_throttled(SimulatorT* simulator) {
+    return atomic_load_explicit(&simulator->throttled, memory_order_relaxed);
+}
+
+// True once pid has finished, reaping its PCB - caller is between
+// enter_lockfree and exit_lockfree. Unknown and already reaped PIDs count as finished.
+static bool reap_if_terminated(SimulatorT* simulator, ProcessIdT pid) {
+    unsigned int slot;
+    ProcessChunkT* chunk = lookup_process(simulator, pid, &slot);
+    if (!chunk) {
+        return true;
+    }
+    unsigned char flags = atomic_load(&chunk->flags[slot]);
+    do {
+        if ((flags & PCB_STATE_MASK) == unallocated || (flags & PCB_REAPED)) {
+            return true;
+        }
+        if ((flags & PCB_STATE_MASK) != terminated) {
+            return false;
+        }
+    } while (!atomic_compare_exchange_weak(&chunk->flags[slot], &flags, flags | PCB_REAPED));
+
+    // A PCB still linked into a queue is released when it is unlinked
+    if (!(flags & PCB_QUEUED)) {
+        defer_release(simulator, chunk, slot);
+    }
+    return true;
+}
 
-    while (simulator_active) {
-        pthread_mutex_lock(&process_mutex);
+// Wait for a process to complete and reap it
+void simulator_wait(SimulatorT* simulator, ProcessIdT pid) {
+    enter_lockfree(simulator);
 
-        // Stop if there are no tasks left to process
-        if (list_empty(task_queue) && list_empty(blocked_queue)) {
-            pthread_mutex_unlock(&process_mutex);
-            break;  // Exit the loop if no tasks are left
+    if (!reap_if_terminated(simulator, pid)) {
+        // Counted before the recheck, so a termination either sees this
+        // waiter or is seen by the recheck under wait_mutex
+        atomic_fetch_add(&simulator->waiters, 1);
+        PROFILED_LOCK(&simulator->wait_mutex);
+        while (!reap_if_terminated(simulator, pid)) {
+            PROFILED_WAIT(&simulator->wait_condition, &simulator->wait_mutex);
         }
+        PROFILED_UNLOCK(&simulator->wait_mutex);
+        atomic_fetch_sub(&simulator->waiters, 1);
+    }
+
+    exit_lockfree(simulator);
+    admit_after_reap(simulator);
+}
+
+// Wait for every process in pids to complete and reap them
+void simulator_wait_many(SimulatorT* simulator, ProcessIdT const* pids, unsigned int n) {
+    enter_lockfree(simulator);
 
-        ProcessIdT task_id = 0;
-        if (!list_empty(task_queue)) {
-            task_id = list_pop_front(task_queue);
-        } else if (!list_empty(blocked_queue)) {
-            task_id = list_pop_front(blocked_queue); // Get a blocked process
+    // Reaped processes stay finished, so resume from the first one still running
+    unsigned int i = 0;
+    while (i < n && reap_if_terminated(simulator, pids[i])) {
+        i++;
+    }
+    if (i < n) {
+        atomic_fetch_add(&simulator->waiters, 1);
+        PROFILED_LOCK(&simulator->wait_mutex);
+        while (i < n) {
+            if (reap_if_terminated(simulator, pids[i])) {
+                i++;
+            } else {
+                PROFILED_WAIT(&simulator->wait_condition, &simulator->wait_mutex);
+            }
         }
+        PROFILED_UNLOCK(&simulator->wait_mutex);
+        atomic_fetch_sub(&simulator->waiters, 1);
+    }
+
+    exit_lockfree(simulator);
+    admit_after_reap(simulator);
+}
+
+// Bytes held by the process table, run queues included
+size_t simulator_table_bytes(SimulatorT* simulator) {
+    PROFILED_LOCK(&simulator->process_mutex);
+    drain_releases_locked(simulator);
+    size_t bytes = (size_t)simulator->allocated_chunks * sizeof(ProcessChunkT) +
+                   (size_t)simulator->chunk_slots * sizeof(ChunkPointerT) +
+                   sizeof(simulator->programs);
+    PROFILED_UNLOCK(&simulator->process_mutex);
+    return bytes;
+}
 
-        ProcessControlBlock* process = &processes[task_id - 1];
-        process->state = running;
+// Checkpoint images. Every section starts on a cache line and is found by its
+// offset from the start of the image, so nothing depends on where the file is
+// mapped. Table columns, queue links - which are PIDs - and heaps are saved as
+// they are held in memory, so a restore copies whole arrays out of the
+// mapping instead of decoding records. Code is saved by evaluator kind, with
+// the instructions of bytecode programs embedded.
 
-        pthread_mutex_unlock(&process_mutex);
+#define SNAPSHOT_MAGIC "OSIMSNAP"
+#define SNAPSHOT_VERSION 1
 
-        EvaluatorResultT result = evaluator_evaluate(process->code, process->PC);
-        process->PC = result.PC;
+typedef struct SnapshotProgram {
+    uint32_t kind;          // EvaluatorKindT
+    uint32_t parameter;     // Instruction count for bytecode programs
+    uint64_t instructions;  // Offset of a bytecode program's instructions
+} SnapshotProgramT;
 
-        pthread_mutex_lock(&process_mutex);
+typedef struct SnapshotShareClass {
+    uint32_t group;
+    uint32_t tickets;
+    uint64_t stride;
+} SnapshotShareClassT;
 
-        if (result.reason == reason_terminated) {
-            process->state = terminated;
-            pthread_cond_broadcast(&process_condition);
-        } else if (result.reason == reason_timeslice_ended) {
-            process->state = ready;
-            list_append(task_queue, task_id);
-        } else if (result.reason == reason_blocked) {
-            process->state = blocked;
-            list_append(blocked_queue, task_id); // Add to blocked queue
+typedef struct SnapshotGroup {
+    char name[32];
+    uint32_t tickets;
+    uint32_t position;
+    uint64_t stride;
+    uint64_t pass;
+    uint64_t virtual_pass;
+    uint64_t usage;
+    uint64_t length;   // Ready entries
+    uint64_t members;  // Live processes the heap reserves room for
+    uint64_t entries;  // Offset of length HeapEntryT
+} SnapshotGroupT;
+
+typedef struct SnapshotChunk {
+    uint32_t index;  // Position in the chunk directory
+    uint32_t live;
+    // Column offsets, deadline 0 for a chunk without deadlines
+    uint64_t flags;
+    uint64_t PC;
+    uint64_t next;
+    uint64_t program;
+    uint64_t share;
+    uint64_t deadline;
+} SnapshotChunkT;
+
+typedef struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t chunk_size;     // PROCESS_CHUNK_SIZE of the build that wrote it
+    uint32_t entry_size;     // sizeof(HeapEntryT) likewise
+    uint32_t stride_scheduling;
+    uint32_t deadline_real_time;
+    uint32_t program_count;
+    uint32_t share_class_count;
+    uint32_t group_count;
+    uint32_t order_length;
+    uint32_t chunk_count;
+    uint32_t in_flight_count;  // PIDs that were mid-slice, requeued on restore
+    uint32_t task_head;
+    uint32_t task_tail;
+    uint32_t blocked_head;
+    uint32_t blocked_tail;
+    uint64_t task_length;
+    uint64_t blocked_length;
+    uint64_t stride_virtual_pass;
+    uint64_t deadline_length;
+    uint64_t deadline_members;
+    uint64_t clock;            // deadline_now_locked when written
+    uint64_t virtual_time;
+    uint64_t slices;
+    uint64_t dispatches;
+    uint64_t cpu_time;
+    uint64_t deadlines_met;
+    uint64_t deadlines_missed;
+    uint64_t deadlines_dropped;
+    uint64_t lateness_histogram[SIMULATOR_LATENESS_BUCKETS];
+    // Section offsets
+    uint64_t programs;
+    uint64_t share_classes;
+    uint64_t groups;
+    uint64_t deadline_entries;
+    uint64_t chunks;
+    uint64_t in_flight;
+    uint64_t size;             // Bytes in the whole image
+} SnapshotHeaderT;
+
+// An image being built in memory
+typedef struct SnapshotImage {
+    unsigned char* bytes;
+    size_t size;
+    size_t capacity;
+    bool failed;
+} SnapshotImageT;
+
+// Append bytes from data, or zeroes if it is NULL, at the next cache line.
+// Returns their offset. Pointers into the image are invalidated.
+static uint64_t image_append(SnapshotImageT* image, void const* data, size_t bytes) {
+    size_t const offset = (image->size + CACHE_LINE_SIZE - 1) & ~(size_t)(CACHE_LINE_SIZE - 1);
+    if (offset + bytes > image->capacity) {
+        size_t capacity = image->capacity ? image->capacity : 1 << 16;
+        while (capacity < offset + bytes) {
+            capacity *= 2;
         }
+        unsigned char* bytes_grown = (unsigned char*)realloc(image->bytes, capacity);
+        if (!bytes_grown) {
+            image->failed = true;
+            return 0;
+        }
+        // Padding is zeroed so equal states give equal images
+        memset(bytes_grown + image->capacity, 0, capacity - image->capacity);
+        image->bytes = bytes_grown;
+        image->capacity = capacity;
+    }
+    if (data) {
+        memcpy(image->bytes + offset, data, bytes);
+    }
+    image->size = offset + bytes;
+    return offset;
+}
 
-        pthread_mutex_unlock(&process_mutex);
+// The bytes at offset, or NULL if they run past the end of the image
+static void const* image_at(unsigned char const* base, size_t size, uint64_t offset, uint64_t bytes) {
+    if (offset > size || bytes > size - offset) {
+        return NULL;
     }
+    return base + offset;
+}
 
-    sprintf(log_buffer, "Thread %d stopping.", thread_id);
-    logger_write(log_buffer);
-    return NULL;
+// What a checkpoint learns while it copies the table
+typedef struct SnapshotScan {
+    ProcessIdT* in_flight;  // Processes mid-slice
+    unsigned int in_flight_count;
+    unsigned int in_flight_capacity;
+    unsigned long long group_members[STRIDE_MAX_GROUPS];  // Live processes per heap
+    unsigned long long deadline_members;
+} SnapshotScanT;
+
+// Save one chunk's columns. Processes mid-slice are saved as queued ready
+// processes and listed in the scan, and PCBs whose release is still pending
+// as unallocated. Counts each live process towards the heap that reserves
+// room for it - caller holds process_mutex
+static SnapshotChunkT snapshot_chunk_locked(SimulatorT* simulator, ProcessChunkT* chunk, unsigned int index,
+                                            SnapshotImageT* image, SnapshotScanT* scan) {
+    SnapshotChunkT record = { .index = index };
+    unsigned char flags[PROCESS_CHUNK_SIZE];
+    unsigned long long* deadlines = NULL;
+    if (chunk->deadline) {
+        deadlines = (unsigned long long*)malloc(sizeof(unsigned long long) * PROCESS_CHUNK_SIZE);
+        if (!deadlines) {
+            image->failed = true;
+            return record;
+        }
+        memcpy(deadlines, chunk->deadline, sizeof(unsigned long long) * PROCESS_CHUNK_SIZE);
+    }
+
+    for (unsigned int slot = 0; slot < PROCESS_CHUNK_SIZE; slot++) {
+        unsigned char flag = atomic_load(&chunk->flags[slot]);
+        if ((flag & PCB_STATE_MASK) == running) {
+            if (flag & PCB_KILL_REQUESTED) {
+                flag = (flag & ~(PCB_STATE_MASK | PCB_KILL_REQUESTED)) | terminated;
+            } else {
+                flag = (flag & ~PCB_STATE_MASK) | ready | PCB_QUEUED;
+                if (scan->in_flight_count == scan->in_flight_capacity) {
+                    unsigned int const capacity = scan->in_flight_capacity ? scan->in_flight_capacity * 2 : 16;
+                    ProcessIdT* grown = (ProcessIdT*)realloc(scan->in_flight, sizeof(ProcessIdT) * capacity);
+                    if (!grown) {
+                        image->failed = true;
+                        break;
+                    }
+                    scan->in_flight = grown;
+                    scan->in_flight_capacity = capacity;
+                }
+                scan->in_flight[scan->in_flight_count++] = chunk->base_pid + slot;
+            }
+        }
+        if ((flag & PCB_REAPED) && !(flag & PCB_QUEUED)) {
+            flag = unallocated;
+            if (deadlines) {
+                deadlines[slot] = 0;
+            }
+        }
+        flags[slot] = flag;
+        if ((flag & PCB_STATE_MASK) == unallocated) {
+            continue;
+        }
+        record.live++;
+        if (deadlines && deadlines[slot]) {
+            scan->deadline_members++;
+        } else if (simulator->stride_scheduling) {
+            scan->group_members[simulator->share_classes[chunk->share[slot]].group]++;
+        }
+    }
+
+    record.flags = image_append(image, flags, sizeof(flags));
+    record.PC = image_append(image, chunk->PC, sizeof(chunk->PC));
+    record.next = image_append(image, chunk->next, sizeof(chunk->next));
+    record.program = image_append(image, chunk->program, sizeof(chunk->program));
+    record.share = image_append(image, chunk->share, sizeof(chunk->share));
+    if (deadlines) {
+        record.deadline = image_append(image, deadlines, sizeof(unsigned long long) * PROCESS_CHUNK_SIZE);
+        free(deadlines);
+    }
+    return record;
 }
 
+// Build the image of the whole instance - caller holds process_mutex
+static bool snapshot_locked(SimulatorT* simulator, SnapshotImageT* image) {
+    SnapshotHeaderT header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.chunk_size = PROCESS_CHUNK_SIZE;
+    header.entry_size = sizeof(HeapEntryT);
+    header.stride_scheduling = simulator->stride_scheduling;
+    header.deadline_real_time = simulator->deadline_real_time;
+    image_append(image, NULL, sizeof(header));
+
+    SnapshotProgramT programs[MAX_PROGRAMS];
+    for (unsigned int i = 0; i < simulator->program_count; i++) {
+        // Entries no process holds keep only their index, whatever code they last named
+        if (!simulator->program_refs[i]) {
+            programs[i] = (SnapshotProgramT){ .kind = evaluator_kind_cpu_bound };
+            continue;
+        }
+        EvaluatorKindT const kind = evaluator_code_kind(simulator->programs[i]);
+        programs[i].kind = kind;
+        programs[i].parameter = simulator->programs[i].parameter;
+        programs[i].instructions = 0;
+        if (kind == evaluator_kind_unknown) {
+            logger_write("Cannot checkpoint a process running code from outside the evaluator.");
+            return false;
+        }
+        if (kind == evaluator_kind_program) {
+            unsigned int length;
+            EvaluatorInstructionT const* instructions =
+                evaluator_program_instructions(evaluator_code_program(simulator->programs[i]), &length);
+            programs[i].parameter = length;
+            programs[i].instructions = image_append(image, instructions, sizeof(EvaluatorInstructionT) * length);
+        }
+    }
+    header.program_count = simulator->program_count;
+    header.programs = image_append(image, programs, sizeof(SnapshotProgramT) * simulator->program_count);
 
+    SnapshotShareClassT share_classes[MAX_SHARE_CLASSES];
+    for (unsigned int i = 0; i < simulator->share_class_count; i++) {
+        share_classes[i].group = simulator->share_classes[i].group;
+        share_classes[i].tickets = simulator->share_classes[i].tickets;
+        share_classes[i].stride = simulator->share_classes[i].stride;
+    }
+    header.share_class_count = simulator->share_class_count;
+    header.share_classes = image_append(image, share_classes, sizeof(SnapshotShareClassT) * simulator->share_class_count);
 
-// Create a new process
-ProcessIdT simulator_create_process(EvaluatorCodeT const code) {
-    pthread_mutex_lock(&process_mutex);
+    // The table, counting members and processes mid-slice on the way
+    SnapshotScanT scan;
+    memset(&scan, 0, sizeof(scan));
+    SnapshotChunkT* chunks = (SnapshotChunkT*)malloc(sizeof(SnapshotChunkT) * (simulator->allocated_chunks + 1));
+    if (!chunks) {
+        return false;
+    }
+    for (unsigned int index = 0; index < simulator->chunk_slots && !image->failed; index++) {
+        ProcessChunkT* chunk = simulator->process_chunks[index];
+        if (chunk) {
+            chunks[header.chunk_count++] = snapshot_chunk_locked(simulator, chunk, index, image, &scan);
+        }
+    }
+    header.chunks = image_append(image, chunks, sizeof(SnapshotChunkT) * header.chunk_count);
+    header.in_flight_count = scan.in_flight_count;
+    header.in_flight = image_append(image, scan.in_flight, sizeof(ProcessIdT) * scan.in_flight_count);
+    free(chunks);
+    free(scan.in_flight);
 
-    for (unsigned int i = 0; i < max_tasks; i++) {
-        if (processes[i].state == unallocated) {
-            ProcessControlBlock* process = &processes[i];
-            process->pid = i + 1;
-            process->state = ready;
-            process->code = code;
-            process->PC = 0;
+    SnapshotGroupT groups[STRIDE_MAX_GROUPS];
+    for (unsigned int g = 0; g < simulator->stride.group_count; g++) {
+        StrideGroupT const* group = &simulator->stride.groups[g];
+        memset(&groups[g], 0, sizeof(groups[g]));
+        memcpy(groups[g].name, group->name, sizeof(groups[g].name));
+        groups[g].tickets = group->tickets;
+        groups[g].position = group->position;
+        groups[g].stride = group->stride;
+        groups[g].pass = group->pass;
+        groups[g].virtual_pass = group->virtual_pass;
+        groups[g].usage = group->usage;
+        groups[g].length = atomic_load(&group->ready.length);
+        groups[g].members = scan.group_members[g];
+        groups[g].entries = image_append(image, group->ready.entries, sizeof(HeapEntryT) * groups[g].length);
+    }
+    header.group_count = simulator->stride.group_count;
+    header.order_length = simulator->stride.order_length;
+    header.stride_virtual_pass = simulator->stride.virtual_pass;
+    header.groups = image_append(image, groups, sizeof(SnapshotGroupT) * header.group_count);
+
+    header.deadline_length = atomic_load(&simulator->deadline_queue.length);
+    header.deadline_members = scan.deadline_members;
+    header.deadline_entries = image_append(image, simulator->deadline_queue.entries, sizeof(HeapEntryT) * header.deadline_length);
+
+    header.task_head = simulator->task_queue.head;
+    header.task_tail = simulator->task_queue.tail;
+    header.task_length = simulator->task_queue.length;
+    header.blocked_head = simulator->blocked_queue.head;
+    header.blocked_tail = simulator->blocked_queue.tail;
+    header.blocked_length = simulator->blocked_queue.length;
+
+    header.clock = deadline_now_locked(simulator);
+    header.virtual_time = simulator->virtual_time;
+    header.slices = simulator->total_slices;
+    header.dispatches = simulator->total_dispatches;
+    header.cpu_time = simulator->total_cpu_time;
+    header.deadlines_met = simulator->deadlines_met;
+    header.deadlines_missed = simulator->deadlines_missed;
+    header.deadlines_dropped = simulator->deadlines_dropped;
+    memcpy(header.lateness_histogram, simulator->lateness_histogram, sizeof(header.lateness_histogram));
+
+    if (image->failed) {
+        return false;
+    }
+    header.size = image->size;
+    memcpy(image->bytes, &header, sizeof(header));
+    return true;
+}
+
+// Save the instance to path
+bool simulator_checkpoint(SimulatorT* simulator, char const* path) {
+    SnapshotImageT image = { NULL, 0, 0, false };
 
-            list_append(task_queue, process->pid);
+    PROFILED_LOCK(&simulator->process_mutex);
+    drain_releases_locked(simulator);
+    // Per-core queues and mailboxes have no place in the image format
+    bool const built = !simulator->core_count && !simulator->linked_processes && snapshot_locked(simulator, &image);
+    PROFILED_UNLOCK(&simulator->process_mutex);
 
-            pthread_mutex_unlock(&process_mutex);
-            return process->pid;
+    char log_message[PATH_MAX + 128];
+    bool written = false;
+    if (built) {
+        // Renamed into place, so an interrupted checkpoint never leaves a torn image at path
+        char temporary[PATH_MAX];
+        FILE* file = NULL;
+        // A path too long for its temporary name is refused rather than truncated
+        if (snprintf(temporary, sizeof(temporary), "%s.tmp", path) < (int)sizeof(temporary)) {
+            file = fopen(temporary, "wb");
+        }
+        if (file) {
+            written = fwrite(image.bytes, 1, image.size, file) == image.size;
+            written = fclose(file) == 0 && written;
+            written = written && rename(temporary, path) == 0;
+            if (!written) {
+                unlink(temporary);
+            }
         }
     }
+    free(image.bytes);
 
-    pthread_mutex_unlock(&process_mutex);
-    return 0;
+    if (written) {
+        snprintf(log_message, sizeof(log_message), "Checkpointed %zu bytes to %s.", image.size, path);
+    } else {
+        snprintf(log_message, sizeof(log_message), "Failed to checkpoint to %s.", path);
+    }
+    logger_write(log_message);
+    return written;
+}
+
+// Check every count and section of an image against its size and this build
+static bool snapshot_valid(unsigned char const* base, size_t size) {
+    SnapshotHeaderT const* header = (SnapshotHeaderT const*)image_at(base, size, 0, sizeof(SnapshotHeaderT));
+    if (!header || memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != SNAPSHOT_VERSION || header->chunk_size != PROCESS_CHUNK_SIZE ||
+        header->entry_size != sizeof(HeapEntryT) || header->size != size ||
+        header->program_count > MAX_PROGRAMS || header->share_class_count == 0 ||
+        header->share_class_count > MAX_SHARE_CLASSES || header->group_count == 0 ||
+        header->group_count > STRIDE_MAX_GROUPS || header->order_length > header->group_count ||
+        header->deadline_length > header->deadline_members) {
+        return false;
+    }
+
+    SnapshotProgramT const* programs = (SnapshotProgramT const*)image_at(base, size, header->programs,
+                                                                         sizeof(SnapshotProgramT) * header->program_count);
+    SnapshotShareClassT const* share_classes = (SnapshotShareClassT const*)image_at(
+        base, size, header->share_classes, sizeof(SnapshotShareClassT) * header->share_class_count);
+    SnapshotGroupT const* groups = (SnapshotGroupT const*)image_at(base, size, header->groups,
+                                                                   sizeof(SnapshotGroupT) * header->group_count);
+    SnapshotChunkT const* chunks = (SnapshotChunkT const*)image_at(base, size, header->chunks,
+                                                                   sizeof(SnapshotChunkT) * header->chunk_count);
+    if (!programs || !share_classes || !groups || !chunks ||
+        !image_at(base, size, header->in_flight, sizeof(ProcessIdT) * header->in_flight_count) ||
+        !image_at(base, size, header->deadline_entries, sizeof(HeapEntryT) * header->deadline_length)) {
+        return false;
+    }
+    for (unsigned int i = 0; i < header->program_count; i++) {
+        if (programs[i].kind > evaluator_kind_program ||
+            (programs[i].kind == evaluator_kind_program &&
+             !image_at(base, size, programs[i].instructions, sizeof(EvaluatorInstructionT) * programs[i].parameter))) {
+            return false;
+        }
+    }
+    for (unsigned int i = 0; i < header->share_class_count; i++) {
+        if (share_classes[i].group >= header->group_count) {
+            return false;
+        }
+    }
+    for (unsigned int g = 0; g < header->group_count; g++) {
+        if (groups[g].length > groups[g].members ||
+            (groups[g].position != STRIDE_NOT_QUEUED && groups[g].position >= header->order_length) ||
+            !image_at(base, size, groups[g].entries, sizeof(HeapEntryT) * groups[g].length)) {
+            return false;
+        }
+    }
+    for (unsigned int c = 0; c < header->chunk_count; c++) {
+        if (chunks[c].index >= UINT_MAX / PROCESS_CHUNK_SIZE || chunks[c].live > PROCESS_CHUNK_SIZE ||
+            (c > 0 && chunks[c].index <= chunks[c - 1].index) ||
+            !image_at(base, size, chunks[c].flags, PROCESS_CHUNK_SIZE) ||
+            !image_at(base, size, chunks[c].PC, sizeof(unsigned int) * PROCESS_CHUNK_SIZE) ||
+            !image_at(base, size, chunks[c].next, sizeof(ProcessIdT) * PROCESS_CHUNK_SIZE) ||
+            !image_at(base, size, chunks[c].program, PROCESS_CHUNK_SIZE) ||
+            !image_at(base, size, chunks[c].share, PROCESS_CHUNK_SIZE) ||
+            (chunks[c].deadline &&
+             !image_at(base, size, chunks[c].deadline, sizeof(unsigned long long) * PROCESS_CHUNK_SIZE))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Fill an empty heap with saved entries, reserving room for members
+static void restore_heap(HeapT* heap, HeapEntryT const* entries, uint64_t length, uint64_t members) {
+    heap->capacity = members;
+    heap->members = members;
+    heap->entries = members ? (HeapEntryT*)malloc(sizeof(HeapEntryT) * members) : NULL;
+    if (members && !heap->entries) {
+        fprintf(stderr, "Error: Unable to allocate restored run queue.\n");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(heap->entries, entries, sizeof(HeapEntryT) * length);
+    atomic_store(&heap->length, length);
+}
+
+// Load a validated image into a fresh instance - caller holds process_mutex
+static void restore_locked(SimulatorT* simulator, unsigned char const* base, EvaluatorCodeT const* codes) {
+    SnapshotHeaderT const* header = (SnapshotHeaderT const*)base;
+    // Real-time deadlines are moved on by the time the image spent on disk
+    unsigned long long const shift = header->deadline_real_time ? deadline_now_locked(simulator) - header->clock : 0;
+
+    memcpy(simulator->programs, codes, sizeof(EvaluatorCodeT) * header->program_count);
+    simulator->program_count = header->program_count;
+
+    SnapshotShareClassT const* share_classes = (SnapshotShareClassT const*)(base + header->share_classes);
+    for (unsigned int i = 0; i < header->share_class_count; i++) {
+        simulator->share_classes[i].group = share_classes[i].group;
+        simulator->share_classes[i].tickets = share_classes[i].tickets;
+        simulator->share_classes[i].stride = share_classes[i].stride;
+    }
+    simulator->share_class_count = header->share_class_count;
+
+    SnapshotGroupT const* groups = (SnapshotGroupT const*)(base + header->groups);
+    StrideSchedulerT* stride = &simulator->stride;
+    stride_destroy(stride);
+    stride_init(stride);
+    unsigned long length = 0;
+    for (unsigned int g = 0; g < header->group_count; g++) {
+        StrideGroupT* group = &stride->groups[g];
+        memcpy(group->name, groups[g].name, sizeof(group->name));
+        group->name[sizeof(group->name) - 1] = '\0';
+        group->tickets = groups[g].tickets;
+        group->position = groups[g].position;
+        group->stride = groups[g].stride;
+        group->pass = groups[g].pass;
+        group->virtual_pass = groups[g].virtual_pass;
+        group->usage = groups[g].usage;
+        heap_init(&group->ready);
+        restore_heap(&group->ready, (HeapEntryT const*)(base + groups[g].entries), groups[g].length, groups[g].members);
+        if (group->position != STRIDE_NOT_QUEUED) {
+            stride->order[group->position] = g;
+        }
+        length += groups[g].length;
+    }
+    stride->group_count = header->group_count;
+    stride->order_length = header->order_length;
+    stride->virtual_pass = header->stride_virtual_pass;
+    atomic_store(&stride->length, length);
+
+    heap_destroy(&simulator->deadline_queue);
+    restore_heap(&simulator->deadline_queue, (HeapEntryT const*)(base + header->deadline_entries),
+                 header->deadline_length, header->deadline_members);
+    for (unsigned long i = 0; shift && i < header->deadline_length; i++) {
+        simulator->deadline_queue.entries[i].key += shift;
+    }
+
+    SnapshotChunkT const* chunks = (SnapshotChunkT const*)(base + header->chunks);
+    for (unsigned int c = 0; c < header->chunk_count; c++) {
+        unsigned int const index = chunks[c].index;
+        ProcessChunkT* chunk = index < simulator->chunk_slots ? simulator->process_chunks[index] : NULL;
+        if (!chunk) {
+            chunk = allocate_chunk_locked(simulator, index);
+        }
+        if (!chunk) {
+            fprintf(stderr, "Error: Unable to allocate restored process table.\n");
+            exit(EXIT_FAILURE);
+        }
+        memcpy(chunk->flags, base + chunks[c].flags, sizeof(chunk->flags));
+        memcpy(chunk->PC, base + chunks[c].PC, sizeof(chunk->PC));
+        memcpy(chunk->next, base + chunks[c].next, sizeof(chunk->next));
+        memcpy(chunk->program, base + chunks[c].program, sizeof(chunk->program));
+        memcpy(chunk->share, base + chunks[c].share, sizeof(chunk->share));
+        if (chunks[c].deadline) {
+            chunk->deadline = (unsigned long long*)malloc(sizeof(unsigned long long) * PROCESS_CHUNK_SIZE);
+            if (!chunk->deadline) {
+                fprintf(stderr, "Error: Unable to allocate restored deadlines.\n");
+                exit(EXIT_FAILURE);
+            }
+            memcpy(chunk->deadline, base + chunks[c].deadline, sizeof(unsigned long long) * PROCESS_CHUNK_SIZE);
+            for (unsigned int slot = 0; shift && slot < PROCESS_CHUNK_SIZE; slot++) {
+                chunk->deadline[slot] += chunk->deadline[slot] ? shift : 0;
+            }
+        }
+        chunk->live = chunks[c].live;
+        simulator->free_pcbs -= chunk->live;
+        for (unsigned int slot = 0; slot < PROCESS_CHUNK_SIZE; slot++) {
+            if (pcb_state(chunk, slot) != unallocated) {
+                simulator->program_refs[chunk->program[slot]]++;
+            }
+        }
+    }
+
+    simulator->task_queue.head = header->task_head;
+    simulator->task_queue.tail = header->task_tail;
+    atomic_store(&simulator->task_queue.length, header->task_length);
+    // Restored into a simulator modelling cores, the saved FIFO order is dealt out over them
+    ProcessIdT queued;
+    while (simulator->core_count && (queued = queue_pop_locked(simulator, &simulator->task_queue))) {
+        unsigned int slot;
+        ProcessChunkT* chunk = lookup_process(simulator, queued, &slot);
+        ready_push_locked(simulator, chunk, slot, 0);
+    }
+    simulator->blocked_queue.head = header->blocked_head;
+    simulator->blocked_queue.tail = header->blocked_tail;
+    atomic_store(&simulator->blocked_queue.length, header->blocked_length);
+
+    ProcessIdT const* in_flight = (ProcessIdT const*)(base + header->in_flight);
+    for (unsigned int i = 0; i < header->in_flight_count; i++) {
+        unsigned int slot;
+        ProcessChunkT* chunk = lookup_process(simulator, in_flight[i], &slot);
+        if (chunk) {
+            ready_push_locked(simulator, chunk, slot, join_pass_locked(simulator, chunk, slot));
+        }
+    }
+
+    simulator->virtual_time = header->virtual_time;
+    simulator->total_slices = header->slices;
+    simulator->total_dispatches = header->dispatches;
+    simulator->total_cpu_time = header->cpu_time;
+    simulator->deadlines_met = header->deadlines_met;
+    simulator->deadlines_missed = header->deadlines_missed;
+    simulator->deadlines_dropped = header->deadlines_dropped;
+    memcpy(simulator->lateness_histogram, header->lateness_histogram, sizeof(simulator->lateness_histogram));
+    update_occupancy_locked(simulator);
+}
+
+// Start an instance from a checkpoint image
+SimulatorT* simulator_restore(char const* path, int threads, SimulatorConfigT const* config) {
+    char log_message[PATH_MAX + 128];
+    int const fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat status;
+    if (fd < 0 || fstat(fd, &status) != 0 || (size_t)status.st_size < sizeof(SnapshotHeaderT)) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        snprintf(log_message, sizeof(log_message), "Failed to read checkpoint %s.", path);
+        logger_write(log_message);
+        return NULL;
+    }
+    size_t const size = (size_t)status.st_size;
+    unsigned char* base = (unsigned char*)mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED || !snapshot_valid(base, size)) {
+        if (base != MAP_FAILED) {
+            munmap(base, size);
+        }
+        snprintf(log_message, sizeof(log_message), "Checkpoint %s is not a valid image for this build.", path);
+        logger_write(log_message);
+        return NULL;
+    }
+    SnapshotHeaderT const* header = (SnapshotHeaderT const*)base;
+
+    // Bytecode programs are registered again and get this run's ids
+    EvaluatorCodeT codes[MAX_PROGRAMS];
+    SnapshotProgramT const* programs = (SnapshotProgramT const*)(base + header->programs);
+    for (unsigned int i = 0; i < header->program_count; i++) {
+        if (programs[i].kind != evaluator_kind_program) {
+            codes[i] = evaluator_code_of_kind((EvaluatorKindT)programs[i].kind, programs[i].parameter);
+            continue;
+        }
+        EvaluatorProgramT const* program = evaluator_program_create(
+            (EvaluatorInstructionT const*)(base + programs[i].instructions), programs[i].parameter);
+        if (!program) {
+            munmap(base, size);
+            snprintf(log_message, sizeof(log_message), "Checkpoint %s holds a program that could not be registered.", path);
+            logger_write(log_message);
+            return NULL;
+        }
+        codes[i] = evaluator_program(program);
+    }
+
+    SimulatorConfigT restored = { 0 };
+    if (config) {
+        restored = *config;
+    }
+    restored.stride_scheduling = header->stride_scheduling;
+    restored.deadline_real_time = header->deadline_real_time;
+    SimulatorT* simulator = simulator_start(threads, 0, &restored);
+
+    PROFILED_LOCK(&simulator->process_mutex);
+    restore_locked(simulator, base, codes);
+    unsigned long const live = live_processes_locked(simulator);
+    notify_work_locked(simulator, ready_length(simulator));
+    PROFILED_UNLOCK(&simulator->process_mutex);
+
+    munmap(base, size);
+    snprintf(log_message, sizeof(log_message), "Restored %lu processes from %s.", live, path);
+    logger_write(log_message);
+    return simulator;
+}
+
+// Log the CPU time each share group received against its ticket share.
+// Configured shares are among the groups that ran, idle groups claim nothing.
+static void log_share_report(SimulatorT* simulator) {
+    unsigned long long tickets = 0;
+    unsigned long long usage = 0;
+    for (unsigned int i = 0; i < simulator->stride.group_count; i++) {
+        StrideGroupT const* group = &simulator->stride.groups[i];
+        if (group->usage > 0) {
+            tickets += group->tickets;
+            usage += group->usage;
+        }
+    }
+
+    char log_message[192];
+    for (unsigned int i = 0; i < simulator->stride.group_count; i++) {
+        StrideGroupT const* group = &simulator->stride.groups[i];
+        if (group->usage == 0) {
+            sprintf(log_message, "Share group \"%s\": %u tickets, idle.", group->name, group->tickets);
+        } else {
+            sprintf(log_message, "Share group \"%s\": %u tickets, %.1f%% configured, %.1f%% achieved (%llu units of CPU time).",
+                    group->name, group->tickets, 100.0 * group->tickets / tickets, 100.0 * group->usage / usage, group->usage);
+        }
+        logger_write(log_message);
+    }
 }
 
-// Wait for a process to complete
-void simulator_wait(ProcessIdT pid) {
-    pthread_mutex_lock(&process_mutex);
+// Log the work each simulated core did and how balanced it was
+static void log_core_report(SimulatorT* simulator) {
+    SimulatorCoreReportT cores[SIMULATOR_MAX_CORES];
+    core_report_locked(simulator, cores, simulator->core_count);
+    char log_message[192];
+    for (unsigned int i = 0; i < simulator->core_count; i++) {
+        sprintf(log_message, "Core %u: %llu dispatches, %llu units of CPU time, %.1f%% of the busiest core, %llu migrations in.",
+                i, cores[i].dispatches, cores[i].cpu_time, 100.0 * cores[i].utilization, cores[i].migrations);
+        logger_write(log_message);
+    }
+    sprintf(log_message, "%llu migrations across %u simulated cores, %llu processes moved by the load balancer.",
+            simulator->migrations, simulator->core_count, simulator->balancer_moves);
+    logger_write(log_message);
+}
 
-    while (processes[pid - 1].state != terminated) {
-        pthread_cond_wait(&process_condition, &process_mutex);
+// Upper bound of the lateness bucket holding the given fraction of misses
+static unsigned long long lateness_percentile(SimulatorT const* simulator, double fraction) {
+    unsigned long long seen = 0;
+    for (int b = 0; b < SIMULATOR_LATENESS_BUCKETS; b++) {
+        seen += simulator->lateness_histogram[b];
+        if (seen >= fraction * simulator->deadlines_missed) {
+            return 2ULL << b;
+        }
     }
+    return 0;
+}
 
-    pthread_mutex_unlock(&process_mutex);
+static void log_deadline_report(SimulatorT* simulator) {
+    char log_message[192];
+    sprintf(log_message, "Deadlines: %llu met, %llu missed, %llu dropped.",
+            simulator->deadlines_met, simulator->deadlines_missed, simulator->deadlines_dropped);
+    logger_write(log_message);
+    if (simulator->deadlines_missed > 0) {
+        sprintf(log_message, "Lateness of missed deadlines: p50<%llu p99<%llu %s.",
+                lateness_percentile(simulator, 0.5), lateness_percentile(simulator, 0.99),
+                simulator->deadline_real_time ? "us" : "units of CPU time");
+        logger_write(log_message);
+    }
 }
 
 // Stop the simulator and clean up resources
-void simulator_stop() {
-    simulator_active = false;
+void simulator_stop(SimulatorT* simulator) {
+    stats_clear_sampler(simulator);
+
+    PROFILED_LOCK(&simulator->process_mutex);
+    simulator->active = false;
+    pthread_cond_broadcast(&simulator->work_condition);
+    PROFILED_UNLOCK(&simulator->process_mutex);
 
-    // Ensure all worker threads stop properly after killing all processes
-    for (int i = 0; i < total_threads; i++) {
-        pthread_join(worker_threads[i], NULL);
+    // Workers finish their current slice and leave; shrunk-out slots are joined too.
+    // No worker is spawned once inactive, but a leaving one still marks its
+    // slot exited, so the slot is read under the lock.
+    for (int i = 0; i < simulator->total_threads; i++) {
+        PROFILED_LOCK(&simulator->process_mutex);
+        bool const started = simulator->worker_slots[i] != slot_empty;
+        PROFILED_UNLOCK(&simulator->process_mutex);
+        if (started) {
+            pthread_join(simulator->worker_threads[i], NULL);
+        }
     }
 
-    list_destroy(task_queue);
-    list_destroy(blocked_queue);  // Destroy blocked queue
-    free(processes);
-    free(worker_threads);
+    for (unsigned int i = 0; i < simulator->chunk_slots; i++) {
+        if (simulator->process_chunks[i]) {
+            free_chunk(simulator, simulator->process_chunks[i]);
+        }
+    }
+    free(simulator->process_chunks);
+    reclaim_retired_locked(simulator);
+    free(simulator->worker_threads);
+    free(simulator->worker_slots);
 
-    pthread_mutex_destroy(&process_mutex);
-    pthread_cond_destroy(&process_condition);
+    pthread_mutex_destroy(&simulator->process_mutex);
+    pthread_mutex_destroy(&simulator->wait_mutex);
+    pthread_cond_destroy(&simulator->wait_condition);
+    pthread_cond_destroy(&simulator->work_condition);
 
     char log_message[128];
+    sprintf(log_message, "Ran %llu slices in %llu dispatches, %llu units of CPU time.",
+            simulator->total_slices, simulator->total_dispatches, simulator->total_cpu_time);
+    logger_write(log_message);
+    if (simulator->stride_scheduling) {
+        log_share_report(simulator);
+    }
+    if (simulator->deadlines_met + simulator->deadlines_missed + simulator->deadlines_dropped > 0) {
+        log_deadline_report(simulator);
+    }
+    if (simulator->core_count) {
+        log_core_report(simulator);
+    }
+    if (simulator->messages_sent + simulator->messages_dropped > 0) {
+        sprintf(log_message, "Messages: %llu sent, %llu received, %llu dropped; %llu sends and %llu receives blocked.",
+                simulator->messages_sent, simulator->messages_received, simulator->messages_dropped,
+                simulator->send_blocks, simulator->receive_blocks);
+        logger_write(log_message);
+    }
+    if (simulator->max_live) {
+        sprintf(log_message, "Peak of %lu live processes against a limit of %lu, %llu timed creations gave up.",
+                simulator->peak_live, simulator->max_live, simulator->admission_timeouts);
+        logger_write(log_message);
+    }
+    stride_destroy(&simulator->stride);
+    heap_destroy(&simulator->deadline_queue);
+    free(simulator->cores);
+    lock_profile_report();
+    if (simulator->tracing) {
+        trace_stop();
+    }
+    free(simulator);
     sprintf(log_message, "Simulator has stopped.");
     logger_write(log_message);
 }
 
 
 
-// Terminate a specific process
-void simulator_kill(ProcessIdT pid) {
-    pthread_mutex_lock(&process_mutex);
+// Mark a process as killed, returns true if it moved straight to terminated
+// and may still be queued - caller is between enter_lockfree and exit_lockfree.
+// A running process keeps its PCB until its worker finishes the current slice.
+static bool kill_process(SimulatorT* simulator, ProcessChunkT* chunk, unsigned int slot) {
+    unsigned char flags = atomic_load(&chunk->flags[slot]);
+    unsigned char next;
+    do {
+        ProcessStateT const state = (ProcessStateT)(flags & PCB_STATE_MASK);
+        if (state == running) {
+            next = flags | PCB_KILL_REQUESTED;
+        } else if (state == ready || state == blocked) {
+            next = (flags & ~PCB_STATE_MASK) | terminated;
+        } else {
+            return false;
+        }
+    } while (!atomic_compare_exchange_weak(&chunk->flags[slot], &flags, next));
+
+    stats_add(stats_kills, 1);
+    if (simulator->tracing) {
+        trace_instant_event("kill", chunk->base_pid + slot);
+    }
+    if ((flags & PCB_STATE_MASK) == running) {
+        atomic_fetch_add_explicit(&simulator->kill_epoch, 1, memory_order_release);
+        return false;
+    }
+    return true;
+}
+
+// Disconnect processes a lock-free kill terminated from their mailbox peers,
+// so a peer blocked on one of them does not wait until it is reaped. Ones
+// killed while running disconnect themselves when their slice completes.
+static void unlink_killed(SimulatorT* simulator, ProcessIdT const* pids, unsigned int n) {
+    PROFILED_LOCK(&simulator->process_mutex);
+    for (unsigned int i = 0; i < n; i++) {
+        unsigned int slot;
+        ProcessChunkT* chunk = lookup_process(simulator, pids[i], &slot);
+        if (chunk && pcb_state(chunk, slot) == terminated) {
+            unlink_process_locked(simulator, chunk, slot);
+        }
+    }
+    PROFILED_UNLOCK(&simulator->process_mutex);
+}
 
+// Terminate a specific process
+void simulator_kill(SimulatorT* simulator, ProcessIdT pid) {
     // Log the kill request
     char log_message[128];
     sprintf(log_message, "Requesting to kill process %d", pid);
     logger_write(log_message);
 
-    // Move the process to the terminated state
-    processes[pid - 1].state = terminated;
+    enter_lockfree(simulator);
+    unsigned int slot;
+    ProcessChunkT* chunk = lookup_process(simulator, pid, &slot);
+    bool const terminated_now = chunk && kill_process(simulator, chunk, slot);
+    bool const linked = terminated_now && chunk->links;
+    exit_lockfree(simulator);
+    if (!terminated_now) {
+        return;
+    }
+    if (linked) {
+        unlink_killed(simulator, &pid, 1);
+    }
 
-    // Log the termination
+    // The queue entry is skipped and unlinked when it reaches the front,
+    // so there is no need to search the ready set or blocked_queue here
     sprintf(log_message, "Process %d has been moved to terminated state.", pid);
     logger_write(log_message);
 
-    // Now remove the process from both task_queue and blocked_queue
-    struct List* node_to_remove = list_find_first(task_queue, pid);
-    if (node_to_remove) {
-        list_remove(task_queue, node_to_remove);
-        sprintf(log_message, "Process %d removed from task queue.", pid);
-        logger_write(log_message);
+    // Wake waiting threads
+    notify_waiters(simulator);
+}
+
+
+
+// Terminate a batch of processes with one wake-up
+void simulator_kill_many(SimulatorT* simulator, ProcessIdT const* pids, unsigned int n) {
+    enter_lockfree(simulator);
+
+    unsigned int killed = 0;
+    bool queued = false;
+    bool linked = false;
+    for (unsigned int i = 0; i < n; i++) {
+        unsigned int slot;
+        ProcessChunkT* chunk = lookup_process(simulator, pids[i], &slot);
+        if (chunk && pcb_state(chunk, slot) != unallocated && pcb_state(chunk, slot) != terminated) {
+            bool const terminated_now = kill_process(simulator, chunk, slot);
+            queued |= terminated_now;
+            linked |= terminated_now && chunk->links;
+            killed++;
+        }
     }
 
-    node_to_remove = list_find_first(blocked_queue, pid);
-    if (node_to_remove) {
-        list_remove(blocked_queue, node_to_remove);
-        sprintf(log_message, "Process %d removed from blocked queue.", pid);
-        logger_write(log_message);
+    exit_lockfree(simulator);
+    if (linked) {
+        unlink_killed(simulator, pids, n);
+    }
+
+    // One sweep per queue unlinks the whole batch. Skipped if a worker holds
+    // the lock, since pops unlink terminated entries as they reach the front.
+    if (queued && PROFILED_TRYLOCK(&simulator->process_mutex) == 0) {
+        ready_purge_terminated_locked(simulator);
+        queue_purge_terminated_locked(simulator, &simulator->blocked_queue);
+        PROFILED_UNLOCK(&simulator->process_mutex);
+    }
+
+    notify_waiters(simulator);
+
+    char log_message[128];
+    sprintf(log_message, "Killed %u processes in one batch.", killed);
+    logger_write(log_message);
+}
+
+// Create a group of processes that can be killed or waited on together
+ProcessGroupT* simulator_group_create(SimulatorT* simulator, EvaluatorCodeT const* codes, unsigned int n) {
+    return simulator_group_create_timed(simulator, codes, n, 0);
+}
+
+ProcessGroupT* simulator_group_create_timed(SimulatorT* simulator, EvaluatorCodeT const* codes, unsigned int n, long timeout_ms) {
+    ProcessGroupT* group = (ProcessGroupT*)malloc(sizeof(ProcessGroupT));
+    if (!group) {
+        return NULL;
     }
 
-    // Broadcast to unblock waiting threads
-    pthread_cond_broadcast(&process_condition);
+    group->pids = (ProcessIdT*)malloc(sizeof(ProcessIdT) * (n ? n : 1));
+    if (!group->pids) {
+        free(group);
+        return NULL;
+    }
+
+    // Only keep the PIDs that were actually created
+    simulator_create_processes_timed(simulator, codes, n, group->pids, timeout_ms);
+    group->count = 0;
+    for (unsigned int i = 0; i < n; i++) {
+        if (group->pids[i]) {
+            group->pids[group->count++] = group->pids[i];
+        }
+    }
+    return group;
+}
 
-    pthread_mutex_unlock(&process_mutex);
+void simulator_group_kill(SimulatorT* simulator, ProcessGroupT* group) {
+    simulator_kill_many(simulator, group->pids, group->count);
 }
 
+void simulator_group_wait(SimulatorT* simulator, ProcessGroupT* group) {
+    simulator_wait_many(simulator, group->pids, group->count);
+}
 
+void simulator_group_destroy(ProcessGroupT* group) {
+    free(group->pids);
+    free(group);
+}
 
-void simulator_event() {
-    if (!list_empty(blocked_queue)) {
-        ProcessIdT pid = list_pop_front(blocked_queue);  // Move the front blocked process
-        ProcessControlBlock* pcb = &processes[pid - 1];
+void simulator_event(SimulatorT* simulator) {
+    PROFILED_LOCK(&simulator->process_mutex);
 
+    // Move the front blocked process, skipping any a lock-free kill got to first
+    ProcessIdT pid;
+    unsigned int slot;
+    ProcessChunkT* chunk = NULL;
+    while ((pid = queue_pop_locked(simulator, &simulator->blocked_queue))) {
+        chunk = lookup_process(simulator, pid, &slot);
+        if (transition_pcb(chunk, slot, blocked, ready, PCB_QUEUED)) {
+            break;
+        }
+    }
+    if (pid) {
         // Move to ready queue
-        pcb->state = ready;
-        list_append(task_queue, pid);
+        ready_push_locked(simulator, chunk, slot, join_pass_locked(simulator, chunk, slot));
+        notify_work_locked(simulator, 1);
+        stats_add(stats_wakes, 1);
+        if (simulator->tracing) {
+            trace_instant_event("wake", pid);
+        }
+
+        PROFILED_UNLOCK(&simulator->process_mutex);
 
         char log_message[128];
         sprintf(log_message, "Process %d moved to ready queue from blocked.", pid);
         logger_write(log_message);
+        return;
     }
+
+    PROFILED_UNLOCK(&simulator->process_mutex);
 }
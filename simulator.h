@@ -3,6 +3,9 @@
 
 #include "evaluator.h"
 
+#include <stddef.h>
+#include <stdbool.h>
+
 // Student: Salameh Alfasatleh ID: 20578169
 
 typedef unsigned int ProcessIdT;
@@ -15,19 +18,274 @@ typedef enum ProcessState {
     terminated
 } ProcessStateT;
 
-typedef struct {
-    ProcessIdT pid;
-    ProcessStateT state;
-    EvaluatorCodeT code;  // Code the process will execute
-    unsigned int PC;      // Program Counter to track execution state
-} ProcessControlBlock;
+// Process control blocks are stored column-wise inside simulator.c. Each
+// process's code is interned in a table of at most 256 distinct programs.
+
+// One simulator instance. Every call takes the handle simulator_start
+// returned, so independent instances can run side by side in one process.
+typedef struct Simulator SimulatorT;
+
+#define SIMULATOR_MAX_CORES 64
+
+// Where a ready process is queued when simulated cores are modelled
+typedef enum SimulatorCorePlacement {
+    core_placement_last,          // The core it last ran on, if allowed
+    core_placement_least_loaded   // The allowed core with the fewest processes, its last one on a tie
+} SimulatorCorePlacementT;
+
+// Tuning for one instance. Zeroed fields take the defaults, so
+// `SimulatorConfigT config = { .coalesce_slices = 4 };` only changes coalescing.
+typedef struct SimulatorConfig {
+    // Pin workers one per CPU of a list such as "0-7,16-23". NULL or ""
+    // leaves workers unpinned.
+    char const* cpus;
+
+    // Let the worker pool grow and shrink between min and max threads. It
+    // grows while the run queue is deep and workers were busy running slices
+    // over the last window. Idle workers park, and ones above min exit after a
+    // quiet spell, or at once while the pool was mostly idle. With max_threads
+    // 0 the pool stays at the thread count passed to simulator_start.
+    unsigned int min_threads;
+    unsigned int max_threads;
+
+    // Let a worker run up to this many back-to-back slices of one process
+    // while no other process is ready. 0 or 1 disables it.
+    unsigned int coalesce_slices;
+
+    // Give each process a quantum of 1 to 8 time slices, lengthened while it
+    // keeps using all of it and reset when it blocks
+    bool adaptive_quantum;
+
+    // Let workers take up to this many ready processes per dispatch and
+    // advance them one slice each with evaluator_evaluate_batch. Batched
+    // dispatch always uses single-slice quanta and does not coalesce.
+    unsigned int dispatch_batch;
+
+    // Run each worker as this many fibers, each dispatching one process at a
+    // time. A slice then suspends only its fiber, so a few threads keep that
+    // many processes in their slices at once. Fiber workers neither batch
+    // nor coalesce. 0 or 1 runs plain workers.
+    unsigned int fibers_per_worker;
+
+    // Model this many simulated cores, at most SIMULATOR_MAX_CORES, apart
+    // from the worker threads. Each core has its own ready queue and runs one
+    // process at a time; a worker claims a free core for each dispatch.
+    // Processes are placed by core_placement, restricted by
+    // simulator_set_affinity, and evened out by a load balancer every
+    // balance_interval units of CPU time (0 takes 1000). A process that runs
+    // on a core other than its last is charged migration_penalty units of CPU
+    // time for its cold cache. Deadline processes, and all processes under
+    // stride scheduling, keep one ready set and run on any free core without
+    // regard to affinity. 0 cores disables the model; the count is fixed at start.
+    unsigned int simulated_cores;
+    SimulatorCorePlacementT core_placement;
+    unsigned int migration_penalty;
+    unsigned int balance_interval;
+
+    // Pick the next process by stride scheduling instead of FIFO: share
+    // groups receive CPU time in proportion to their tickets, and processes
+    // within a group in proportion to theirs. The ready process with the
+    // lowest pass in the group with the lowest pass runs next, chosen in
+    // O(log n). Shares achieved are logged at simulator_stop.
+    bool stride_scheduling;
+
+    // Deadlines of processes from simulator_create_deadline_process count in
+    // units of CPU time simulated by the instance, or with deadline_real_time
+    // in microseconds of wall-clock time
+    bool deadline_real_time;
+    // Under overload, drop a deadline process when it is next picked to run if
+    // the CPU time its code still needs would take it past its deadline,
+    // instead of running it late
+    bool drop_late_deadlines;
+
+    // Admission control: at most max_live_processes PCBs in use at once,
+    // terminated processes not yet waited on included. 0 leaves the table
+    // limited by memory alone. Creation fails at the limit, or with the
+    // _timed variants waits for a PCB, waiting creators served in arrival order.
+    unsigned int max_live_processes;
+    // simulator_throttled turns true once live processes reach high_watermark
+    // percent of max_live_processes and false again at low_watermark percent,
+    // so creators can back off before they block. Zero takes 90 and 70.
+    unsigned int high_watermark;
+    unsigned int low_watermark;
+
+    // Messages each process's mailbox holds, see simulator_connect. Applies
+    // to mailboxes allocated after it is set; 0 takes 64.
+    unsigned int mailbox_capacity;
+
+    // Record worker slices, blocks, wakes, kills and queue depths and write
+    // them here as a Chrome trace-event file at simulator_stop. Tracing is
+    // process-wide, so only one running instance can record. NULL or "" disables.
+    char const* trace_path;
+} SimulatorConfigT;
+
+// max_processes sizes the initial process table, which grows as needed.
+// config may be NULL for the defaults.
+SimulatorT* simulator_start(int threads, int max_processes, SimulatorConfigT const* config);
+// Join the workers and free the instance
+void simulator_stop(SimulatorT* simulator);
+
+// Retune a running instance between workloads without restarting it. The
+// process table and worker threads are kept; workers are added or retired to
+// fit the new pool bounds, which cannot exceed the pool size the instance was
+// started with. cpus, stride_scheduling, deadline_real_time, fibers_per_worker,
+// simulated_cores and trace_path are fixed at start and ignored here.
+// Resets the counters simulator_report returns and the occupancy peak and timeouts.
+void simulator_reconfigure(SimulatorT* simulator, int threads, SimulatorConfigT const* config);
+
+#define SIMULATOR_LATENESS_BUCKETS 32
+
+typedef struct SimulatorReport {
+    unsigned long long slices;
+    unsigned long long dispatches;
+    unsigned long long cpu_time;
+    unsigned int workers;  // Workers currently in the pool
+
+    // Deadline processes that terminated by their deadline, after it, or
+    // were dropped by drop_late_deadlines. Killed ones are not counted.
+    unsigned long long deadlines_met;
+    unsigned long long deadlines_missed;
+    unsigned long long deadlines_dropped;
+    // Missed deadlines by lateness: bucket b counts lateness in [2^b, 2^(b+1))
+    unsigned long long lateness_histogram[SIMULATOR_LATENESS_BUCKETS];
+
+    // With simulated cores: dispatches onto a core other than the process's
+    // last one, and processes the load balancer moved between core queues
+    unsigned long long migrations;
+    unsigned long long balancer_moves;
+
+    // Mailbox traffic: messages that went into a mailbox, were taken out,
+    // or were lost to a process that terminated, and exchanges that blocked
+    unsigned long long messages_sent;
+    unsigned long long messages_received;
+    unsigned long long messages_dropped;
+    unsigned long long send_blocks;
+    unsigned long long receive_blocks;
+} SimulatorReportT;
+
+// Work done since simulator_start or the last simulator_reconfigure
+SimulatorReportT simulator_report(SimulatorT* simulator);
+
+typedef struct SimulatorCoreReport {
+    unsigned long long dispatches;
+    unsigned long long cpu_time;     // Migration penalties included
+    unsigned long long migrations;   // Dispatches of processes that last ran elsewhere
+    double utilization;              // cpu_time against the busiest core's
+} SimulatorCoreReportT;
+
+// Per-core work since simulator_start or the last simulator_reconfigure.
+// Fills up to n entries and returns the number of simulated cores.
+unsigned int simulator_core_report(SimulatorT* simulator, SimulatorCoreReportT* cores, unsigned int n);
+
+// Restrict a process to the simulated cores whose bits are set in mask, or
+// any core with 0, from its next dispatch on. False if the process is not
+// live, no cores are modelled or mask holds none of them.
+bool simulator_set_affinity(SimulatorT* simulator, ProcessIdT pid, unsigned long long mask);
+
+// Simulated message passing between processes running bytecode programs.
+// Each process has a bounded mailbox, allocated on first use. op_send
+// delivers its operand to the mailbox of the process's peer and op_receive
+// takes the oldest message from its own. A send to a full mailbox, or by a
+// process with no peer yet, blocks the sender; a receive from an empty one
+// blocks the receiver. The other side wakes it directly once it makes room
+// or delivers, and messages move through lock-free rings without copying.
+// Once a receiver's sender terminates, receives on its empty mailbox return
+// at once; once a sender's peer terminates, its sends are dropped. A process
+// keeps the last message it received, which an op_send of
+// EVALUATOR_MESSAGE_RECEIVED passes on to its own peer.
+//
+// Connect sender to receiver. A process has at most one peer and a mailbox
+// at most one sender, so every mailbox has a single producer and a single
+// consumer. False if either is not live, they are the same process, sender
+// already has a peer or receiver already has a sender.
+bool simulator_connect(SimulatorT* simulator, ProcessIdT sender, ProcessIdT receiver);
+// The last message pid received, 0 if it has received none or is not live
+unsigned int simulator_received(SimulatorT* simulator, ProcessIdT pid);
+
+// Returns 0 if the process table could not grow, the program table is full,
+// or max_live_processes are live or other creators are waiting for a PCB
+ProcessIdT simulator_create_process(SimulatorT* simulator, EvaluatorCodeT const code);
+// Waiting reaps the process so its PID may be reused - wait on a PID at most once
+void simulator_wait(SimulatorT* simulator, ProcessIdT pid);
+void simulator_kill(SimulatorT* simulator, ProcessIdT pid);
+void simulator_event(SimulatorT* simulator);
+
+// Bytes currently held by the process table, run queues included
+size_t simulator_table_bytes(SimulatorT* simulator);
+
+// Save the process table, run queues, share groups and counters to path as a
+// versioned binary image, written to a temporary file and renamed into place.
+// A process in the middle of a slice is saved as ready at the start of it.
+// Returns false if the file cannot be written, simulated cores are
+// modelled, a live process has used a mailbox, or a process runs code from
+// outside the evaluator, which has no identity that survives the run.
+bool simulator_checkpoint(SimulatorT* simulator, char const* path);
+// Start an instance from an image simulator_checkpoint wrote. threads and
+// config are as for simulator_start, except that stride_scheduling and
+// deadline_real_time are taken from the image. PIDs are kept, so saved PIDs
+// can still be waited on and killed. Returns NULL if the image cannot be read
+// or was written by an incompatible build.
+SimulatorT* simulator_restore(char const* path, int threads, SimulatorConfigT const* config);
+
+// Bulk variants - each call takes the process lock once and notifies once
+unsigned int simulator_create_processes(SimulatorT* simulator, EvaluatorCodeT const* codes, unsigned int n, ProcessIdT* pids);
+void simulator_kill_many(SimulatorT* simulator, ProcessIdT const* pids, unsigned int n);
+void simulator_wait_many(SimulatorT* simulator, ProcessIdT const* pids, unsigned int n);
+
+// Like simulator_create_process(es), but wait up to timeout_ms for a PCB
+// while max_live_processes are live - a negative timeout waits indefinitely.
+// Creators are admitted in the order they began waiting, and a batch keeps
+// its place until all of it is created. Returns 0, or for the batch how many
+// were created, leaving 0 in the PIDs that timed out.
+ProcessIdT simulator_create_process_timed(SimulatorT* simulator, EvaluatorCodeT const code, long timeout_ms);
+unsigned int simulator_create_processes_timed(SimulatorT* simulator, EvaluatorCodeT const* codes, unsigned int n,
+                                              ProcessIdT* pids, long timeout_ms);
+
+typedef struct SimulatorOccupancy {
+    unsigned long live;      // PCBs in use
+    unsigned long capacity;  // max_live_processes, 0 for no limit
+    unsigned long peak;      // Most live at once
+    unsigned int waiting;    // Creators waiting for a PCB
+    unsigned long long timeouts;  // Timed creations that gave up
+    bool throttled;
+} SimulatorOccupancyT;
+
+// Occupancy since simulator_start or the last simulator_reconfigure
+SimulatorOccupancyT simulator_occupancy(SimulatorT* simulator);
+// True from when live processes reach the high watermark until they fall back
+// to the low one. Lock-free, cheap enough to poll before every creation.
+bool simulator_throttled(SimulatorT* simulator);
+
+// Create processes that should terminate within relative_deadline of now, on
+// the clock chosen by deadline_real_time. Ready deadline processes run before
+// all others, earliest deadline first, and outside any share group. A deadline
+// of 0 creates an ordinary process.
+ProcessIdT simulator_create_deadline_process(SimulatorT* simulator, EvaluatorCodeT const code, unsigned long long relative_deadline);
+unsigned int simulator_create_deadline_processes(SimulatorT* simulator, EvaluatorCodeT const* codes,
+                                                 unsigned long long const* relative_deadlines, unsigned int n, ProcessIdT* pids);
+
+// Tickets held by the default share group, and by processes created without a count
+#define SIMULATOR_DEFAULT_TICKETS 100
+
+// Share groups divide CPU time between tenants under stride_scheduling.
+// Processes from simulator_create_process belong to group 0, "default".
+// Returns the new group's id, or -1 once 64 groups exist. Zero tickets means the default.
+int simulator_share_group_create(SimulatorT* simulator, char const* name, unsigned int tickets);
+// Create a process holding tickets within group. Returns 0 for an unknown
+// group or once 256 distinct (group, tickets) pairs are in use.
+ProcessIdT simulator_create_shared_process(SimulatorT* simulator, EvaluatorCodeT const code, int group, unsigned int tickets);
 
-void simulator_start(int threads, int max_processes);
-void simulator_stop();
+// A batch of processes that can be killed or waited on as a unit
+typedef struct ProcessGroup {
+    ProcessIdT* pids;
+    unsigned int count;
+} ProcessGroupT;
 
-ProcessIdT simulator_create_process(EvaluatorCodeT const code);
-void simulator_wait(ProcessIdT pid);
-void simulator_kill(ProcessIdT pid);
-void simulator_event();
+ProcessGroupT* simulator_group_create(SimulatorT* simulator, EvaluatorCodeT const* codes, unsigned int n);
+// Waits for admission as simulator_create_processes_timed does
+ProcessGroupT* simulator_group_create_timed(SimulatorT* simulator, EvaluatorCodeT const* codes, unsigned int n, long timeout_ms);
+void simulator_group_kill(SimulatorT* simulator, ProcessGroupT* group);
+void simulator_group_wait(SimulatorT* simulator, ProcessGroupT* group);
+void simulator_group_destroy(ProcessGroupT* group);
 
 #endif
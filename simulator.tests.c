@@ -0,0 +1,762 @@
+#include "simulator.h"
+#include "logger.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+// Deadlines count in simulated CPU time, so these runs do not depend on how
+// fast the host is
+
+// A job whose remaining work cannot fit before its deadline is dropped when
+// first picked, without spending CPU time on it, while one that fits is run
+void test_hopeless_deadline_dropped_early() {
+  printf("Test hopeless deadline dropped early\n");
+  SimulatorConfigT const config = { .drop_late_deadlines = true };
+  SimulatorT* simulator = simulator_start(1, 16, &config);
+  // Needs 19 full slices, far more than its deadline allows
+  ProcessIdT const hopeless = simulator_create_deadline_process(simulator, evaluator_terminates_after(20),
+                                                                5 * TIME_SLICE_LENGTH);
+  ProcessIdT const feasible = simulator_create_deadline_process(simulator, evaluator_terminates_after(2),
+                                                                100 * TIME_SLICE_LENGTH);
+  assert(hopeless && feasible);
+  simulator_wait(simulator, hopeless);
+  simulator_wait(simulator, feasible);
+  SimulatorReportT const report = simulator_report(simulator);
+  assert(report.deadlines_dropped == 1);
+  assert(report.deadlines_met == 1);
+  assert(report.deadlines_missed == 0);
+  // Only the feasible job ran
+  assert(report.cpu_time < 5 * TIME_SLICE_LENGTH);
+  simulator_stop(simulator);
+}
+
+// A creator blocked in simulator_create_process_timed on its own thread
+typedef struct {
+  SimulatorT* simulator;
+  ProcessIdT pid;
+} CreatorT;
+
+static void* create_waiting(void* argument) {
+  CreatorT* creator = (CreatorT*)argument;
+  creator->pid = simulator_create_process_timed(creator->simulator, evaluator_infinite_loop, -1);
+  return NULL;
+}
+
+static void wait_for_creators(SimulatorT* simulator, unsigned int waiting) {
+  while(simulator_occupancy(simulator).waiting != waiting) {
+    usleep(1000);
+  }
+}
+
+// Killed processes still in a run queue are released when a worker unlinks them
+static SimulatorOccupancyT wait_for_live(SimulatorT* simulator, unsigned long live) {
+  SimulatorOccupancyT occupancy;
+  while((occupancy = simulator_occupancy(simulator)).live != live) {
+    usleep(1000);
+  }
+  return occupancy;
+}
+
+static void kill_and_wait(SimulatorT* simulator, ProcessIdT pid) {
+  simulator_kill(simulator, pid);
+  simulator_wait(simulator, pid);
+}
+
+// Waiting creators are admitted one PCB at a time, in the order they began waiting
+void test_admission_fifo() {
+  printf("Test admission FIFO\n");
+  SimulatorConfigT const config = { .max_live_processes = 1 };
+  SimulatorT* simulator = simulator_start(1, 16, &config);
+  ProcessIdT const blocker = simulator_create_process(simulator, evaluator_infinite_loop);
+  assert(blocker);
+  // Full, so an untimed creation fails at once
+  assert(!simulator_create_process(simulator, evaluator_infinite_loop));
+
+  CreatorT first = { simulator, 0 };
+  CreatorT second = { simulator, 0 };
+  pthread_t first_thread, second_thread;
+  assert(pthread_create(&first_thread, NULL, create_waiting, &first) == 0);
+  wait_for_creators(simulator, 1);
+  assert(pthread_create(&second_thread, NULL, create_waiting, &second) == 0);
+  wait_for_creators(simulator, 2);
+
+  kill_and_wait(simulator, blocker);
+  pthread_join(first_thread, NULL);
+  assert(first.pid);
+  SimulatorOccupancyT occupancy = wait_for_live(simulator, 1);
+  assert(occupancy.waiting == 1);
+
+  kill_and_wait(simulator, first.pid);
+  pthread_join(second_thread, NULL);
+  assert(second.pid);
+  occupancy = simulator_occupancy(simulator);
+  assert(occupancy.waiting == 0 && occupancy.timeouts == 0);
+  kill_and_wait(simulator, second.pid);
+  simulator_stop(simulator);
+}
+
+// A timed creation gives up once the limit has held for its whole timeout
+void test_admission_timeout() {
+  printf("Test admission timeout\n");
+  SimulatorConfigT const config = { .max_live_processes = 1 };
+  SimulatorT* simulator = simulator_start(1, 16, &config);
+  ProcessIdT const blocker = simulator_create_process(simulator, evaluator_infinite_loop);
+  assert(blocker);
+  assert(!simulator_create_process_timed(simulator, evaluator_infinite_loop, 20));
+  ProcessIdT pids[2] = { 1, 1 };
+  assert(simulator_create_processes_timed(simulator, (EvaluatorCodeT[]) { evaluator_infinite_loop, evaluator_infinite_loop },
+                                          2, pids, 20) == 0);
+  assert(pids[0] == 0 && pids[1] == 0);
+  SimulatorOccupancyT const occupancy = simulator_occupancy(simulator);
+  assert(occupancy.timeouts == 2 && occupancy.waiting == 0);
+
+  kill_and_wait(simulator, blocker);
+  ProcessIdT const pid = simulator_create_process_timed(simulator, evaluator_infinite_loop, 20);
+  assert(pid);
+  kill_and_wait(simulator, pid);
+  simulator_stop(simulator);
+}
+
+// Program table entries are freed with their last process, so more distinct
+// codes than the table holds can be used one after another
+void test_program_table_reused() {
+  printf("Test program table reused\n");
+  SimulatorT* simulator = simulator_start(1, 16, NULL);
+  for(unsigned int i = 1; i <= 600; i++) {
+    ProcessIdT const pid = simulator_create_process(simulator, evaluator_terminates_after(1000 + i));
+    assert(pid);
+    kill_and_wait(simulator, pid);
+    wait_for_live(simulator, 0);
+  }
+  simulator_stop(simulator);
+}
+
+// Slices count the time a process ran, so a long adaptive quantum counts as
+// the several slices it covers rather than as one
+void test_slices_count_quantum_length() {
+  printf("Test slices count quantum length\n");
+  SimulatorConfigT const config = { .adaptive_quantum = true };
+  SimulatorT* simulator = simulator_start(1, 16, &config);
+  ProcessIdT const pid = simulator_create_process(simulator, evaluator_terminates_after(20 * TIME_SLICE_LENGTH));
+  assert(pid);
+  simulator_wait(simulator, pid);
+  SimulatorReportT const report = simulator_report(simulator);
+  assert(report.slices * TIME_SLICE_LENGTH >= report.cpu_time);
+  assert(report.slices > report.dispatches);
+  simulator_stop(simulator);
+}
+
+// throttled turns on at the high watermark and stays on until the low one
+void test_watermark_throttle() {
+  printf("Test watermark throttle\n");
+  SimulatorConfigT const config = { .max_live_processes = 10, .high_watermark = 50, .low_watermark = 20 };
+  SimulatorT* simulator = simulator_start(1, 16, &config);
+  ProcessIdT pids[5];
+  for(unsigned int i = 0; i != 4; ++i) {
+    pids[i] = simulator_create_process(simulator, evaluator_infinite_loop);
+    assert(pids[i]);
+    assert(!simulator_throttled(simulator));
+  }
+  pids[4] = simulator_create_process(simulator, evaluator_infinite_loop);
+  assert(pids[4]);
+  assert(simulator_throttled(simulator));
+
+  // Throttling only advises: creation still succeeds below the limit
+  ProcessIdT const extra = simulator_create_process(simulator, evaluator_infinite_loop);
+  assert(extra);
+  kill_and_wait(simulator, extra);
+  kill_and_wait(simulator, pids[4]);
+  kill_and_wait(simulator, pids[3]);
+  assert(wait_for_live(simulator, 3).throttled);
+  kill_and_wait(simulator, pids[2]);
+  SimulatorOccupancyT const occupancy = wait_for_live(simulator, 2);
+  assert(!occupancy.throttled);
+  assert(occupancy.peak == 6);
+
+  kill_and_wait(simulator, pids[1]);
+  kill_and_wait(simulator, pids[0]);
+  simulator_stop(simulator);
+}
+
+#define CHECKPOINT_PATH "simulator.tests.checkpoint"
+
+// A cpu bound program of this many steps is unlikely to appear in an image by chance
+#define CHECKPOINT_MARKER_STEPS 0x00ABCDEF
+
+static unsigned char* read_file(char const* path, size_t* size) {
+  FILE* file = fopen(path, "rb");
+  assert(file);
+  fseek(file, 0, SEEK_END);
+  *size = ftell(file);
+  rewind(file);
+  unsigned char* bytes = malloc(*size);
+  assert(bytes && fread(bytes, 1, *size, file) == *size);
+  fclose(file);
+  return bytes;
+}
+
+static void write_file(char const* path, unsigned char const* bytes, size_t size) {
+  FILE* file = fopen(path, "wb");
+  assert(file && fwrite(bytes, 1, size, file) == size);
+  fclose(file);
+}
+
+// Processes keep their PIDs and progress across a checkpoint and restore
+void test_checkpoint_round_trip() {
+  printf("Test checkpoint round trip\n");
+  SimulatorT* simulator = simulator_start(1, 16, NULL);
+  // Nothing here blocks, since no events are raised to wake it
+  EvaluatorInstructionT const instructions[] = {
+    EVALUATOR_INSTRUCTION(op_compute, 3),
+    EVALUATOR_INSTRUCTION(op_compute, 2),
+  };
+  EvaluatorCodeT const codes[] = {
+    evaluator_terminates_after(40),
+    evaluator_terminates_after(7),
+    evaluator_program(evaluator_program_create(instructions, 2)),
+  };
+  ProcessIdT pids[3];
+  assert(simulator_create_processes(simulator, codes, 3, pids) == 3);
+  ProcessIdT const looping = simulator_create_process(simulator, evaluator_infinite_loop);
+  assert(looping);
+  // Workers keep running, so the image holds at least this many
+  unsigned long long const slices = simulator_report(simulator).slices;
+  assert(simulator_checkpoint(simulator, CHECKPOINT_PATH));
+  assert(access(CHECKPOINT_PATH ".tmp", F_OK) != 0);
+  kill_and_wait(simulator, looping);
+  simulator_wait_many(simulator, pids, 3);
+  simulator_stop(simulator);
+
+  simulator = simulator_restore(CHECKPOINT_PATH, 1, NULL);
+  assert(simulator);
+  SimulatorOccupancyT const occupancy = simulator_occupancy(simulator);
+  assert(occupancy.live == 4);
+  // Counters carry over, and the saved PIDs can still be waited on and killed
+  assert(simulator_report(simulator).slices >= slices);
+  simulator_wait_many(simulator, pids, 3);
+  kill_and_wait(simulator, looping);
+  assert(wait_for_live(simulator, 0).live == 0);
+  simulator_stop(simulator);
+  unlink(CHECKPOINT_PATH);
+}
+
+// An image from another format version, or naming code this build cannot
+// recreate, is refused rather than misread
+void test_checkpoint_rejects_mismatches() {
+  printf("Test checkpoint rejects mismatches\n");
+  SimulatorT* simulator = simulator_start(1, 16, NULL);
+  ProcessIdT const pid = simulator_create_process(simulator, evaluator_terminates_after(CHECKPOINT_MARKER_STEPS));
+  assert(pid);
+  assert(simulator_checkpoint(simulator, CHECKPOINT_PATH));
+  kill_and_wait(simulator, pid);
+  simulator_stop(simulator);
+
+  size_t size;
+  unsigned char* const image = read_file(CHECKPOINT_PATH, &size);
+  unsigned char* const patched = malloc(size);
+
+  // The version follows the 8 byte magic
+  memcpy(patched, image, size);
+  uint32_t version;
+  memcpy(&version, patched + 8, sizeof(version));
+  version++;
+  memcpy(patched + 8, &version, sizeof(version));
+  write_file(CHECKPOINT_PATH, patched, size);
+  assert(!simulator_restore(CHECKPOINT_PATH, 1, NULL));
+
+  // The program record holds the kind just before the marker parameter
+  memcpy(patched, image, size);
+  uint32_t const marker[2] = { evaluator_kind_cpu_bound, CHECKPOINT_MARKER_STEPS };
+  size_t offset = 0;
+  while(offset + sizeof(marker) <= size && memcmp(patched + offset, marker, sizeof(marker)) != 0) {
+    offset += sizeof(uint32_t);
+  }
+  assert(offset + sizeof(marker) <= size);
+  uint32_t const unknown = evaluator_kind_unknown;
+  memcpy(patched + offset, &unknown, sizeof(unknown));
+  write_file(CHECKPOINT_PATH, patched, size);
+  assert(!simulator_restore(CHECKPOINT_PATH, 1, NULL));
+
+  // The untouched image still restores
+  write_file(CHECKPOINT_PATH, image, size);
+  simulator = simulator_restore(CHECKPOINT_PATH, 1, NULL);
+  assert(simulator);
+  kill_and_wait(simulator, pid);
+  simulator_stop(simulator);
+
+  free(patched);
+  free(image);
+  unlink(CHECKPOINT_PATH);
+}
+
+// A checkpoint is refused when the path leaves no room for its temporary name
+void test_checkpoint_path_too_long() {
+  printf("Test checkpoint path too long\n");
+  SimulatorT* simulator = simulator_start(1, 16, NULL);
+  char path[PATH_MAX];
+  memset(path, 'x', sizeof(path) - 1);
+  path[sizeof(path) - 1] = '\0';
+  assert(!simulator_checkpoint(simulator, path));
+  simulator_stop(simulator);
+}
+
+#define TRACE_PATH "simulator.tests.trace"
+#define OTHER_TRACE_PATH "simulator.tests.other.trace"
+
+// Only the first of two traced instances records. The other keeps running
+// untraced after the owner stops and writes its file.
+void test_trace_owned_by_one_instance() {
+  printf("Test trace owned by one instance\n");
+  unlink(TRACE_PATH);
+  unlink(OTHER_TRACE_PATH);
+  SimulatorConfigT const owner_config = { .trace_path = TRACE_PATH };
+  SimulatorConfigT const other_config = { .trace_path = OTHER_TRACE_PATH };
+  SimulatorT* owner = simulator_start(1, 16, &owner_config);
+  SimulatorT* other = simulator_start(1, 16, &other_config);
+  ProcessIdT const owned = simulator_create_process(owner, evaluator_infinite_loop);
+  ProcessIdT const spinning = simulator_create_process(other, evaluator_infinite_loop);
+  assert(owned && spinning);
+  kill_and_wait(owner, owned);
+  simulator_stop(owner);
+  assert(access(TRACE_PATH, F_OK) == 0);
+
+  ProcessIdT const pid = simulator_create_process(other, evaluator_terminates_after(TIME_SLICE_LENGTH));
+  assert(pid);
+  simulator_wait(other, pid);
+  kill_and_wait(other, spinning);
+  simulator_stop(other);
+  assert(access(OTHER_TRACE_PATH, F_OK) != 0);
+  unlink(TRACE_PATH);
+}
+
+// A kill that lands mid-slice is taken when the slice completes, even one
+// coalescing many slices, and the process is not put back in the run queue
+void test_kill_while_running() {
+  printf("Test kill while running\n");
+  SimulatorConfigT const config = { .coalesce_slices = 1u << 20 };
+  SimulatorT* simulator = simulator_start(1, 16, &config);
+  ProcessIdT const pid = simulator_create_process(simulator, evaluator_infinite_loop);
+  assert(pid);
+  usleep(20000);
+  kill_and_wait(simulator, pid);
+  wait_for_live(simulator, 0);
+  unsigned long long const dispatches = simulator_report(simulator).dispatches;
+  usleep(20000);
+  assert(simulator_report(simulator).dispatches == dispatches);
+  simulator_stop(simulator);
+}
+
+// A process killed while it waits in the run queue is released once, when a
+// worker unlinks it, so its PCB is handed out again exactly once
+void test_kill_while_queued() {
+  printf("Test kill while queued\n");
+  SimulatorT* simulator = simulator_start(1, 16, NULL);
+  ProcessIdT const running = simulator_create_process(simulator, evaluator_infinite_loop);
+  ProcessIdT const queued = simulator_create_process(simulator, evaluator_infinite_loop);
+  assert(running && queued);
+  kill_and_wait(simulator, queued);
+  wait_for_live(simulator, 1);
+
+  ProcessIdT const first = simulator_create_process(simulator, evaluator_infinite_loop);
+  ProcessIdT const second = simulator_create_process(simulator, evaluator_infinite_loop);
+  assert(first && second && first != second && first != running && second != running);
+  assert(simulator_occupancy(simulator).live == 3);
+  ProcessIdT const pids[3] = { running, first, second };
+  simulator_kill_many(simulator, pids, 3);
+  simulator_wait_many(simulator, pids, 3);
+  wait_for_live(simulator, 0);
+  simulator_stop(simulator);
+}
+
+#define RACED_PROCESSES 200
+
+// Waits on each process as soon as it is created, racing its termination
+typedef struct {
+  SimulatorT* simulator;
+  ProcessIdT pids[RACED_PROCESSES];
+  atomic_uint created;
+} RacingWaiterT;
+
+static void* wait_racing(void* argument) {
+  RacingWaiterT* waiter = (RacingWaiterT*)argument;
+  for(unsigned int i = 0; i != RACED_PROCESSES; ++i) {
+    while(atomic_load(&waiter->created) <= i) {
+      sched_yield();
+    }
+    simulator_wait(waiter->simulator, waiter->pids[i]);
+  }
+  return NULL;
+}
+
+// A wait that begins as its process terminates still returns
+void test_wait_races_termination() {
+  printf("Test wait races termination\n");
+  static RacingWaiterT waiter;
+  waiter.simulator = simulator_start(2, 16, NULL);
+  atomic_init(&waiter.created, 0);
+  pthread_t thread;
+  assert(pthread_create(&thread, NULL, wait_racing, &waiter) == 0);
+  for(unsigned int i = 0; i != RACED_PROCESSES; ++i) {
+    waiter.pids[i] = simulator_create_process(waiter.simulator, evaluator_terminates_after(1 + i % 3));
+    assert(waiter.pids[i]);
+    atomic_store(&waiter.created, i + 1);
+  }
+  assert(pthread_join(thread, NULL) == 0);
+  wait_for_live(waiter.simulator, 0);
+  simulator_stop(waiter.simulator);
+}
+
+#define KILLED_PROCESSES 64
+
+// Bulk kills land while every worker is dispatching and contending for the lock
+void test_kill_many_under_load() {
+  printf("Test kill many under load\n");
+  SimulatorT* simulator = simulator_start(4, KILLED_PROCESSES, NULL);
+  EvaluatorCodeT codes[KILLED_PROCESSES];
+  for(unsigned int i = 0; i != KILLED_PROCESSES; ++i) {
+    codes[i] = i % 2 ? evaluator_infinite_loop : evaluator_terminates_after(TIME_SLICE_LENGTH * (1 + i));
+  }
+  ProcessIdT pids[KILLED_PROCESSES];
+  for(unsigned int round = 0; round != 20; ++round) {
+    assert(simulator_create_processes(simulator, codes, KILLED_PROCESSES, pids) == KILLED_PROCESSES);
+    simulator_kill_many(simulator, pids, KILLED_PROCESSES);
+    simulator_wait_many(simulator, pids, KILLED_PROCESSES);
+    wait_for_live(simulator, 0);
+  }
+  simulator_stop(simulator);
+}
+
+// A PID is handed out again once its process has been reaped. A stale kill
+// of the reaped PID before then does nothing, and the new process is live.
+void test_pid_reused_after_reap() {
+  printf("Test PID reused after reap\n");
+  SimulatorT* simulator = simulator_start(1, 16, NULL);
+  ProcessIdT const pid = simulator_create_process(simulator, evaluator_terminates_after(1));
+  assert(pid);
+  simulator_wait(simulator, pid);
+  simulator_kill(simulator, pid);
+
+  ProcessIdT const reused = simulator_create_process(simulator, evaluator_infinite_loop);
+  assert(reused == pid);
+  usleep(20000);
+  assert(simulator_occupancy(simulator).live == 1);
+  assert(simulator_report(simulator).dispatches > 1);
+  kill_and_wait(simulator, reused);
+  wait_for_live(simulator, 0);
+  simulator_stop(simulator);
+}
+
+// Per-core counters once cond holds for them, polling for up to five seconds
+static void poll_cores(SimulatorT* simulator, SimulatorCoreReportT* cores, unsigned int n,
+                       bool (*cond)(SimulatorCoreReportT const*)) {
+  for(unsigned int i = 0; i != 5000; ++i) {
+    assert(simulator_core_report(simulator, cores, n) == n);
+    if(cond(cores)) {
+      return;
+    }
+    usleep(1000);
+  }
+  assert(!"core counters never reached the expected state");
+}
+
+// Restart the counters and poll until cond holds, twice. A dispatch is
+// counted when its slice completes, so by the second restart every slice
+// that began before the caller changed masks has been counted and cleared.
+static void restart_cores(SimulatorT* simulator, int threads, SimulatorConfigT const* config,
+                          SimulatorCoreReportT* cores, unsigned int n, bool (*cond)(SimulatorCoreReportT const*)) {
+  for(unsigned int i = 0; i != 2; ++i) {
+    simulator_reconfigure(simulator, threads, config);
+    poll_cores(simulator, cores, n, cond);
+  }
+}
+
+static bool core_0_dispatched(SimulatorCoreReportT const* cores) {
+  return cores[0].dispatches >= 20;
+}
+
+static bool core_1_dispatched(SimulatorCoreReportT const* cores) {
+  return cores[1].dispatches > 0 && cores[1].cpu_time > 0;
+}
+
+static bool core_2_dispatched(SimulatorCoreReportT const* cores) {
+  return cores[2].dispatches >= 20;
+}
+
+// Once pinned, processes are dispatched on their allowed cores only
+void test_affinity_respected() {
+  printf("Test affinity respected\n");
+  SimulatorConfigT const config = { .simulated_cores = 4, .core_placement = core_placement_least_loaded };
+  SimulatorT* simulator = simulator_start(2, 16, &config);
+  ProcessIdT pids[6];
+  for(unsigned int i = 0; i != 6; ++i) {
+    pids[i] = simulator_create_process(simulator, evaluator_infinite_loop);
+    assert(pids[i]);
+    assert(simulator_set_affinity(simulator, pids[i], 1ULL << 2));
+  }
+  // Masks naming no modelled core are refused
+  assert(!simulator_set_affinity(simulator, pids[0], 1ULL << 4));
+  // Every dispatch counted from here follows the masks
+  SimulatorCoreReportT cores[4];
+  restart_cores(simulator, 2, &config, cores, 4, core_2_dispatched);
+  assert(cores[0].dispatches == 0 && cores[1].dispatches == 0 && cores[3].dispatches == 0);
+  simulator_kill_many(simulator, pids, 6);
+  simulator_wait_many(simulator, pids, 6);
+  simulator_stop(simulator);
+
+  simulator = simulator_start(1, 16, NULL);
+  ProcessIdT const pid = simulator_create_process(simulator, evaluator_infinite_loop);
+  assert(!simulator_set_affinity(simulator, pid, 1));
+  kill_and_wait(simulator, pid);
+  simulator_stop(simulator);
+}
+
+#define MIGRATION_PENALTY 1000000
+
+// A process moved to another core is charged the penalty on the core it moved to
+void test_migration_penalty() {
+  printf("Test migration penalty\n");
+  SimulatorConfigT const config = { .simulated_cores = 2, .migration_penalty = MIGRATION_PENALTY };
+  SimulatorT* simulator = simulator_start(1, 16, &config);
+  ProcessIdT const pid = simulator_create_process(simulator, evaluator_infinite_loop);
+  assert(pid);
+  assert(simulator_set_affinity(simulator, pid, 1ULL << 0));
+  SimulatorCoreReportT cores[2];
+  restart_cores(simulator, 1, &config, cores, 2, core_0_dispatched);
+  assert(cores[1].dispatches == 0);
+
+  assert(simulator_set_affinity(simulator, pid, 1ULL << 1));
+  poll_cores(simulator, cores, 2, core_1_dispatched);
+  assert(cores[1].migrations == 1);
+  assert(cores[1].cpu_time >= MIGRATION_PENALTY);
+  assert(cores[0].cpu_time < MIGRATION_PENALTY);
+  SimulatorReportT const report = simulator_report(simulator);
+  assert(report.migrations == 1);
+  assert(report.cpu_time >= MIGRATION_PENALTY);
+  kill_and_wait(simulator, pid);
+  simulator_stop(simulator);
+}
+
+// Processes that stay with their last core pile up on one queue until the
+// balancer moves some to the idle core
+void test_balancer_moves() {
+  printf("Test balancer moves\n");
+  SimulatorConfigT const config = { .simulated_cores = 2, .core_placement = core_placement_last,
+                                    .balance_interval = TIME_SLICE_LENGTH };
+  SimulatorT* simulator = simulator_start(1, 16, &config);
+  ProcessIdT pids[6];
+  for(unsigned int i = 0; i != 6; ++i) {
+    pids[i] = simulator_create_process(simulator, evaluator_infinite_loop);
+    assert(pids[i]);
+    assert(simulator_set_affinity(simulator, pids[i], 1ULL << 0));
+  }
+  SimulatorCoreReportT cores[2];
+  // Each has run on core 0 since, which is now its last core
+  restart_cores(simulator, 1, &config, cores, 2, core_0_dispatched);
+  assert(cores[1].dispatches == 0);
+
+  for(unsigned int i = 0; i != 6; ++i) {
+    assert(simulator_set_affinity(simulator, pids[i], 0));
+  }
+  simulator_reconfigure(simulator, 1, &config);
+  poll_cores(simulator, cores, 2, core_1_dispatched);
+  assert(simulator_report(simulator).balancer_moves > 0);
+  simulator_kill_many(simulator, pids, 6);
+  simulator_wait_many(simulator, pids, 6);
+  simulator_stop(simulator);
+}
+
+#define SEND(message) EVALUATOR_INSTRUCTION(op_send, message)
+#define RECEIVE EVALUATOR_INSTRUCTION(op_receive, 0)
+// Keeps a process alive after its exchanges, so what it received can be
+// read; at is the index of the first of its two instructions
+#define SPIN(at) EVALUATOR_INSTRUCTION(op_compute, 1), EVALUATOR_INSTRUCTION(op_loop, at)
+
+static ProcessIdT create_program(SimulatorT* simulator, EvaluatorInstructionT const* instructions, unsigned int length) {
+  EvaluatorProgramT const* program = evaluator_program_create(instructions, length);
+  assert(program);
+  ProcessIdT const pid = simulator_create_process(simulator, evaluator_program(program));
+  assert(pid);
+  return pid;
+}
+
+// Report once cond holds for it, polling for up to five seconds
+static SimulatorReportT poll_report(SimulatorT* simulator, bool (*cond)(SimulatorReportT const*)) {
+  for(unsigned int i = 0; i != 5000; ++i) {
+    SimulatorReportT const report = simulator_report(simulator);
+    if(cond(&report)) {
+      return report;
+    }
+    usleep(1000);
+  }
+  assert(!"report never reached the expected state");
+  return simulator_report(simulator);
+}
+
+static bool two_sent(SimulatorReportT const* report) {
+  return report->messages_sent == 2;
+}
+
+static bool receive_blocked(SimulatorReportT const* report) {
+  return report->receive_blocks > 0;
+}
+
+// A send to a full mailbox blocks the sender, and killing the receiver
+// wakes it with its message dropped
+void test_send_to_full_mailbox() {
+  printf("Test send to full mailbox\n");
+  SimulatorConfigT const config = { .mailbox_capacity = 2 };
+  SimulatorT* simulator = simulator_start(1, 16, &config);
+  EvaluatorInstructionT const idle[] = { SPIN(0) };
+  EvaluatorInstructionT const sends[] = { SEND(1), SEND(2), SEND(3), SEND(4) };
+  ProcessIdT const receiver = create_program(simulator, idle, 2);
+  ProcessIdT const sender = create_program(simulator, sends, 4);
+  assert(simulator_connect(simulator, sender, receiver));
+  // A second peer, or a second sender to one mailbox, is refused
+  assert(!simulator_connect(simulator, sender, receiver));
+  assert(!simulator_connect(simulator, receiver, receiver));
+
+  poll_report(simulator, two_sent);
+  usleep(20000);
+  SimulatorReportT report = simulator_report(simulator);
+  assert(report.messages_sent == 2 && report.send_blocks > 0);
+  assert(simulator_occupancy(simulator).live == 2);
+
+  // The two queued and the one pending are lost, the last is dropped on sending
+  kill_and_wait(simulator, receiver);
+  simulator_wait(simulator, sender);
+  report = simulator_report(simulator);
+  assert(report.messages_sent == 2 && report.messages_received == 0);
+  assert(report.messages_dropped == 4);
+  simulator_stop(simulator);
+}
+
+// A receive from an empty mailbox blocks until a message is delivered to it,
+// which the receiver then holds
+void test_receive_from_empty_mailbox() {
+  printf("Test receive from empty mailbox\n");
+  SimulatorT* simulator = simulator_start(1, 16, NULL);
+  EvaluatorInstructionT const receives[] = { RECEIVE, SPIN(1) };
+  ProcessIdT const receiver = create_program(simulator, receives, 3);
+  poll_report(simulator, receive_blocked);
+  usleep(20000);
+  assert(simulator_report(simulator).messages_received == 0);
+  assert(simulator_received(simulator, receiver) == 0);
+
+  EvaluatorInstructionT const sends[] = { SEND(42) };
+  ProcessIdT const sender = create_program(simulator, sends, 1);
+  assert(simulator_connect(simulator, sender, receiver));
+  simulator_wait(simulator, sender);
+  while(simulator_received(simulator, receiver) != 42) {
+    usleep(1000);
+  }
+  SimulatorReportT const report = simulator_report(simulator);
+  assert(report.messages_sent == 1 && report.messages_received == 1 && report.receive_blocks == 1);
+  kill_and_wait(simulator, receiver);
+  simulator_stop(simulator);
+}
+
+static bool four_received(SimulatorReportT const* report) {
+  return report->messages_received == 4;
+}
+
+// A sender blocked on a full mailbox is refilled from by the receiver, so
+// every message arrives in order and none is dropped
+void test_blocked_sender_refilled() {
+  printf("Test blocked sender refilled\n");
+  SimulatorConfigT const config = { .mailbox_capacity = 2 };
+  SimulatorT* simulator = simulator_start(1, 16, &config);
+  // The receiver computes first, so the sender fills the mailbox and blocks
+  EvaluatorInstructionT const receives[] = {
+    EVALUATOR_INSTRUCTION(op_compute, 20), RECEIVE, RECEIVE, RECEIVE, RECEIVE, SPIN(5)
+  };
+  EvaluatorInstructionT const sends[] = { SEND(1), SEND(2), SEND(3), SEND(4) };
+  ProcessIdT const receiver = create_program(simulator, receives, 7);
+  ProcessIdT const sender = create_program(simulator, sends, 4);
+  assert(simulator_connect(simulator, sender, receiver));
+  simulator_wait(simulator, sender);
+  SimulatorReportT const report = poll_report(simulator, four_received);
+  assert(report.messages_sent == 4 && report.messages_dropped == 0 && report.send_blocks > 0);
+  assert(simulator_received(simulator, receiver) == 4);
+  kill_and_wait(simulator, receiver);
+  simulator_stop(simulator);
+}
+
+// Killing a sender wakes the receiver blocked on it, and later receives
+// on the empty mailbox return at once
+void test_killed_sender_closes_mailbox() {
+  printf("Test killed sender closes mailbox\n");
+  SimulatorT* simulator = simulator_start(1, 16, NULL);
+  EvaluatorInstructionT const receives[] = { RECEIVE, RECEIVE, RECEIVE };
+  EvaluatorInstructionT const idle[] = { SPIN(0) };
+  ProcessIdT const receiver = create_program(simulator, receives, 3);
+  ProcessIdT const sender = create_program(simulator, idle, 2);
+  assert(simulator_connect(simulator, sender, receiver));
+  poll_report(simulator, receive_blocked);
+  kill_and_wait(simulator, sender);
+  simulator_wait(simulator, receiver);
+  assert(simulator_report(simulator).messages_received == 0);
+  simulator_stop(simulator);
+}
+
+// Messages pass down a pipeline, each stage sending on what it received
+void test_pipeline_forwards_messages() {
+  printf("Test pipeline forwards messages\n");
+  SimulatorT* simulator = simulator_start(2, 16, NULL);
+  EvaluatorInstructionT const source[] = { SEND(5), SEND(6) };
+  EvaluatorInstructionT const relay[] = {
+    RECEIVE, SEND(EVALUATOR_MESSAGE_RECEIVED), RECEIVE, SEND(EVALUATOR_MESSAGE_RECEIVED), SPIN(4)
+  };
+  EvaluatorInstructionT const sink[] = { RECEIVE, RECEIVE, SPIN(2) };
+  ProcessIdT const last = create_program(simulator, sink, 4);
+  ProcessIdT const middle = create_program(simulator, relay, 6);
+  ProcessIdT const first = create_program(simulator, source, 2);
+  assert(simulator_connect(simulator, middle, last));
+  assert(simulator_connect(simulator, first, middle));
+  simulator_wait(simulator, first);
+  while(simulator_received(simulator, last) != 6) {
+    usleep(1000);
+  }
+  assert(simulator_received(simulator, middle) == 6);
+  SimulatorReportT const report = simulator_report(simulator);
+  assert(report.messages_sent == 4 && report.messages_received == 4 && report.messages_dropped == 0);
+  kill_and_wait(simulator, middle);
+  kill_and_wait(simulator, last);
+  simulator_stop(simulator);
+}
+
+int main() {
+  logger_start();
+  logger_set_output(NULL);
+  test_hopeless_deadline_dropped_early();
+  test_admission_fifo();
+  test_admission_timeout();
+  test_program_table_reused();
+  test_slices_count_quantum_length();
+  test_watermark_throttle();
+  test_checkpoint_round_trip();
+  test_checkpoint_rejects_mismatches();
+  test_checkpoint_path_too_long();
+  test_trace_owned_by_one_instance();
+  test_kill_while_running();
+  test_kill_while_queued();
+  test_wait_races_termination();
+  test_kill_many_under_load();
+  test_pid_reused_after_reap();
+  test_affinity_respected();
+  test_migration_penalty();
+  test_balancer_moves();
+  test_send_to_full_mailbox();
+  test_receive_from_empty_mailbox();
+  test_blocked_sender_refilled();
+  test_killed_sender_closes_mailbox();
+  test_pipeline_forwards_messages();
+  logger_stop();
+}
@@ -0,0 +1,201 @@
+#include "stats.h"
+#include "utilities.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+char const* const stats_counter_names[stats_counter_count] = {
+  "dispatches", "timeslice", "blocked", "terminated", "creates", "kills", "wakes", "lock_wait_ns",
+};
+
+char const* const stats_gauge_names[stats_gauge_count] = {
+  "ready", "blocked", "live", "workers", "parked",
+};
+
+__thread StatsBlockT* stats_block = NULL;
+
+// Blocks are never freed. When a thread exits its counts are folded into
+// retired and its block goes on the spare list for the next thread to
+// register, so the registry is only as long as the most threads ever alive at once.
+static pthread_mutex_t registry_mutex = PTHREAD_MUTEX_INITIALIZER;
+static StatsBlockT* blocks = NULL;
+static StatsBlockT* spare = NULL;
+static unsigned long long retired[stats_counter_count];
+static unsigned int block_count = 0;  // Threads currently registered
+static pthread_key_t exit_key;
+static pthread_once_t exit_key_once = PTHREAD_ONCE_INIT;
+// Guarded by sampler_mutex so a sampler's context is never used after it is cleared
+static pthread_mutex_t sampler_mutex = PTHREAD_MUTEX_INITIALIZER;
+static void (*sampler)(void* context, unsigned long long gauges[stats_gauge_count]) = NULL;
+static void* sampler_context = NULL;
+
+static pthread_t publisher;
+static pthread_mutex_t publisher_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t publisher_condition = PTHREAD_COND_INITIALIZER;
+static bool publisher_active = false;
+static unsigned int publish_interval_ms;
+static StatsFileT* mapped = NULL;
+
+// Run at thread exit for every thread that registered. Folding and zeroing
+// under the registry lock keeps collected totals from going backwards.
+static void unregister_thread(void* value) {
+  StatsBlockT* block = value;
+  pthread_mutex_lock(&registry_mutex);
+  for(int i = 0; i != stats_counter_count; ++i) {
+    retired[i] += atomic_load_explicit(&block->counters[i], memory_order_relaxed);
+    atomic_store_explicit(&block->counters[i], 0, memory_order_relaxed);
+  }
+  block->spare = spare;
+  spare = block;
+  block_count--;
+  pthread_mutex_unlock(&registry_mutex);
+  stats_block = NULL;
+}
+
+static void create_exit_key() {
+  if(pthread_key_create(&exit_key, unregister_thread)) abort();
+}
+
+StatsBlockT* stats_register_thread() {
+  pthread_once(&exit_key_once, create_exit_key);
+  pthread_mutex_lock(&registry_mutex);
+  StatsBlockT* block = spare;
+  if(block) {
+    spare = block->spare;
+  } else {
+    if(posix_memalign((void**)&block, CACHE_LINE_SIZE, sizeof(StatsBlockT))) abort();
+    memset(block, 0, sizeof(StatsBlockT));
+    block->next = blocks;
+    blocks = block;
+  }
+  block_count++;
+  pthread_mutex_unlock(&registry_mutex);
+
+  pthread_setspecific(exit_key, block);
+  stats_block = block;
+  return block;
+}
+
+void stats_collect(unsigned long long counters[stats_counter_count]) {
+  pthread_mutex_lock(&registry_mutex);
+  memcpy(counters, retired, sizeof(retired));
+  for(StatsBlockT* block = blocks; block; block = block->next) {
+    for(int i = 0; i != stats_counter_count; ++i) {
+      counters[i] += atomic_load_explicit(&block->counters[i], memory_order_relaxed);
+    }
+  }
+  pthread_mutex_unlock(&registry_mutex);
+}
+
+// Threads holding a block now
+static unsigned int registered_threads() {
+  pthread_mutex_lock(&registry_mutex);
+  unsigned int const threads = block_count;
+  pthread_mutex_unlock(&registry_mutex);
+  return threads;
+}
+
+void stats_set_sampler(void (*fill)(void* context, unsigned long long gauges[stats_gauge_count]),
+                       void* context) {
+  pthread_mutex_lock(&sampler_mutex);
+  sampler = fill;
+  sampler_context = context;
+  pthread_mutex_unlock(&sampler_mutex);
+}
+
+void stats_clear_sampler(void* context) {
+  pthread_mutex_lock(&sampler_mutex);
+  if(sampler_context == context) {
+    sampler = NULL;
+    sampler_context = NULL;
+  }
+  pthread_mutex_unlock(&sampler_mutex);
+}
+
+static void publish() {
+  unsigned long long counters[stats_counter_count];
+  unsigned long long gauges[stats_gauge_count] = { 0 };
+  stats_collect(counters);
+  pthread_mutex_lock(&sampler_mutex);
+  if(sampler) sampler(sampler_context, gauges);
+  pthread_mutex_unlock(&sampler_mutex);
+
+  atomic_fetch_add_explicit(&mapped->sequence, 1, memory_order_acq_rel);  // Now odd
+  mapped->threads = registered_threads();
+  mapped->timestamp_ns = monotonic_ns();
+  memcpy(mapped->counters, counters, sizeof(counters));
+  memcpy(mapped->gauges, gauges, sizeof(gauges));
+  atomic_fetch_add_explicit(&mapped->sequence, 1, memory_order_release);  // Even again
+}
+
+static void* publisher_routine(void* unused) {
+  pthread_mutex_lock(&publisher_mutex);
+  while(publisher_active) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_nsec += (publish_interval_ms % 1000) * 1000000L;
+    deadline.tv_sec += publish_interval_ms / 1000 + deadline.tv_nsec / 1000000000L;
+    deadline.tv_nsec %= 1000000000L;
+    pthread_cond_timedwait(&publisher_condition, &publisher_mutex, &deadline);
+    publish();
+  }
+  pthread_mutex_unlock(&publisher_mutex);
+  return NULL;
+}
+
+void stats_start(char const* path, unsigned int interval_ms) {
+  int const fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if(fd < 0 || ftruncate(fd, sizeof(StatsFileT)) != 0) {
+    fprintf(stderr, "Error: Unable to create stats file %s\n", path);
+    exit(EXIT_FAILURE);
+  }
+  void* memory = mmap(NULL, sizeof(StatsFileT), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if(memory == MAP_FAILED) {
+    fprintf(stderr, "Error: Unable to map stats file %s\n", path);
+    exit(EXIT_FAILURE);
+  }
+
+  mapped = memory;
+  mapped->magic = STATS_FILE_MAGIC;
+  mapped->version = STATS_FILE_VERSION;
+  publish_interval_ms = interval_ms ? interval_ms : 1;
+  publisher_active = true;
+  publish();
+
+  if(pthread_create(&publisher, NULL, publisher_routine, NULL) != 0) {
+    fprintf(stderr, "Error: Failed to create stats publisher thread\n");
+    exit(EXIT_FAILURE);
+  }
+}
+
+void stats_stop() {
+  if(!mapped) return;
+  pthread_mutex_lock(&publisher_mutex);
+  publisher_active = false;
+  pthread_cond_signal(&publisher_condition);
+  pthread_mutex_unlock(&publisher_mutex);
+  pthread_join(publisher, NULL);
+
+  publish();
+  munmap(mapped, sizeof(StatsFileT));
+  mapped = NULL;
+}
+
+void stats_read(StatsFileT const* file, StatsFileT* snapshot) {
+  StatsFileT* shared = (StatsFileT*)file;
+  for(;;) {
+    unsigned int const before = atomic_load_explicit(&shared->sequence, memory_order_acquire);
+    if(before % 2 == 0) {
+      memcpy(snapshot, file, sizeof(StatsFileT));
+      atomic_thread_fence(memory_order_acquire);
+      if(atomic_load_explicit(&shared->sequence, memory_order_relaxed) == before) return;
+    }
+    usleep(100);
+  }
+}
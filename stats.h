@@ -0,0 +1,90 @@
+#ifndef _STATS_H_
+#define _STATS_H_
+
+#include "utilities.h"
+
+#include <stdatomic.h>
+
+// Live statistics. Every thread counts into a block of its own, so the hot
+// path is a plain load and store with no lock or atomic read-modify-write.
+// Blocks are summed on demand and published into a memory-mapped file that
+// simtop (or anything else) can read while the simulator runs.
+
+typedef enum StatsCounter {
+  stats_dispatches,
+  stats_slices_timeslice,   // Slices by the reason they ended
+  stats_slices_blocked,
+  stats_slices_terminated,
+  stats_creates,
+  stats_kills,
+  stats_wakes,
+  stats_lock_wait_ns,       // Time workers spent waiting for process_mutex
+  stats_counter_count
+} StatsCounterT;
+
+typedef enum StatsGauge {
+  stats_ready_depth,
+  stats_blocked_depth,
+  stats_live_processes,
+  stats_active_workers,
+  stats_parked_workers,
+  stats_gauge_count
+} StatsGaugeT;
+
+extern char const* const stats_counter_names[stats_counter_count];
+extern char const* const stats_gauge_names[stats_gauge_count];
+
+typedef struct StatsBlock {
+  atomic_ullong counters[stats_counter_count];
+  struct StatsBlock* next;   // Registry of every block
+  struct StatsBlock* spare;  // Blocks no thread holds, reused by the next to register
+} __attribute__((aligned(CACHE_LINE_SIZE))) StatsBlockT;
+
+extern __thread StatsBlockT* stats_block;
+
+// Give the calling thread a block, reusing one an exited thread left. At
+// thread exit its counts move into the retired totals and the block is kept for reuse
+StatsBlockT* stats_register_thread();
+
+// Count n events against the calling thread - only that thread writes its block
+static inline void stats_add(StatsCounterT counter, unsigned long long n) {
+  StatsBlockT* block = stats_block ? stats_block : stats_register_thread();
+  atomic_store_explicit(&block->counters[counter],
+                        atomic_load_explicit(&block->counters[counter], memory_order_relaxed) + n,
+                        memory_order_relaxed);
+}
+
+// Sum every thread's counters
+void stats_collect(unsigned long long counters[stats_counter_count]);
+
+// Fills gauges when a snapshot is published. There is one sampler per
+// process, the last one set wins; counters always cover every thread.
+void stats_set_sampler(void (*sampler)(void* context, unsigned long long gauges[stats_gauge_count]),
+                       void* context);
+// Remove the sampler if it was set with this context
+void stats_clear_sampler(void* context);
+
+// Layout of the published file. Readers retry while sequence is odd or
+// changes across their copy.
+#define STATS_FILE_MAGIC 0x53494d53u  // "SIMS"
+#define STATS_FILE_VERSION 1
+
+typedef struct StatsFile {
+  unsigned int magic;
+  unsigned int version;
+  atomic_uint sequence;
+  unsigned int threads;     // Threads holding a block when it was published
+  unsigned long long timestamp_ns;
+  unsigned long long counters[stats_counter_count];
+  unsigned long long gauges[stats_gauge_count];
+} StatsFileT;
+
+// Publish a snapshot to path every interval_ms from a background thread
+void stats_start(char const* path, unsigned int interval_ms);
+// Publish a final snapshot and stop
+void stats_stop();
+
+// Copy a consistent snapshot out of a mapped stats file
+void stats_read(StatsFileT const* file, StatsFileT* snapshot);
+
+#endif
@@ -0,0 +1,107 @@
+#include "stats.h"
+
+#include <assert.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define THREADS 4
+#define EVENTS 100000
+
+void* count_routine(void* arg) {
+  for (int i = 0; i != EVENTS; ++i) {
+    stats_add(stats_dispatches, 1);
+    stats_add(stats_creates, 2);
+  }
+  return NULL;
+}
+
+void test_stats_collect() {
+  printf("Test stats collect\n");
+  unsigned long long before[stats_counter_count];
+  stats_collect(before);
+
+  pthread_t threads[THREADS];
+  for (int i = 0; i != THREADS; ++i) {
+    pthread_create(&threads[i], NULL, count_routine, NULL);
+  }
+  for (int i = 0; i != THREADS; ++i) {
+    pthread_join(threads[i], NULL);
+  }
+
+  // Totals survive their threads exiting
+  unsigned long long after[stats_counter_count];
+  stats_collect(after);
+  assert(after[stats_dispatches] - before[stats_dispatches] == THREADS * EVENTS);
+  assert(after[stats_creates] - before[stats_creates] == 2 * THREADS * EVENTS);
+  assert(after[stats_kills] == before[stats_kills]);
+}
+
+void* block_routine(void* arg) {
+  stats_add(stats_kills, 1);
+  return stats_block;
+}
+
+void test_stats_block_reused() {
+  printf("Test stats block reused\n");
+  unsigned long long before[stats_counter_count];
+  stats_collect(before);
+
+  // Each thread exits before the next starts, so all of them share one block
+  void* first = NULL;
+  for (int i = 0; i != THREADS; ++i) {
+    pthread_t thread;
+    void* block;
+    pthread_create(&thread, NULL, block_routine, NULL);
+    pthread_join(thread, &block);
+    assert(block);
+    assert(!first || block == first);
+    first = block;
+  }
+
+  unsigned long long after[stats_counter_count];
+  stats_collect(after);
+  assert(after[stats_kills] - before[stats_kills] == THREADS);
+}
+
+void sample(void* context, unsigned long long gauges[stats_gauge_count]) {
+  gauges[stats_ready_depth] = 7;
+}
+
+void test_stats_file() {
+  printf("Test stats file\n");
+  char path[] = "/tmp/stats.testsXXXXXX";
+  close(mkstemp(path));
+
+  stats_set_sampler(sample, NULL);
+  stats_start(path, 10);
+  stats_add(stats_wakes, 3);
+  stats_stop();
+  stats_clear_sampler(NULL);
+
+  int const fd = open(path, O_RDONLY);
+  assert(fd >= 0);
+  StatsFileT const* file = mmap(NULL, sizeof(StatsFileT), PROT_READ, MAP_SHARED, fd, 0);
+  assert(file != MAP_FAILED);
+  close(fd);
+
+  StatsFileT snapshot;
+  stats_read(file, &snapshot);
+  assert(snapshot.magic == STATS_FILE_MAGIC);
+  assert(snapshot.version == STATS_FILE_VERSION);
+  assert(snapshot.sequence % 2 == 0);
+  assert(snapshot.counters[stats_wakes] == 3);
+  assert(snapshot.gauges[stats_ready_depth] == 7);
+  assert(snapshot.threads >= 1);
+
+  munmap((void*)file, sizeof(StatsFileT));
+  unlink(path);
+}
+
+int main() {
+  test_stats_collect();
+  test_stats_block_reused();
+  test_stats_file();
+}
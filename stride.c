@@ -0,0 +1,170 @@
+#include "stride.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// The group heap stores group indices and keeps each group's position up to date
+static bool group_before(StrideSchedulerT const* scheduler, unsigned int a, unsigned int b) {
+  unsigned long long const pass_a = scheduler->groups[a].pass;
+  unsigned long long const pass_b = scheduler->groups[b].pass;
+  return pass_a < pass_b || (pass_a == pass_b && a < b);
+}
+
+static void order_place(StrideSchedulerT* scheduler, unsigned int i, unsigned int group) {
+  scheduler->order[i] = group;
+  scheduler->groups[group].position = i;
+}
+
+static void order_sift_up(StrideSchedulerT* scheduler, unsigned int i) {
+  unsigned int const group = scheduler->order[i];
+  while (i > 0) {
+    unsigned int const parent = (i - 1) / 2;
+    if (!group_before(scheduler, group, scheduler->order[parent])) {
+      break;
+    }
+    order_place(scheduler, i, scheduler->order[parent]);
+    i = parent;
+  }
+  order_place(scheduler, i, group);
+}
+
+static void order_sift_down(StrideSchedulerT* scheduler, unsigned int i) {
+  unsigned int const group = scheduler->order[i];
+  for (;;) {
+    unsigned int child = 2 * i + 1;
+    if (child >= scheduler->order_length) {
+      break;
+    }
+    if (child + 1 < scheduler->order_length && group_before(scheduler, scheduler->order[child + 1], scheduler->order[child])) {
+      child++;
+    }
+    if (!group_before(scheduler, scheduler->order[child], group)) {
+      break;
+    }
+    order_place(scheduler, i, scheduler->order[child]);
+    i = child;
+  }
+  order_place(scheduler, i, group);
+}
+
+static void order_insert(StrideSchedulerT* scheduler, unsigned int group) {
+  order_place(scheduler, scheduler->order_length++, group);
+  order_sift_up(scheduler, scheduler->order_length - 1);
+}
+
+static void order_remove(StrideSchedulerT* scheduler, unsigned int group) {
+  unsigned int const i = scheduler->groups[group].position;
+  scheduler->groups[group].position = STRIDE_NOT_QUEUED;
+  unsigned int const last = scheduler->order[--scheduler->order_length];
+  if (last != group) {
+    order_place(scheduler, i, last);
+    order_sift_up(scheduler, i);
+    order_sift_down(scheduler, scheduler->groups[last].position);
+  }
+}
+
+// Only the serialised caller writes length, so a load and store is enough
+static void add_length(StrideSchedulerT* scheduler, long delta) {
+  atomic_store_explicit(&scheduler->length, atomic_load_explicit(&scheduler->length, memory_order_relaxed) + delta,
+                        memory_order_relaxed);
+}
+
+void stride_init(StrideSchedulerT* scheduler) {
+  memset(scheduler, 0, sizeof(StrideSchedulerT));
+  atomic_init(&scheduler->length, 0);
+}
+
+void stride_destroy(StrideSchedulerT* scheduler) {
+  for (unsigned int i = 0; i < scheduler->group_count; i++) {
+    heap_destroy(&scheduler->groups[i].ready);
+  }
+  memset(scheduler, 0, sizeof(StrideSchedulerT));
+}
+
+unsigned long long stride_of(unsigned int tickets) {
+  return STRIDE_ONE / (tickets ? tickets : 1);
+}
+
+int stride_add_group(StrideSchedulerT* scheduler, char const* name, unsigned int tickets) {
+  if (scheduler->group_count == STRIDE_MAX_GROUPS) {
+    return -1;
+  }
+  StrideGroupT* group = &scheduler->groups[scheduler->group_count];
+  memset(group, 0, sizeof(StrideGroupT));
+  snprintf(group->name, sizeof(group->name), "%s", name ? name : "");
+  group->tickets = tickets ? tickets : 1;
+  group->stride = stride_of(group->tickets);
+  group->pass = scheduler->virtual_pass;
+  group->position = STRIDE_NOT_QUEUED;
+  heap_init(&group->ready);
+  return scheduler->group_count++;
+}
+
+bool stride_add_member(StrideSchedulerT* scheduler, unsigned int group) {
+  return heap_add_member(&scheduler->groups[group].ready);
+}
+
+void stride_remove_member(StrideSchedulerT* scheduler, unsigned int group) {
+  heap_remove_member(&scheduler->groups[group].ready);
+}
+
+unsigned long long stride_join_pass(StrideSchedulerT const* scheduler, unsigned int group, unsigned long long stride) {
+  return scheduler->groups[group].virtual_pass + stride;
+}
+
+void stride_push(StrideSchedulerT* scheduler, unsigned int group_index, unsigned int id, unsigned long long pass) {
+  StrideGroupT* group = &scheduler->groups[group_index];
+  heap_push(&group->ready, pass, id);
+  add_length(scheduler, 1);
+
+  // A group that sat idle rejoins at the current pass rather than with banked credit
+  if (group->position == STRIDE_NOT_QUEUED) {
+    if (group->pass < scheduler->virtual_pass) {
+      group->pass = scheduler->virtual_pass;
+    }
+    order_insert(scheduler, group_index);
+  }
+}
+
+bool stride_pop(StrideSchedulerT* scheduler, unsigned int* id, unsigned long long* pass, unsigned int* group_index) {
+  if (scheduler->order_length == 0) {
+    return false;
+  }
+  unsigned int const index = scheduler->order[0];
+  StrideGroupT* group = &scheduler->groups[index];
+
+  HeapEntryT const entry = heap_pop(&group->ready);
+  if (group->ready.length == 0) {
+    order_remove(scheduler, index);
+  }
+  add_length(scheduler, -1);
+
+  group->virtual_pass = entry.key;
+  scheduler->virtual_pass = group->pass;
+  *id = entry.id;
+  *pass = entry.key;
+  *group_index = index;
+  return true;
+}
+
+void stride_charge(StrideSchedulerT* scheduler, unsigned int group_index, long long units) {
+  StrideGroupT* group = &scheduler->groups[group_index];
+  // Unsigned wrap-around makes a negative charge a refund
+  group->pass += group->stride * (unsigned long long)units;
+  group->usage += (unsigned long long)units;
+  if (group->position != STRIDE_NOT_QUEUED) {
+    order_sift_up(scheduler, group->position);
+    order_sift_down(scheduler, group->position);
+  }
+}
+
+void stride_filter(StrideSchedulerT* scheduler, bool (*keep)(void* context, unsigned int id), void* context) {
+  for (unsigned int g = 0; g < scheduler->group_count; g++) {
+    StrideGroupT* group = &scheduler->groups[g];
+    unsigned int const removed = heap_filter(&group->ready, keep, context);
+    add_length(scheduler, -(long)removed);
+    if (group->ready.length == 0 && group->position != STRIDE_NOT_QUEUED) {
+      order_remove(scheduler, g);
+    }
+  }
+}
@@ -0,0 +1,77 @@
+#ifndef _STRIDE_H_
+#define _STRIDE_H_
+
+#include "heap.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+
+// Stride scheduling over share groups. Each group holds tickets and its ready
+// entries; each entry carries a pass value. The next entry comes from the
+// group with the lowest pass, and within it the entry with the lowest pass,
+// so a group's share of CPU time tracks its share of tickets. Groups are
+// kept in an indexed heap so their pass can move while they wait, and each
+// group's entries in a heap of their own: selection is O(log groups + log entries).
+// Not thread-safe, the caller serialises access.
+
+#ifndef STRIDE_MAX_GROUPS
+#define STRIDE_MAX_GROUPS 64
+#endif
+
+// Pass advanced per unit of CPU time by an entry or group holding one ticket
+#define STRIDE_ONE (1ULL << 20)
+
+#define STRIDE_NOT_QUEUED (~0U)
+
+typedef struct StrideGroup {
+  char name[32];
+  unsigned int tickets;
+  unsigned long long stride;        // STRIDE_ONE / tickets
+  unsigned long long pass;
+  unsigned long long virtual_pass;  // Pass of the entry taken last, new entries join from here
+  HeapT ready;                      // Ready entries keyed by pass
+  unsigned int position;            // Index in the group heap, STRIDE_NOT_QUEUED while empty
+  unsigned long long usage;         // CPU time charged
+} StrideGroupT;
+
+typedef struct StrideScheduler {
+  StrideGroupT groups[STRIDE_MAX_GROUPS];
+  unsigned int group_count;
+  unsigned int order[STRIDE_MAX_GROUPS];  // Groups with ready entries, lowest pass first
+  unsigned int order_length;
+  unsigned long long virtual_pass;        // Pass of the group taken last
+  atomic_ulong length;                    // Ready entries in every group, may be peeked unserialised
+} StrideSchedulerT;
+
+void stride_init(StrideSchedulerT* scheduler);
+void stride_destroy(StrideSchedulerT* scheduler);
+
+// Returns the new group's index, or -1 once STRIDE_MAX_GROUPS exist.
+// Zero tickets count as one.
+int stride_add_group(StrideSchedulerT* scheduler, char const* name, unsigned int tickets);
+
+// Pass advanced per unit of CPU time for the given tickets
+unsigned long long stride_of(unsigned int tickets);
+
+// Reserve heap room for one more entry of group, so stride_push never fails.
+// Returns false if the heap could not grow.
+bool stride_add_member(StrideSchedulerT* scheduler, unsigned int group);
+void stride_remove_member(StrideSchedulerT* scheduler, unsigned int group);
+
+// Pass for an entry of group joining or rejoining the ready set: one stride
+// behind the entry taken last, so time spent away earns no credit
+unsigned long long stride_join_pass(StrideSchedulerT const* scheduler, unsigned int group, unsigned long long stride);
+
+// Add a ready entry, within the room reserved by stride_add_member
+void stride_push(StrideSchedulerT* scheduler, unsigned int group, unsigned int id, unsigned long long pass);
+
+// Take the lowest-pass entry of the lowest-pass group, false if none is ready
+bool stride_pop(StrideSchedulerT* scheduler, unsigned int* id, unsigned long long* pass, unsigned int* group);
+
+// Charge group for units of CPU time, negative to refund an overestimate
+void stride_charge(StrideSchedulerT* scheduler, unsigned int group, long long units);
+
+// Drop every entry keep returns false for
+void stride_filter(StrideSchedulerT* scheduler, bool (*keep)(void* context, unsigned int id), void* context);
+
+#endif
@@ -0,0 +1,175 @@
+#include "stride.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Dispatch like the simulator does: charge the group for each slice and
+// requeue the entry one stride further on
+static void run_slices(StrideSchedulerT* scheduler, unsigned int slices, unsigned long long* per_group) {
+  for (unsigned int i = 0; i < slices; i++) {
+    unsigned int id, group;
+    unsigned long long pass;
+    assert(stride_pop(scheduler, &id, &pass, &group));
+    stride_charge(scheduler, group, 1);
+    per_group[group]++;
+    stride_push(scheduler, group, id, pass + stride_of(100));
+  }
+}
+
+void test_stride_empty() {
+  printf("Test stride empty\n");
+  StrideSchedulerT scheduler;
+  stride_init(&scheduler);
+  unsigned int id, group;
+  unsigned long long pass;
+  assert(stride_add_group(&scheduler, "default", 100) == 0);
+  assert(!stride_pop(&scheduler, &id, &pass, &group));
+  assert(scheduler.length == 0);
+  stride_destroy(&scheduler);
+}
+
+void test_stride_order() {
+  printf("Test stride order\n");
+  StrideSchedulerT scheduler;
+  stride_init(&scheduler);
+  int const group = stride_add_group(&scheduler, "default", 100);
+  unsigned long long const passes[] = { 50, 10, 40, 10, 30, 20 };
+  for (unsigned int i = 0; i < 6; i++) {
+    assert(stride_add_member(&scheduler, group));
+    stride_push(&scheduler, group, i + 1, passes[i]);
+  }
+  assert(scheduler.length == 6);
+
+  // Lowest pass first, ties by id
+  unsigned int const expected[] = { 2, 4, 6, 5, 3, 1 };
+  for (unsigned int i = 0; i < 6; i++) {
+    unsigned int id, popped_group;
+    unsigned long long pass;
+    assert(stride_pop(&scheduler, &id, &pass, &popped_group));
+    assert(id == expected[i]);
+    assert(popped_group == (unsigned int)group);
+  }
+  assert(scheduler.length == 0);
+  stride_destroy(&scheduler);
+}
+
+void test_stride_shares() {
+  printf("Test stride shares\n");
+  StrideSchedulerT scheduler;
+  stride_init(&scheduler);
+  int const tickets[] = { 100, 300, 600 };
+  for (unsigned int g = 0; g < 3; g++) {
+    assert(stride_add_group(&scheduler, "tenant", tickets[g]) == (int)g);
+    // Group size does not change a group's share
+    for (unsigned int i = 0; i < 2 + 5 * g; i++) {
+      assert(stride_add_member(&scheduler, g));
+      stride_push(&scheduler, g, 100 * g + i, stride_join_pass(&scheduler, g, stride_of(100)));
+    }
+  }
+
+  unsigned long long per_group[3] = { 0 };
+  run_slices(&scheduler, 10000, per_group);
+  assert(per_group[0] >= 990 && per_group[0] <= 1010);
+  assert(per_group[1] >= 2990 && per_group[1] <= 3010);
+  assert(per_group[2] >= 5990 && per_group[2] <= 6010);
+  assert(scheduler.groups[1].usage == per_group[1]);
+
+  // A refund is credited back to the group
+  unsigned long long const pass = scheduler.groups[0].pass;
+  stride_charge(&scheduler, 0, 4);
+  stride_charge(&scheduler, 0, -4);
+  assert(scheduler.groups[0].pass == pass);
+  stride_destroy(&scheduler);
+}
+
+void test_stride_idle_group() {
+  printf("Test stride idle group\n");
+  StrideSchedulerT scheduler;
+  stride_init(&scheduler);
+  stride_add_group(&scheduler, "busy", 100);
+  stride_add_group(&scheduler, "idle", 100);
+  assert(stride_add_member(&scheduler, 0));
+  assert(stride_add_member(&scheduler, 1));
+  stride_push(&scheduler, 0, 1, 0);
+
+  unsigned long long per_group[2] = { 0 };
+  run_slices(&scheduler, 1000, per_group);
+  assert(per_group[0] == 1000);
+
+  // The idle group rejoins at the current pass instead of running 1000 slices in a row
+  stride_push(&scheduler, 1, 2, stride_join_pass(&scheduler, 1, stride_of(100)));
+  per_group[0] = per_group[1] = 0;
+  run_slices(&scheduler, 100, per_group);
+  assert(per_group[0] >= 49 && per_group[0] <= 51);
+  stride_destroy(&scheduler);
+}
+
+static bool keep_even(void* context, unsigned int id) {
+  (*(unsigned int*)context)++;
+  return id % 2 == 0;
+}
+
+void test_stride_filter() {
+  printf("Test stride filter\n");
+  StrideSchedulerT scheduler;
+  stride_init(&scheduler);
+  stride_add_group(&scheduler, "a", 100);
+  stride_add_group(&scheduler, "b", 100);
+  for (unsigned int i = 0; i < 100; i++) {
+    assert(stride_add_member(&scheduler, i % 2 ? 1 : 0));
+    stride_push(&scheduler, i % 2 ? 1 : 0, i, 1000 - i);
+  }
+
+  unsigned int visited = 0;
+  stride_filter(&scheduler, keep_even, &visited);
+  assert(visited == 100);
+  assert(scheduler.length == 50);
+  assert(scheduler.order_length == 1);
+
+  unsigned long long last = 0;
+  for (unsigned int i = 0; i < 50; i++) {
+    unsigned int id, group;
+    unsigned long long pass;
+    assert(stride_pop(&scheduler, &id, &pass, &group));
+    assert(id % 2 == 0 && group == 0);
+    assert(pass >= last);
+    last = pass;
+  }
+  assert(!stride_pop(&scheduler, &(unsigned int){ 0 }, &last, &(unsigned int){ 0 }));
+  stride_destroy(&scheduler);
+}
+
+void test_stride_large() {
+  printf("Test stride large\n");
+  StrideSchedulerT scheduler;
+  stride_init(&scheduler);
+  stride_add_group(&scheduler, "default", 100);
+  unsigned int const n = 200000;
+  srand(1);
+  for (unsigned int i = 0; i < n; i++) {
+    assert(stride_add_member(&scheduler, 0));
+    stride_push(&scheduler, 0, i + 1, rand() % 100000);
+  }
+  assert(scheduler.groups[0].ready.capacity >= n);
+
+  unsigned long long last = 0;
+  for (unsigned int i = 0; i < n; i++) {
+    unsigned int id, group;
+    unsigned long long pass;
+    assert(stride_pop(&scheduler, &id, &pass, &group));
+    assert(pass >= last);
+    last = pass;
+  }
+  assert(scheduler.length == 0);
+  stride_destroy(&scheduler);
+}
+
+int main() {
+  test_stride_empty();
+  test_stride_order();
+  test_stride_shares();
+  test_stride_idle_group();
+  test_stride_filter();
+  test_stride_large();
+}
@@ -0,0 +1,237 @@
+#include "simulator.h"
+#include "environment.h"
+#include "event_source.h"
+#include "logger.h"
+#include "utilities.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Runs a parameter sweep in one process and prints a single results table.
+// Each lane keeps one simulator instance - its process table and worker
+// threads - and retunes it with simulator_reconfigure between points, so a
+// point costs no rebuild and no process start.
+//
+// usage: sweep [key=values ...]
+//   threads=2 environment=2 batch=10 interval=10 coalesce=1 adaptive=0 dispatch=1
+//     the swept dimensions; values are comma lists of numbers or lo-hi ranges,
+//     e.g. threads=1-4 batch=10,100,1000
+//   iterations=5       environment iterations per point
+//   processes=2048     initial process table size
+//   parallel=1         points run at once, each lane on its own simulator
+//   log=path           simulator log file, discarded by default
+
+#define SWEEP_MAX_VALUES 64
+
+typedef enum SweepDimension {
+  dimension_threads,
+  dimension_environment,
+  dimension_batch,
+  dimension_interval,
+  dimension_coalesce,
+  dimension_adaptive,
+  dimension_dispatch,
+  dimension_count
+} SweepDimensionT;
+
+static char const* const dimension_names[dimension_count] = {
+  "threads", "environment", "batch", "interval", "coalesce", "adaptive", "dispatch",
+};
+
+typedef struct SweepResult {
+  unsigned int values[dimension_count];
+  double seconds;
+  unsigned long long created;
+  SimulatorReportT report;
+} SweepResultT;
+
+static unsigned int values[dimension_count][SWEEP_MAX_VALUES];
+static unsigned int value_counts[dimension_count];
+static unsigned int iterations = 5;
+static unsigned int max_processes = 2048;
+static unsigned int max_threads = 0;
+
+static SweepResultT* results;
+static unsigned int point_count;
+static atomic_uint next_point = 0;
+
+static void parse_values(SweepDimensionT dimension, char const* list) {
+  value_counts[dimension] = 0;
+  char* copy = strdup(list);
+  for (char* item = strtok(copy, ","); item; item = strtok(NULL, ",")) {
+    unsigned int low, high;
+    int const fields = sscanf(item, "%u-%u", &low, &high);
+    if (fields < 1) {
+      fprintf(stderr, "Error: Invalid value \"%s\" for %s\n", item, dimension_names[dimension]);
+      exit(EXIT_FAILURE);
+    }
+    if (fields == 1) {
+      high = low;
+    }
+    for (unsigned int value = low; value <= high; value++) {
+      if (value_counts[dimension] == SWEEP_MAX_VALUES) {
+        fprintf(stderr, "Error: More than %d values for %s\n", SWEEP_MAX_VALUES, dimension_names[dimension]);
+        exit(EXIT_FAILURE);
+      }
+      values[dimension][value_counts[dimension]++] = value;
+    }
+  }
+  free(copy);
+  if (value_counts[dimension] == 0) {
+    fprintf(stderr, "Error: No values for %s\n", dimension_names[dimension]);
+    exit(EXIT_FAILURE);
+  }
+}
+
+// Point index to one value per dimension, the last dimension varying fastest
+static void decode_point(unsigned int point, unsigned int* point_values) {
+  for (int dimension = dimension_count - 1; dimension >= 0; dimension--) {
+    point_values[dimension] = values[dimension][point % value_counts[dimension]];
+    point /= value_counts[dimension];
+  }
+}
+
+static void run_point(SimulatorT* simulator, SweepResultT* result) {
+  unsigned int const* v = result->values;
+  SimulatorConfigT const config = {
+    .coalesce_slices = v[dimension_coalesce],
+    .adaptive_quantum = v[dimension_adaptive] != 0,
+    .dispatch_batch = v[dimension_dispatch],
+  };
+  simulator_reconfigure(simulator, v[dimension_threads], &config);
+
+  EventSourceT* event_source = event_source_start(simulator, v[dimension_interval], NULL);
+  unsigned long long const start = monotonic_ns();
+  EnvironmentT* environment = environment_start(simulator, v[dimension_environment], iterations, v[dimension_batch], NULL);
+  environment_stop(environment);
+  result->seconds = (monotonic_ns() - start) / 1e9;
+  event_source_stop(event_source);
+
+  result->created = (unsigned long long)v[dimension_environment] * iterations * v[dimension_batch];
+  result->report = simulator_report(simulator);
+}
+
+static void* lane_routine(void* unused) {
+  SimulatorT* simulator = NULL;
+  for (unsigned int point = atomic_fetch_add(&next_point, 1); point < point_count;
+       point = atomic_fetch_add(&next_point, 1)) {
+    // Started lazily so a lane with no points costs nothing
+    if (!simulator) {
+      simulator = simulator_start(max_threads, max_processes, NULL);
+    }
+    decode_point(point, results[point].values);
+    run_point(simulator, &results[point]);
+  }
+  if (simulator) {
+    simulator_stop(simulator);
+  }
+  return NULL;
+}
+
+static void print_results() {
+  for (int dimension = 0; dimension != dimension_count; ++dimension) {
+    printf("%*s ", (int)strlen(dimension_names[dimension]), dimension_names[dimension]);
+  }
+  printf("%10s %10s %12s %12s %12s %14s\n", "seconds", "created", "slices", "dispatches", "cpu_time", "slices/s");
+
+  for (unsigned int point = 0; point != point_count; ++point) {
+    SweepResultT const* result = &results[point];
+    for (int dimension = 0; dimension != dimension_count; ++dimension) {
+      printf("%*u ", (int)strlen(dimension_names[dimension]), result->values[dimension]);
+    }
+    printf("%10.3f %10llu %12llu %12llu %12llu %14.1f\n", result->seconds, result->created,
+           result->report.slices, result->report.dispatches, result->report.cpu_time,
+           result->seconds > 0 ? result->report.slices / result->seconds : 0.0);
+  }
+}
+
+int main(int argc, char** argv) {
+  char const* const defaults[dimension_count] = { "2", "2", "10", "10", "1", "0", "1" };
+  for (int dimension = 0; dimension != dimension_count; ++dimension) {
+    parse_values(dimension, defaults[dimension]);
+  }
+
+  unsigned int parallel = 1;
+  char const* log_path = NULL;
+  for (int i = 1; i < argc; i++) {
+    char* equals = strchr(argv[i], '=');
+    if (!equals) {
+      fprintf(stderr, "Error: Expected key=values, got \"%s\"\n", argv[i]);
+      return EXIT_FAILURE;
+    }
+    *equals = '\0';
+    char const* key = argv[i];
+    char const* value = equals + 1;
+
+    int dimension = 0;
+    while (dimension != dimension_count && strcmp(key, dimension_names[dimension]) != 0) {
+      dimension++;
+    }
+    if (dimension != dimension_count) {
+      parse_values(dimension, value);
+    } else if (strcmp(key, "iterations") == 0) {
+      iterations = atoi(value);
+    } else if (strcmp(key, "processes") == 0) {
+      max_processes = atoi(value);
+    } else if (strcmp(key, "parallel") == 0) {
+      parallel = atoi(value);
+    } else if (strcmp(key, "log") == 0) {
+      log_path = value;
+    } else {
+      fprintf(stderr, "Error: Unknown sweep key \"%s\"\n", key);
+      return EXIT_FAILURE;
+    }
+  }
+
+  point_count = 1;
+  for (int dimension = 0; dimension != dimension_count; ++dimension) {
+    point_count *= value_counts[dimension];
+  }
+  for (unsigned int i = 0; i != value_counts[dimension_threads]; ++i) {
+    if (values[dimension_threads][i] > max_threads) {
+      max_threads = values[dimension_threads][i];
+    }
+  }
+  if (parallel == 0) {
+    parallel = 1;
+  }
+  if (parallel > point_count) {
+    parallel = point_count;
+  }
+
+  FILE* log_file = NULL;
+  if (log_path) {
+    log_file = fopen(log_path, "w");
+    if (!log_file) {
+      fprintf(stderr, "Error: Unable to open log file %s\n", log_path);
+      return EXIT_FAILURE;
+    }
+  }
+  logger_start();
+  logger_set_output(log_file);
+
+  results = checked_malloc(sizeof(SweepResultT) * point_count);
+  pthread_t* lanes = checked_malloc(sizeof(pthread_t) * parallel);
+  for (unsigned int i = 0; i != parallel; ++i) {
+    if (pthread_create(&lanes[i], NULL, lane_routine, NULL) != 0) {
+      fprintf(stderr, "Error: Unable to create sweep lane %u\n", i);
+      return EXIT_FAILURE;
+    }
+  }
+  for (unsigned int i = 0; i != parallel; ++i) {
+    pthread_join(lanes[i], NULL);
+  }
+
+  print_results();
+
+  checked_free(lanes);
+  checked_free(results);
+  logger_stop();
+  if (log_file) {
+    fclose(log_file);
+  }
+  return EXIT_SUCCESS;
+}
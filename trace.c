@@ -0,0 +1,210 @@
+#include "trace.h"
+#include "utilities.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+
+// Events per buffer block, blocks are chained so recorded events never move
+#define TRACE_BLOCK_EVENTS 4096
+
+// Cap per thread so a long run cannot exhaust memory, later events are dropped
+#ifndef TRACE_MAX_EVENTS
+#define TRACE_MAX_EVENTS (1u << 20)
+#endif
+
+typedef struct TraceEvent {
+  char const* name;
+  char const* reason;
+  unsigned long long start_ns;
+  unsigned long long end_ns;    // Slices only
+  unsigned long a;              // Process id, or ready depth for counters
+  unsigned long b;              // PC, or blocked depth for counters
+  TraceEventKindT kind;
+} TraceEventT;
+
+typedef struct TraceBlock {
+  TraceEventT events[TRACE_BLOCK_EVENTS];
+  struct TraceBlock* next;
+} TraceBlockT;
+
+typedef struct TraceBuffer {
+  char name[32];
+  unsigned int tid;
+  TraceBlockT* first;
+  TraceBlockT* last;
+  atomic_uint count;            // Published with release so trace_stop reads whole events
+  unsigned int dropped;
+  struct TraceBuffer* next;
+} TraceBufferT;
+
+atomic_bool trace_enabled = false;
+static atomic_bool trace_claimed = false;   // Held from trace_start until trace_stop has written the file
+
+static char const* trace_path = NULL;
+static unsigned long long trace_origin_ns = 0;
+static TraceBufferT* _Atomic buffers = NULL;
+static atomic_uint next_tid = 1;
+static _Atomic unsigned int generation = 0;   // Invalidates thread pointers across runs
+
+static __thread TraceBufferT* thread_buffer = NULL;
+static __thread unsigned int thread_generation = 0;
+
+static TraceBufferT* buffer() {
+  unsigned int const current = atomic_load_explicit(&generation, memory_order_acquire);
+  if (thread_buffer && thread_generation == current) {
+    return thread_buffer;
+  }
+
+  TraceBufferT* created = (TraceBufferT*)checked_malloc(sizeof(TraceBufferT));
+  memset(created, 0, sizeof(TraceBufferT));
+  created->tid = atomic_fetch_add(&next_tid, 1);
+  snprintf(created->name, sizeof(created->name), "thread %u", created->tid);
+  created->next = atomic_load(&buffers);
+  while (!atomic_compare_exchange_weak(&buffers, &created->next, created));
+
+  thread_buffer = created;
+  thread_generation = current;
+  return created;
+}
+
+static TraceEventT* append() {
+  TraceBufferT* const own = buffer();
+  unsigned int const count = atomic_load_explicit(&own->count, memory_order_relaxed);
+  if (count == TRACE_MAX_EVENTS) {
+    own->dropped++;
+    return NULL;
+  }
+  if (count % TRACE_BLOCK_EVENTS == 0) {
+    TraceBlockT* block = (TraceBlockT*)checked_malloc(sizeof(TraceBlockT));
+    block->next = NULL;
+    if (own->last) {
+      own->last->next = block;
+    } else {
+      own->first = block;
+    }
+    own->last = block;
+  }
+  return &own->last->events[count % TRACE_BLOCK_EVENTS];
+}
+
+static void publish() {
+  atomic_fetch_add_explicit(&thread_buffer->count, 1, memory_order_release);
+}
+
+bool trace_start(char const* path) {
+  bool expected = false;
+  if (!atomic_compare_exchange_strong(&trace_claimed, &expected, true)) {
+    return false;
+  }
+  trace_path = path;
+  trace_origin_ns = monotonic_ns();
+  atomic_fetch_add_explicit(&generation, 1, memory_order_release);
+  trace_enabled = true;
+  return true;
+}
+
+void trace_name_thread(char const* name) {
+  if (trace_enabled) {
+    snprintf(buffer()->name, sizeof(buffer()->name), "%s", name);
+  }
+}
+
+void trace_slice_event(char const* name, unsigned long long start_ns, unsigned long long end_ns,
+                       unsigned int pid, unsigned int PC, char const* reason) {
+  if (!trace_enabled) return;
+  TraceEventT* event = append();
+  if (!event) return;
+  *event = (TraceEventT){ name, reason, start_ns, end_ns, pid, PC, trace_slice };
+  publish();
+}
+
+void trace_instant_event(char const* name, unsigned int pid) {
+  if (!trace_enabled) return;
+  TraceEventT* event = append();
+  if (!event) return;
+  *event = (TraceEventT){ name, NULL, monotonic_ns(), 0, pid, 0, trace_instant };
+  publish();
+}
+
+void trace_queue_counter(unsigned long ready, unsigned long blocked) {
+  if (!trace_enabled) return;
+  TraceEventT* event = append();
+  if (!event) return;
+  *event = (TraceEventT){ "queues", NULL, monotonic_ns(), 0, ready, blocked, trace_counter };
+  publish();
+}
+
+// Trace timestamps are microseconds from trace_start
+static double micros(unsigned long long ns) {
+  return ns > trace_origin_ns ? (ns - trace_origin_ns) / 1000.0 : 0.0;
+}
+
+static void write_event(FILE* file, TraceBufferT const* owner, TraceEventT const* event) {
+  switch (event->kind) {
+  case trace_slice:
+    fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,"
+                  "\"args\":{\"pid\":%lu,\"PC\":%lu,\"reason\":\"%s\"}}",
+            event->name, owner->tid, micros(event->start_ns), (event->end_ns - event->start_ns) / 1000.0,
+            event->a, event->b, event->reason ? event->reason : "");
+    break;
+  case trace_instant:
+    fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,"
+                  "\"args\":{\"pid\":%lu}}",
+            event->name, owner->tid, micros(event->start_ns), event->a);
+    break;
+  case trace_counter:
+    fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"C\",\"pid\":1,\"ts\":%.3f,\"args\":{\"ready\":%lu,\"blocked\":%lu}}",
+            event->name, micros(event->start_ns), event->a, event->b);
+    break;
+  }
+}
+
+void trace_stop() {
+  if (!trace_enabled) return;
+  trace_enabled = false;
+
+  FILE* file = fopen(trace_path, "w");
+  if (!file) {
+    fprintf(stderr, "Error: Unable to create trace file %s\n", trace_path);
+    exit(EXIT_FAILURE);
+  }
+
+  fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n"
+                "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"simulator\"}}");
+  unsigned long long dropped = 0;
+  for (TraceBufferT* owner = atomic_load(&buffers); owner; owner = owner->next) {
+    fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+            owner->tid, owner->name);
+    unsigned int const count = atomic_load_explicit(&owner->count, memory_order_acquire);
+    TraceBlockT* block = owner->first;
+    for (unsigned int i = 0; i < count; i++) {
+      if (i && i % TRACE_BLOCK_EVENTS == 0) {
+        block = block->next;
+      }
+      write_event(file, owner, &block->events[i % TRACE_BLOCK_EVENTS]);
+    }
+    dropped += owner->dropped;
+  }
+  fprintf(file, "\n]}\n");
+  fclose(file);
+
+  if (dropped) {
+    fprintf(stderr, "Warning: %llu trace events dropped\n", dropped);
+  }
+
+  // Threads still alive allocate a fresh buffer if tracing restarts
+  TraceBufferT* owner = atomic_exchange(&buffers, NULL);
+  while (owner) {
+    TraceBufferT* next_owner = owner->next;
+    for (TraceBlockT* block = owner->first; block;) {
+      TraceBlockT* next_block = block->next;
+      checked_free(block);
+      block = next_block;
+    }
+    checked_free(owner);
+    owner = next_owner;
+  }
+  atomic_store(&trace_claimed, false);
+}
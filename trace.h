@@ -0,0 +1,36 @@
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include <stdatomic.h>
+#include <stdbool.h>
+
+// Timeline export in the Chrome/Perfetto trace-event JSON format. Threads
+// append events to buffers of their own without locking; trace_stop writes
+// every buffer to the file once the traced threads have quiesced.
+
+typedef enum TraceEventKind {
+  trace_slice,     // A span of one thread's time, "X" in the trace format
+  trace_instant,   // A point in time, "i"
+  trace_counter    // Sampled values, "C"
+} TraceEventKindT;
+
+extern atomic_bool trace_enabled;
+
+// Start buffering events, written to path by trace_stop. Only one recording
+// runs at a time: returns false, changing nothing, while another is in progress
+bool trace_start(char const* path);
+// Write the trace file and free every buffer
+void trace_stop();
+
+// Label the calling thread's track, e.g. "worker 2"
+void trace_name_thread(char const* name);
+
+// Record a slice from start_ns to end_ns of process pid (0 for none)
+void trace_slice_event(char const* name, unsigned long long start_ns, unsigned long long end_ns,
+                       unsigned int pid, unsigned int PC, char const* reason);
+// Record an instant event about process pid
+void trace_instant_event(char const* name, unsigned int pid);
+// Record the ready and blocked queue depths
+void trace_queue_counter(unsigned long ready, unsigned long blocked);
+
+#endif
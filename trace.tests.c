@@ -0,0 +1,78 @@
+#include "trace.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static unsigned int count_occurrences(char const* text, char const* pattern) {
+  unsigned int count = 0;
+  for (char const* at = strstr(text, pattern); at; at = strstr(at + 1, pattern)) {
+    count++;
+  }
+  return count;
+}
+
+static void read_file(char const* path, char* text, size_t size) {
+  FILE* file = fopen(path, "r");
+  assert(file);
+  size_t const length = fread(text, 1, size - 1, file);
+  text[length] = '\0';
+  fclose(file);
+}
+
+void* traced_routine(void* arg) {
+  trace_name_thread("traced worker");
+  trace_slice_event("slice", 1000, 3000, 7, 42, "blocked");
+  trace_instant_event("block", 7);
+  return NULL;
+}
+
+void test_trace_disabled() {
+  printf("Test trace disabled\n");
+  // Recording without trace_start is a no-op
+  trace_instant_event("kill", 1);
+  trace_stop();
+}
+
+void test_trace_events() {
+  printf("Test trace events\n");
+  char path[] = "/tmp/trace.testsXXXXXX";
+  close(mkstemp(path));
+
+  assert(trace_start(path));
+  // Only one recording at a time
+  assert(!trace_start("/tmp/trace.tests.other"));
+  pthread_t thread;
+  pthread_create(&thread, NULL, traced_routine, NULL);
+  pthread_join(thread, NULL);
+  trace_queue_counter(3, 1);
+  trace_instant_event("wake", 7);
+  trace_stop();
+
+  static char text[16384];
+  read_file(path, text, sizeof(text));
+  assert(strncmp(text, "{\"displayTimeUnit\"", 18) == 0);
+  assert(count_occurrences(text, "\"ph\":\"X\"") == 1);
+  assert(count_occurrences(text, "\"ph\":\"i\"") == 2);
+  assert(count_occurrences(text, "\"ph\":\"C\"") == 1);
+  assert(count_occurrences(text, "\"name\":\"traced worker\"") == 1);
+  assert(strstr(text, "\"args\":{\"pid\":7,\"PC\":42,\"reason\":\"blocked\"}"));
+  assert(strstr(text, "\"args\":{\"ready\":3,\"blocked\":1}"));
+
+  // A second run starts from empty buffers
+  assert(trace_start(path));
+  trace_instant_event("kill", 9);
+  trace_stop();
+  read_file(path, text, sizeof(text));
+  assert(count_occurrences(text, "\"ph\":\"i\"") == 1);
+  assert(count_occurrences(text, "\"ph\":\"X\"") == 0);
+  unlink(path);
+}
+
+int main() {
+  test_trace_disabled();
+  test_trace_events();
+}
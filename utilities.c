@@ -1,6 +1,7 @@
 #include "utilities.h"
 
 #include <assert.h>
+#include <time.h>
 
 void* checked_malloc(size_t size) {
   void* result = malloc(size);
@@ -12,3 +13,9 @@ void checked_free(void* addr) {
   assert(addr);
   free(addr);
 }
+
+unsigned long long monotonic_ns() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (unsigned long long)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
@@ -3,7 +3,15 @@
 
 #include <stdlib.h>
 
+// Assumed size of a cache line, used to keep data written by different threads apart
+#ifndef CACHE_LINE_SIZE
+#define CACHE_LINE_SIZE 64
+#endif
+
 void* checked_malloc(size_t size);
 void checked_free(void* addr);
 
+// Nanoseconds on the monotonic clock
+unsigned long long monotonic_ns();
+
 #endif